@@ -12,10 +12,12 @@
 #include <crypto/skcipher.h>
 #include <linux/blk-cgroup.h>
 #include <linux/blk-crypto.h>
+#include <linux/cpuhotplug.h>
 #include <linux/crypto.h>
 #include <linux/keyslot-manager.h>
 #include <linux/mempool.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/random.h>
 
 #include "blk-crypto-internal.h"
@@ -35,6 +37,17 @@ module_param(num_prealloc_fallback_crypt_ctxs, uint, 0);
 MODULE_PARM_DESC(num_prealloc_crypt_fallback_ctxs,
 		 "Number of preallocated bio fallback crypto contexts for blk-crypto to use during crypto API fallback");
 
+static unsigned int parallel_chunk_kb = 64;
+module_param(parallel_chunk_kb, uint, 0644);
+MODULE_PARM_DESC(parallel_chunk_kb,
+		 "Split bios larger than this many KiB into chunks en/decrypted on several CPUs, 0 to disable");
+
+/* Data units in flight per chunk when the skcipher completes asynchronously */
+#define BLK_CRYPTO_BATCH_SIZE		16
+
+/* Bounce pages cached per CPU in front of the mempool */
+#define BLK_CRYPTO_PCP_BOUNCE_PAGES	32
+
 struct bio_fallback_crypt_ctx {
 	struct bio_crypt_ctx crypt_ctx;
 	/*
@@ -68,6 +81,52 @@ struct blk_crypto_decrypt_work {
 	struct bio *bio;
 };
 
+/* Tracks the chunks a bio was split into for parallel en/decryption */
+struct blk_crypto_chunk_ctl {
+	atomic_t remaining;
+	struct completion done;
+	blk_status_t status;
+};
+
+/* A range of data units en/decrypted by a single context */
+struct blk_crypto_chunk {
+	struct work_struct work;
+	struct blk_crypto_chunk_ctl *ctl;
+	struct crypto_skcipher *tfm;
+	struct bio *src_bio;
+	struct bio *dst_bio;
+	struct bvec_iter src_iter;
+	struct bvec_iter dst_iter;
+	u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
+	unsigned int data_unit_size;
+	bool encrypt;
+};
+
+union blk_crypto_iv {
+	__le64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
+	u8 bytes[BLK_CRYPTO_MAX_IV_SIZE];
+};
+
+struct blk_crypto_batch_req {
+	struct skcipher_request *req;
+	union blk_crypto_iv iv;
+	struct scatterlist *src;
+	struct scatterlist *dst;
+};
+
+/* Up to BLK_CRYPTO_BATCH_SIZE skcipher requests submitted before waiting */
+struct blk_crypto_batch {
+	atomic_t pending;
+	struct completion done;
+	int err;
+	struct blk_crypto_batch_req reqs[BLK_CRYPTO_BATCH_SIZE];
+};
+
+struct blk_crypto_bounce_cache {
+	unsigned int nr;
+	struct page *pages[BLK_CRYPTO_PCP_BOUNCE_PAGES];
+};
+
 static struct blk_crypto_keyslot {
 	struct crypto_skcipher *tfm;
 	enum blk_crypto_mode_num crypto_mode;
@@ -77,7 +136,9 @@ static struct blk_crypto_keyslot {
 /* The following few vars are only used during the crypto API fallback */
 static struct keyslot_manager *blk_crypto_ksm;
 static struct workqueue_struct *blk_crypto_wq;
+static struct workqueue_struct *blk_crypto_chunk_wq;
 static mempool_t *blk_crypto_bounce_page_pool;
+static DEFINE_PER_CPU(struct blk_crypto_bounce_cache, blk_crypto_bounce_cache);
 static struct kmem_cache *blk_crypto_decrypt_work_cache;
 
 bool bio_crypt_fallback_crypted(const struct bio_crypt_ctx *bc)
@@ -150,14 +211,62 @@ static const struct keyslot_mgmt_ll_ops blk_crypto_ksm_ll_ops = {
 	.keyslot_evict		= blk_crypto_keyslot_evict,
 };
 
+static struct page *blk_crypto_alloc_bounce_page(void)
+{
+	struct blk_crypto_bounce_cache *cache;
+	struct page *page = NULL;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&blk_crypto_bounce_cache);
+	if (cache->nr)
+		page = cache->pages[--cache->nr];
+	local_irq_restore(flags);
+
+	return page ?: mempool_alloc(blk_crypto_bounce_page_pool, GFP_NOIO);
+}
+
+static void blk_crypto_free_bounce_page(struct page *page)
+{
+	struct blk_crypto_bounce_cache *cache;
+	unsigned long flags;
+
+	/* Refill the reserve first, an allocation may be waiting for it */
+	if (READ_ONCE(blk_crypto_bounce_page_pool->curr_nr) <
+	    blk_crypto_bounce_page_pool->min_nr)
+		goto out_mempool;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&blk_crypto_bounce_cache);
+	if (cache->nr < BLK_CRYPTO_PCP_BOUNCE_PAGES) {
+		cache->pages[cache->nr++] = page;
+		page = NULL;
+	}
+	local_irq_restore(flags);
+	if (!page)
+		return;
+out_mempool:
+	mempool_free(page, blk_crypto_bounce_page_pool);
+}
+
+static int blk_crypto_bounce_cache_dead(unsigned int cpu)
+{
+	struct blk_crypto_bounce_cache *cache =
+		per_cpu_ptr(&blk_crypto_bounce_cache, cpu);
+
+	while (cache->nr)
+		mempool_free(cache->pages[--cache->nr],
+			     blk_crypto_bounce_page_pool);
+	return 0;
+}
+
 static void blk_crypto_encrypt_endio(struct bio *enc_bio)
 {
 	struct bio *src_bio = enc_bio->bi_private;
 	int i;
 
 	for (i = 0; i < enc_bio->bi_vcnt; i++)
-		mempool_free(enc_bio->bi_io_vec[i].bv_page,
-			     blk_crypto_bounce_page_pool);
+		blk_crypto_free_bounce_page(enc_bio->bi_io_vec[i].bv_page);
 
 	src_bio->bi_status = enc_bio->bi_status;
 
@@ -197,29 +306,6 @@ static struct bio *blk_crypto_clone_bio(struct bio *bio_src)
 	return bio;
 }
 
-static int blk_crypto_alloc_cipher_req(struct bio *src_bio,
-				       struct skcipher_request **ciph_req_ret,
-				       struct crypto_wait *wait)
-{
-	struct skcipher_request *ciph_req;
-	const struct blk_crypto_keyslot *slotp;
-
-	slotp = &blk_crypto_keyslots[src_bio->bi_crypt_context->bc_keyslot];
-	ciph_req = skcipher_request_alloc(slotp->tfms[slotp->crypto_mode],
-					  GFP_NOIO);
-	if (!ciph_req) {
-		src_bio->bi_status = BLK_STS_RESOURCE;
-		return -ENOMEM;
-	}
-
-	skcipher_request_set_callback(ciph_req,
-				      CRYPTO_TFM_REQ_MAY_BACKLOG |
-				      CRYPTO_TFM_REQ_MAY_SLEEP,
-				      crypto_req_done, wait);
-	*ciph_req_ret = ciph_req;
-	return 0;
-}
-
 static int blk_crypto_split_bio_if_needed(struct bio **bio_ptr)
 {
 	struct bio *bio = *bio_ptr;
@@ -248,11 +334,6 @@ static int blk_crypto_split_bio_if_needed(struct bio **bio_ptr)
 	return 0;
 }
 
-union blk_crypto_iv {
-	__le64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
-	u8 bytes[BLK_CRYPTO_MAX_IV_SIZE];
-};
-
 static void blk_crypto_dun_to_iv(const u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE],
 				 union blk_crypto_iv *iv)
 {
@@ -266,18 +347,11 @@ static void blk_crypto_dun_to_iv(const u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE],
  * If the length of any bio segment isn't a multiple of data_unit_size
  * (which can happen if data_unit_size > logical_block_size), then each
  * encryption/decryption might need to be passed multiple scatterlist elements.
- * If that will be the case, this function allocates and initializes src and dst
- * scatterlists (or a combined src/dst scatterlist) with the needed length.
- *
- * If 1 element is guaranteed to be enough (which is usually the case, and is
- * guaranteed when data_unit_size <= logical_block_size), then this function
- * just initializes the on-stack scatterlist(s).
+ * Returns the number of elements needed per data unit, which is usually 1.
  */
-static bool blk_crypto_alloc_sglists(struct bio *bio,
-				     const struct bvec_iter *start_iter,
-				     unsigned int data_unit_size,
-				     struct scatterlist **src_p,
-				     struct scatterlist **dst_p)
+static unsigned int blk_crypto_sg_count(struct bio *bio,
+					const struct bvec_iter *start_iter,
+					unsigned int data_unit_size)
 {
 	struct bio_vec bv;
 	struct bvec_iter iter;
@@ -288,37 +362,275 @@ static bool blk_crypto_alloc_sglists(struct bio *bio,
 		count++;
 		aligned &= IS_ALIGNED(bv.bv_len, data_unit_size);
 	}
-	if (aligned) {
-		count = 1;
-	} else {
-		/*
-		 * We can't need more elements than bio segments, and we can't
-		 * need more than the number of sectors per data unit.  This may
-		 * overestimate the required length by a bit, but that's okay.
-		 */
-		count = min(count, data_unit_size >> SECTOR_SHIFT);
+	if (aligned)
+		return 1;
+
+	/*
+	 * We can't need more elements than bio segments, and we can't need
+	 * more than the number of sectors per data unit.  This may overestimate
+	 * the required length by a bit, but that's okay.
+	 */
+	return min(count, data_unit_size >> SECTOR_SHIFT);
+}
+
+static void blk_crypto_batch_done(struct crypto_async_request *areq, int err)
+{
+	struct blk_crypto_batch *batch = areq->data;
+
+	/* A backlogged request was queued, it will complete later */
+	if (err == -EINPROGRESS)
+		return;
+
+	if (err)
+		WRITE_ONCE(batch->err, err);
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+}
+
+/*
+ * Allocate the batch along with its skcipher requests and scatterlists in a
+ * single allocation, so a chunk costs one allocation however many data units
+ * it covers.
+ */
+static struct blk_crypto_batch *
+blk_crypto_alloc_batch(struct crypto_skcipher *tfm, unsigned int nr_sg)
+{
+	const unsigned int hdr_size = ALIGN(sizeof(struct blk_crypto_batch),
+					    CRYPTO_MINALIGN);
+	const unsigned int req_size = ALIGN(sizeof(struct skcipher_request) +
+					    crypto_skcipher_reqsize(tfm),
+					    CRYPTO_MINALIGN);
+	struct blk_crypto_batch *batch;
+	struct scatterlist *sg;
+	u8 *reqs;
+	int i;
+
+	batch = kmalloc(hdr_size + BLK_CRYPTO_BATCH_SIZE *
+			(req_size + 2 * nr_sg * sizeof(*sg)), GFP_NOIO);
+	if (!batch)
+		return NULL;
+
+	reqs = (u8 *)batch + hdr_size;
+	sg = (struct scatterlist *)(reqs + BLK_CRYPTO_BATCH_SIZE * req_size);
+	for (i = 0; i < BLK_CRYPTO_BATCH_SIZE; i++) {
+		struct blk_crypto_batch_req *r = &batch->reqs[i];
+
+		r->req = (struct skcipher_request *)(reqs + i * req_size);
+		skcipher_request_set_tfm(r->req, tfm);
+		skcipher_request_set_callback(r->req,
+					      CRYPTO_TFM_REQ_MAY_BACKLOG |
+					      CRYPTO_TFM_REQ_MAY_SLEEP,
+					      blk_crypto_batch_done, batch);
+		r->src = sg;
+		sg_init_table(r->src, nr_sg);
+		sg += nr_sg;
+		r->dst = sg;
+		sg_init_table(r->dst, nr_sg);
+		sg += nr_sg;
 	}
 
-	if (count > 1) {
-		*src_p = kmalloc_array(count, sizeof(struct scatterlist),
-				       GFP_NOIO);
-		if (!*src_p)
-			return false;
-		if (dst_p) {
-			*dst_p = kmalloc_array(count,
-					       sizeof(struct scatterlist),
-					       GFP_NOIO);
-			if (!*dst_p) {
-				kfree(*src_p);
-				*src_p = NULL;
-				return false;
-			}
+	atomic_set(&batch->pending, 1);
+	init_completion(&batch->done);
+	batch->err = 0;
+	return batch;
+}
+
+/* Wait for all the requests submitted so far, and get ready for more */
+static int blk_crypto_batch_wait(struct blk_crypto_batch *batch)
+{
+	if (!atomic_dec_and_test(&batch->pending))
+		wait_for_completion(&batch->done);
+
+	atomic_set(&batch->pending, 1);
+	reinit_completion(&batch->done);
+	return batch->err;
+}
+
+/*
+ * En/decrypt the data units of a chunk. Up to BLK_CRYPTO_BATCH_SIZE requests
+ * are submitted before waiting, so that asynchronous skcipher implementations
+ * can work on several data units at once. Synchronous ones complete each
+ * request on submission.
+ *
+ * Take care to handle the case where a data unit spans bio segments.  This
+ * can happen when data_unit_size > logical_block_size.
+ */
+static blk_status_t blk_crypto_crypt_chunk(struct blk_crypto_chunk *chunk)
+{
+	const unsigned int data_unit_size = chunk->data_unit_size;
+	const bool inplace = chunk->src_bio == chunk->dst_bio;
+	struct bvec_iter src_iter = chunk->src_iter;
+	struct bvec_iter dst_iter = chunk->dst_iter;
+	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
+	struct blk_crypto_batch *batch;
+	unsigned int nr_reqs = 0;
+	unsigned int sg_idx = 0;
+	unsigned int du_filled = 0;
+	int err = 0, wait_err;
+
+	batch = blk_crypto_alloc_batch(chunk->tfm,
+				       blk_crypto_sg_count(chunk->src_bio,
+							   &src_iter,
+							   data_unit_size));
+	if (!batch)
+		return BLK_STS_RESOURCE;
+
+	memcpy(curr_dun, chunk->dun, sizeof(curr_dun));
+
+	while (src_iter.bi_size) {
+		struct bio_vec src_bv = bio_iter_iovec(chunk->src_bio, src_iter);
+		struct bio_vec dst_bv = bio_iter_iovec(chunk->dst_bio, dst_iter);
+		struct blk_crypto_batch_req *r = &batch->reqs[nr_reqs];
+		unsigned int n = min3(src_bv.bv_len, dst_bv.bv_len,
+				      data_unit_size - du_filled);
+
+		sg_set_page(&r->src[sg_idx], src_bv.bv_page, n,
+			    src_bv.bv_offset);
+		if (!inplace)
+			sg_set_page(&r->dst[sg_idx], dst_bv.bv_page, n,
+				    dst_bv.bv_offset);
+		sg_idx++;
+		bio_advance_iter(chunk->src_bio, &src_iter, n);
+		bio_advance_iter(chunk->dst_bio, &dst_iter, n);
+		du_filled += n;
+		if (du_filled < data_unit_size)
+			continue;
+
+		blk_crypto_dun_to_iv(curr_dun, &r->iv);
+		skcipher_request_set_crypt(r->req, r->src,
+					   inplace ? r->src : r->dst,
+					   data_unit_size, r->iv.bytes);
+		atomic_inc(&batch->pending);
+		err = chunk->encrypt ? crypto_skcipher_encrypt(r->req) :
+				       crypto_skcipher_decrypt(r->req);
+		if (err == -EINPROGRESS || err == -EBUSY) {
+			err = 0;
+		} else {
+			atomic_dec(&batch->pending);
+			if (err)
+				break;
+		}
+		bio_crypt_dun_increment(curr_dun, 1);
+		sg_idx = 0;
+		du_filled = 0;
+
+		if (++nr_reqs == BLK_CRYPTO_BATCH_SIZE) {
+			err = blk_crypto_batch_wait(batch);
+			if (err)
+				break;
+			nr_reqs = 0;
 		}
 	}
-	sg_init_table(*src_p, count);
-	if (dst_p)
-		sg_init_table(*dst_p, count);
-	return true;
+
+	/* Requests still in flight reference the batch */
+	wait_err = blk_crypto_batch_wait(batch);
+	kzfree(batch);
+
+	if (err || wait_err || WARN_ON_ONCE(du_filled != 0))
+		return BLK_STS_IOERR;
+	return BLK_STS_OK;
+}
+
+static void blk_crypto_chunk_done(struct blk_crypto_chunk *chunk,
+				  blk_status_t status)
+{
+	struct blk_crypto_chunk_ctl *ctl = chunk->ctl;
+
+	if (status)
+		WRITE_ONCE(ctl->status, status);
+	if (atomic_dec_and_test(&ctl->remaining))
+		complete(&ctl->done);
+}
+
+static void blk_crypto_chunk_work(struct work_struct *work)
+{
+	struct blk_crypto_chunk *chunk =
+		container_of(work, struct blk_crypto_chunk, work);
+
+	blk_crypto_chunk_done(chunk, blk_crypto_crypt_chunk(chunk));
+}
+
+/* Bytes per chunk: whole data units, and no more chunks than online CPUs */
+static unsigned int blk_crypto_chunk_size(unsigned int size,
+					  unsigned int data_unit_size)
+{
+	unsigned int chunk_size = READ_ONCE(parallel_chunk_kb) << 10;
+	unsigned int nr_cpus = num_online_cpus();
+
+	if (!chunk_size || nr_cpus < 2)
+		return size;
+
+	chunk_size = max(chunk_size, DIV_ROUND_UP(size, nr_cpus));
+	return round_up(chunk_size, data_unit_size);
+}
+
+/*
+ * En/decrypt the data described by src_iter into the pages described by
+ * dst_iter, which may be the same. Large ranges are split into chunks which
+ * are handed to blk_crypto_chunk_wq, while the calling context does the first
+ * one itself and then waits for the others.
+ */
+static blk_status_t blk_crypto_crypt_bio(struct crypto_skcipher *tfm,
+					 struct bio *src_bio,
+					 struct bvec_iter src_iter,
+					 struct bio *dst_bio,
+					 struct bvec_iter dst_iter,
+					 const u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE],
+					 unsigned int data_unit_size,
+					 bool encrypt)
+{
+	struct blk_crypto_chunk_ctl ctl;
+	struct blk_crypto_chunk first, *chunks = NULL;
+	unsigned int chunk_size, nr_chunks = 1;
+	unsigned int i;
+
+	chunk_size = blk_crypto_chunk_size(src_iter.bi_size, data_unit_size);
+	if (chunk_size < src_iter.bi_size) {
+		nr_chunks = DIV_ROUND_UP(src_iter.bi_size, chunk_size);
+		chunks = kmalloc_array(nr_chunks - 1, sizeof(*chunks),
+				       GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+		if (!chunks) {
+			/* Not worth failing the I/O for, do it serially */
+			nr_chunks = 1;
+			chunk_size = src_iter.bi_size;
+		}
+	}
+
+	atomic_set(&ctl.remaining, nr_chunks);
+	init_completion(&ctl.done);
+	ctl.status = BLK_STS_OK;
+
+	for (i = 0; i < nr_chunks; i++) {
+		struct blk_crypto_chunk *chunk = i ? &chunks[i - 1] : &first;
+		unsigned int bytes = min(chunk_size, src_iter.bi_size);
+
+		chunk->ctl = &ctl;
+		chunk->tfm = tfm;
+		chunk->src_bio = src_bio;
+		chunk->dst_bio = dst_bio;
+		chunk->src_iter = src_iter;
+		chunk->src_iter.bi_size = bytes;
+		chunk->dst_iter = dst_iter;
+		chunk->dst_iter.bi_size = bytes;
+		memcpy(chunk->dun, dun, sizeof(chunk->dun));
+		bio_crypt_dun_increment(chunk->dun,
+					i * (chunk_size / data_unit_size));
+		chunk->data_unit_size = data_unit_size;
+		chunk->encrypt = encrypt;
+		if (i) {
+			INIT_WORK(&chunk->work, blk_crypto_chunk_work);
+			queue_work(blk_crypto_chunk_wq, &chunk->work);
+		}
+
+		bio_advance_iter(src_bio, &src_iter, bytes);
+		bio_advance_iter(dst_bio, &dst_iter, bytes);
+	}
+
+	blk_crypto_chunk_done(&first, blk_crypto_crypt_chunk(&first));
+	wait_for_completion(&ctl.done);
+	kfree(chunks);
+
+	return ctl.status;
 }
 
 /*
@@ -330,19 +642,12 @@ static bool blk_crypto_alloc_sglists(struct bio *bio,
 static int blk_crypto_encrypt_bio(struct bio **bio_ptr)
 {
 	struct bio *src_bio;
-	struct skcipher_request *ciph_req = NULL;
-	DECLARE_CRYPTO_WAIT(wait);
-	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
-	union blk_crypto_iv iv;
-	struct scatterlist _src, *src = &_src;
-	struct scatterlist _dst, *dst = &_dst;
 	struct bio *enc_bio;
-	unsigned int i;
-	unsigned int sg_idx = 0;
-	unsigned int du_filled = 0;
-	int data_unit_size;
 	struct bio_crypt_ctx *bc;
-	int err = 0;
+	const struct blk_crypto_keyslot *slotp;
+	blk_status_t status;
+	unsigned int i;
+	int err;
 
 	/* Split the bio if it's too big for single page bvec */
 	err = blk_crypto_split_bio_if_needed(bio_ptr);
@@ -351,116 +656,60 @@ static int blk_crypto_encrypt_bio(struct bio **bio_ptr)
 
 	src_bio = *bio_ptr;
 	bc = src_bio->bi_crypt_context;
-	data_unit_size = bc->bc_key->data_unit_size;
-
-	/* Allocate scatterlists if needed */
-	if (!blk_crypto_alloc_sglists(src_bio, &src_bio->bi_iter,
-				      data_unit_size, &src, &dst)) {
-		src_bio->bi_status = BLK_STS_RESOURCE;
-		return -ENOMEM;
-	}
 
 	/* Allocate bounce bio for encryption */
 	enc_bio = blk_crypto_clone_bio(src_bio);
 	if (!enc_bio) {
 		src_bio->bi_status = BLK_STS_RESOURCE;
-		goto out_free_sglists;
-	}
-
-	/*
-	 * Use the crypto API fallback keyslot manager to get a crypto_skcipher
-	 * for the algorithm and key specified for this bio.
-	 */
-	err = bio_crypt_ctx_acquire_keyslot(bc, blk_crypto_ksm);
-	if (err) {
-		src_bio->bi_status = BLK_STS_IOERR;
-		goto out_put_enc_bio;
+		return -ENOMEM;
 	}
 
-	/* and then allocate an skcipher_request for it */
-	err = blk_crypto_alloc_cipher_req(src_bio, &ciph_req, &wait);
-	if (err)
-		goto out_release_keyslot;
-
-	memcpy(curr_dun, bc->bc_dun, sizeof(curr_dun));
-
-	skcipher_request_set_crypt(ciph_req, src, dst, data_unit_size,
-				   iv.bytes);
-
 	/*
-	 * Encrypt each data unit in the bounce bio.
-	 *
-	 * Take care to handle the case where a data unit spans bio segments.
-	 * This can happen when data_unit_size > logical_block_size.
+	 * Swap in the bounce pages up front; the plaintext is still reachable
+	 * through src_bio, whose segments enc_bio's bvecs mirror one to one.
 	 */
 	for (i = 0; i < enc_bio->bi_vcnt; i++) {
-		struct bio_vec *bv = &enc_bio->bi_io_vec[i];
-		struct page *plaintext_page = bv->bv_page;
-		struct page *ciphertext_page =
-			mempool_alloc(blk_crypto_bounce_page_pool, GFP_NOIO);
-		unsigned int offset_in_bv = 0;
-
-		bv->bv_page = ciphertext_page;
+		struct page *ciphertext_page = blk_crypto_alloc_bounce_page();
 
 		if (!ciphertext_page) {
 			src_bio->bi_status = BLK_STS_RESOURCE;
 			err = -ENOMEM;
 			goto out_free_bounce_pages;
 		}
-
-		while (offset_in_bv < bv->bv_len) {
-			unsigned int n = min(bv->bv_len - offset_in_bv,
-					     data_unit_size - du_filled);
-			sg_set_page(&src[sg_idx], plaintext_page, n,
-				    bv->bv_offset + offset_in_bv);
-			sg_set_page(&dst[sg_idx], ciphertext_page, n,
-				    bv->bv_offset + offset_in_bv);
-			sg_idx++;
-			offset_in_bv += n;
-			du_filled += n;
-			if (du_filled == data_unit_size) {
-				blk_crypto_dun_to_iv(curr_dun, &iv);
-				if (crypto_wait_req(crypto_skcipher_encrypt(ciph_req),
-						    &wait)) {
-					src_bio->bi_status = BLK_STS_IOERR;
-					i++;
-					goto out_free_bounce_pages;
-				}
-				bio_crypt_dun_increment(curr_dun, 1);
-				sg_idx = 0;
-				du_filled = 0;
-			}
-		}
+		enc_bio->bi_io_vec[i].bv_page = ciphertext_page;
 	}
-	if (WARN_ON_ONCE(du_filled != 0)) {
+
+	/*
+	 * Use the crypto API fallback keyslot manager to get a crypto_skcipher
+	 * for the algorithm and key specified for this bio.
+	 */
+	err = bio_crypt_ctx_acquire_keyslot(bc, blk_crypto_ksm);
+	if (err) {
 		src_bio->bi_status = BLK_STS_IOERR;
 		goto out_free_bounce_pages;
 	}
 
+	slotp = &blk_crypto_keyslots[bc->bc_keyslot];
+	status = blk_crypto_crypt_bio(slotp->tfms[slotp->crypto_mode],
+				      src_bio, src_bio->bi_iter,
+				      enc_bio, enc_bio->bi_iter, bc->bc_dun,
+				      bc->bc_key->data_unit_size, true);
+	bio_crypt_ctx_release_keyslot(bc);
+	if (status) {
+		src_bio->bi_status = status;
+		err = -EIO;
+		goto out_free_bounce_pages;
+	}
+
 	enc_bio->bi_private = src_bio;
 	enc_bio->bi_end_io = blk_crypto_encrypt_endio;
 	*bio_ptr = enc_bio;
-
-	enc_bio = NULL;
-	err = 0;
-	goto out_free_ciph_req;
+	return 0;
 
 out_free_bounce_pages:
 	while (i > 0)
-		mempool_free(enc_bio->bi_io_vec[--i].bv_page,
-			     blk_crypto_bounce_page_pool);
-out_free_ciph_req:
-	skcipher_request_free(ciph_req);
-out_release_keyslot:
-	bio_crypt_ctx_release_keyslot(bc);
-out_put_enc_bio:
-	if (enc_bio)
-		bio_put(enc_bio);
-out_free_sglists:
-	if (src != &_src)
-		kfree(src);
-	if (dst != &_dst)
-		kfree(dst);
+		blk_crypto_free_bounce_page(enc_bio->bi_io_vec[--i].bv_page);
+	bio_put(enc_bio);
 	return err;
 }
 
@@ -482,27 +731,11 @@ static void blk_crypto_decrypt_bio(struct work_struct *work)
 	struct blk_crypto_decrypt_work *decrypt_work =
 		container_of(work, struct blk_crypto_decrypt_work, work);
 	struct bio *bio = decrypt_work->bio;
-	struct skcipher_request *ciph_req = NULL;
-	DECLARE_CRYPTO_WAIT(wait);
-	struct bio_vec bv;
-	struct bvec_iter iter;
-	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
-	union blk_crypto_iv iv;
-	struct scatterlist _sg, *sg = &_sg;
 	struct bio_crypt_ctx *bc = bio->bi_crypt_context;
 	struct bio_fallback_crypt_ctx *f_ctx =
 		container_of(bc, struct bio_fallback_crypt_ctx, crypt_ctx);
-	const int data_unit_size = bc->bc_key->data_unit_size;
-	unsigned int sg_idx = 0;
-	unsigned int du_filled = 0;
-	int err;
-
-	/* Allocate scatterlist if needed */
-	if (!blk_crypto_alloc_sglists(bio, &f_ctx->crypt_iter, data_unit_size,
-				      &sg, NULL)) {
-		bio->bi_status = BLK_STS_RESOURCE;
-		goto out_no_sglists;
-	}
+	const struct blk_crypto_keyslot *slotp;
+	blk_status_t status;
 
 	/*
 	 * Use the crypto API fallback keyslot manager to get a crypto_skcipher
@@ -513,54 +746,16 @@ static void blk_crypto_decrypt_bio(struct work_struct *work)
 		goto out_no_keyslot;
 	}
 
-	/* and then allocate an skcipher_request for it */
-	err = blk_crypto_alloc_cipher_req(bio, &ciph_req, &wait);
-	if (err)
-		goto out;
-
-	memcpy(curr_dun, f_ctx->fallback_dun, sizeof(curr_dun));
-	skcipher_request_set_crypt(ciph_req, sg, sg, data_unit_size, iv.bytes);
+	slotp = &blk_crypto_keyslots[bc->bc_keyslot];
+	status = blk_crypto_crypt_bio(slotp->tfms[slotp->crypto_mode],
+				      bio, f_ctx->crypt_iter,
+				      bio, f_ctx->crypt_iter, f_ctx->fallback_dun,
+				      bc->bc_key->data_unit_size, false);
+	if (status)
+		bio->bi_status = status;
 
-	/*
-	 * Decrypt each data unit in the bio.
-	 *
-	 * Take care to handle the case where a data unit spans bio segments.
-	 * This can happen when data_unit_size > logical_block_size.
-	 */
-	__bio_for_each_segment(bv, bio, iter, f_ctx->crypt_iter) {
-		unsigned int offset_in_bv = 0;
-
-		while (offset_in_bv < bv.bv_len) {
-			unsigned int n = min(bv.bv_len - offset_in_bv,
-					     data_unit_size - du_filled);
-			sg_set_page(&sg[sg_idx++], bv.bv_page, n,
-				    bv.bv_offset + offset_in_bv);
-			offset_in_bv += n;
-			du_filled += n;
-			if (du_filled == data_unit_size) {
-				blk_crypto_dun_to_iv(curr_dun, &iv);
-				if (crypto_wait_req(crypto_skcipher_decrypt(ciph_req),
-						    &wait)) {
-					bio->bi_status = BLK_STS_IOERR;
-					goto out;
-				}
-				bio_crypt_dun_increment(curr_dun, 1);
-				sg_idx = 0;
-				du_filled = 0;
-			}
-		}
-	}
-	if (WARN_ON_ONCE(du_filled != 0)) {
-		bio->bi_status = BLK_STS_IOERR;
-		goto out;
-	}
-out:
-	skcipher_request_free(ciph_req);
 	bio_crypt_ctx_release_keyslot(bc);
 out_no_keyslot:
-	if (sg != &_sg)
-		kfree(sg);
-out_no_sglists:
 	kmem_cache_free(blk_crypto_decrypt_work_cache, decrypt_work);
 	blk_crypto_free_fallback_crypt_ctx(bio);
 	bio_endio(bio);
@@ -722,6 +917,16 @@ int __init blk_crypto_fallback_init(void)
 	if (!blk_crypto_wq)
 		return -ENOMEM;
 
+	/*
+	 * Separate from blk_crypto_wq, whose decryption works wait for the
+	 * chunks they queue here.
+	 */
+	blk_crypto_chunk_wq = alloc_workqueue("blk_crypto_chunk_wq",
+					      WQ_UNBOUND | WQ_HIGHPRI |
+					      WQ_MEM_RECLAIM, 0);
+	if (!blk_crypto_chunk_wq)
+		return -ENOMEM;
+
 	blk_crypto_keyslots = kcalloc(blk_crypto_num_keyslots,
 				      sizeof(blk_crypto_keyslots[0]),
 				      GFP_KERNEL);
@@ -733,6 +938,10 @@ int __init blk_crypto_fallback_init(void)
 	if (!blk_crypto_bounce_page_pool)
 		return -ENOMEM;
 
+	cpuhp_setup_state_nocalls(CPUHP_BP_PREPARE_DYN,
+				  "block/blk-crypto-fallback:dead", NULL,
+				  blk_crypto_bounce_cache_dead);
+
 	blk_crypto_decrypt_work_cache = KMEM_CACHE(blk_crypto_decrypt_work,
 						   SLAB_RECLAIM_ACCOUNT);
 	if (!blk_crypto_decrypt_work_cache)
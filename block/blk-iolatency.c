@@ -61,6 +61,38 @@
  * root cg issued io's, wethere that's some metadata intensive operation or the
  * group is using so much memory that it is pushing us into swap.
  *
+ * Automatic targets
+ *
+ * Instead of a target, a group can be given a relative priority with
+ * "prio=<0-7>", 0 being the most latency sensitive.  While any group on a
+ * device is configured this way we learn the mean bio latency of the device,
+ * measured like the group latencies the targets are checked against, once a
+ * second from the timer, and keep a baseline of it.  The baseline follows
+ * improvements quickly but degradations only slowly, so the contention we are
+ * trying to get rid of doesn't relax the targets it is measured against.  A
+ * group's target is the baseline shifted left by its prio, so every step down
+ * halves how much latency a group is allowed before it throttles its
+ * siblings.  Targets follow the baseline only once they are off by more than
+ * a quarter, and without resetting the scaling state of their parent, so that
+ * throttling can build up across windows.  Until the first baseline is
+ * learned the group has no target.
+ *
+ * The io.latency interface
+ *
+ * Each line of io.latency configures one device, as "MAJ:MIN" followed by
+ * space separated keys:
+ *
+ *   target=<usec>|max	fixed latency target, "max" removes it
+ *   prio=<0-7>		automatic target, see above
+ *
+ * When both are given prio wins, and writing a line without prio turns the
+ * automatic target off.  Reading io.latency prints the target in effect for
+ * each configured device, followed by the prio if the target is automatic:
+ *
+ *   8:16 target=10000
+ *   8:32 target=400 prio=3
+ *   8:48 target=max prio=3	(no baseline learned yet)
+ *
  * Copyright (C) 2018 Josef Bacik
  */
 #include <linux/kernel.h>
@@ -96,6 +128,16 @@ struct blk_iolatency {
 	bool enabled;
 	atomic_t enable_cnt;
 	struct work_struct enable_work;
+
+	/*
+	 * Automatic targets. While ->auto_cnt groups use a prio, the latency of
+	 * every bio completing is added to ->auto_stats, which the timer folds
+	 * into ->auto_lat_nsec.
+	 */
+	atomic_t auto_cnt;
+	struct blk_rq_stat __percpu *auto_stats;
+	/* learned mean bio latency, 0 until the first full window */
+	u64 auto_lat_nsec;
 };
 
 static inline struct blk_iolatency *BLKIOLATENCY(struct rq_qos *rqos)
@@ -133,6 +175,9 @@ struct iolatency_grp {
 	u64 min_lat_nsec;
 	u64 cur_win_nsec;
 
+	/* prio for an automatic target, -1 if the target is set by hand */
+	int auto_prio;
+
 	/* total running average of our io latency. */
 	u64 lat_avg;
 
@@ -481,6 +526,22 @@ static void iolatency_record_time(struct iolatency_grp *iolat,
 	put_cpu_ptr(rq_stat);
 }
 
+/* The device-wide counterpart of iolatency_record_time(), for the baseline */
+static void iolatency_auto_record_time(struct blk_iolatency *blkiolat,
+				       struct bio_issue *issue, u64 now)
+{
+	struct blk_rq_stat *rq_stat;
+	u64 start = bio_issue_time(issue);
+
+	now = __bio_issue_time(now);
+	if (now <= start)
+		return;
+
+	rq_stat = get_cpu_ptr(blkiolat->auto_stats);
+	blk_rq_stat_add(rq_stat, now - start);
+	put_cpu_ptr(rq_stat);
+}
+
 #define BLKIOLATENCY_MIN_ADJUST_TIME (500 * NSEC_PER_MSEC)
 #define BLKIOLATENCY_MIN_GOOD_SAMPLES 5
 
@@ -579,6 +640,10 @@ static void blkcg_iolatency_done_bio(struct rq_qos *rqos, struct bio *bio)
 	if (!iolat->blkiolat->enabled)
 		return;
 
+	if (atomic_read(&iolat->blkiolat->auto_cnt) && !issue_as_root &&
+	    bio->bi_status != BLK_STS_AGAIN)
+		iolatency_auto_record_time(iolat->blkiolat, &bio->bi_issue, now);
+
 	while (blkg && blkg->parent) {
 		iolat = blkg_to_lat(blkg);
 		if (!iolat) {
@@ -616,6 +681,9 @@ static void blkcg_iolatency_exit(struct rq_qos *rqos)
 	del_timer_sync(&blkiolat->timer);
 	flush_work(&blkiolat->enable_work);
 	blkcg_deactivate_policy(rqos->q, &blkcg_policy_iolatency);
+	/* offlining the groups may have queued it again */
+	flush_work(&blkiolat->enable_work);
+	free_percpu(blkiolat->auto_stats);
 	kfree(blkiolat);
 }
 
@@ -625,6 +693,8 @@ static struct rq_qos_ops blkcg_iolatency_ops = {
 	.exit = blkcg_iolatency_exit,
 };
 
+static void iolatency_auto_update(struct blk_iolatency *blkiolat);
+
 static void blkiolatency_timer_fn(struct timer_list *t)
 {
 	struct blk_iolatency *blkiolat = from_timer(blkiolat, t, timer);
@@ -632,6 +702,8 @@ static void blkiolatency_timer_fn(struct timer_list *t)
 	struct cgroup_subsys_state *pos_css;
 	u64 now = ktime_to_ns(ktime_get());
 
+	iolatency_auto_update(blkiolat);
+
 	rcu_read_lock();
 	blkg_for_each_descendant_pre(blkg, pos_css,
 				     blkiolat->rqos.q->root_blkg) {
@@ -686,6 +758,104 @@ static void blkiolatency_timer_fn(struct timer_list *t)
 	rcu_read_unlock();
 }
 
+#define IOLATENCY_AUTO_NR_PRIOS 8
+#define IOLATENCY_AUTO_MIN_SAMPLES 100
+#define IOLATENCY_AUTO_MIN_TARGET (50 * NSEC_PER_USEC)
+/* a derived target only follows the baseline once off by more than 1/4 */
+#define IOLATENCY_AUTO_HYSTERESIS_SHIFT 2
+
+static u64 iolatency_auto_target(struct blk_iolatency *blkiolat, int prio)
+{
+	u64 lat = READ_ONCE(blkiolat->auto_lat_nsec);
+
+	if (!lat)
+		return 0;
+	return max_t(u64, lat << prio, IOLATENCY_AUTO_MIN_TARGET);
+}
+
+static void iolatency_set_min_lat_nsec(struct blkcg_gq *blkg, u64 val);
+
+static void iolatency_auto_update_targets(struct blk_iolatency *blkiolat)
+{
+	struct request_queue *q = blkiolat->rqos.q;
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+	unsigned long flags;
+
+	/* Serializes against io.latency writes and group offlining */
+	rcu_read_lock();
+	spin_lock_irqsave(q->queue_lock, flags);
+	blkg_for_each_descendant_pre(blkg, pos_css, q->root_blkg) {
+		struct iolatency_grp *iolat = blkg_to_lat(blkg);
+		u64 oldval, val, diff;
+
+		if (!iolat || iolat->auto_prio < 0)
+			continue;
+		oldval = iolat->min_lat_nsec;
+		val = iolatency_auto_target(blkiolat, iolat->auto_prio);
+		diff = val > oldval ? val - oldval : oldval - val;
+		if (oldval && diff <= oldval >> IOLATENCY_AUTO_HYSTERESIS_SHIFT)
+			continue;
+		/*
+		 * Unlike a target written by hand, leave the scaling state of
+		 * the parent alone: it has to build up over several windows.
+		 */
+		iolatency_set_min_lat_nsec(blkg, val);
+	}
+	spin_unlock_irqrestore(q->queue_lock, flags);
+	rcu_read_unlock();
+}
+
+/* Folds the bio latencies since the last call into the baseline */
+static void iolatency_auto_update(struct blk_iolatency *blkiolat)
+{
+	struct blk_rq_stat stat;
+	u64 lat;
+	int cpu;
+
+	if (!atomic_read(&blkiolat->auto_cnt))
+		return;
+
+	blk_rq_stat_init(&stat);
+	for_each_online_cpu(cpu) {
+		struct blk_rq_stat *s = per_cpu_ptr(blkiolat->auto_stats, cpu);
+
+		blk_rq_stat_sum(&stat, s);
+		blk_rq_stat_init(s);
+	}
+
+	if (stat.nr_samples < IOLATENCY_AUTO_MIN_SAMPLES)
+		return;
+
+	/* Halve the way down, but only a sixteenth of the way up */
+	lat = blkiolat->auto_lat_nsec;
+	if (!lat)
+		lat = stat.mean;
+	else if (stat.mean < lat)
+		lat -= (lat - stat.mean) >> 1;
+	else
+		lat += (stat.mean - lat) >> 4;
+	WRITE_ONCE(blkiolat->auto_lat_nsec, lat);
+
+	iolatency_auto_update_targets(blkiolat);
+}
+
+static void iolatency_set_auto_prio(struct iolatency_grp *iolat, int prio)
+{
+	struct blk_iolatency *blkiolat = iolat->blkiolat;
+	int oldprio = iolat->auto_prio;
+
+	iolat->auto_prio = prio;
+	if (oldprio < 0 && prio >= 0) {
+		if (atomic_inc_return(&blkiolat->auto_cnt) == 1)
+			schedule_work(&blkiolat->enable_work);
+	}
+	if (oldprio >= 0 && prio < 0) {
+		if (atomic_dec_return(&blkiolat->auto_cnt) == 0)
+			schedule_work(&blkiolat->enable_work);
+	}
+}
+
 /**
  * blkiolatency_enable_work_fn - Enable or disable iolatency on the device
  * @work: enable_work of the blk_iolatency of interest
@@ -700,6 +870,9 @@ static void blkiolatency_timer_fn(struct timer_list *t)
  * are in flight. This is achieved by ensuring that no IO is in flight by
  * freezing the queue while flipping ->enabled. As this requires a sleepable
  * context, ->enabled flipping is punted to this work function.
+ *
+ * Groups with an automatic target need the completions accounted before they
+ * have a target, to learn the device latency, so they count as enabled too.
  */
 static void blkiolatency_enable_work_fn(struct work_struct *work)
 {
@@ -716,7 +889,8 @@ static void blkiolatency_enable_work_fn(struct work_struct *work)
 	 * Also, we know @blkiolat is safe to access as ->enable_work is flushed
 	 * in blkcg_iolatency_exit().
 	 */
-	enabled = atomic_read(&blkiolat->enable_cnt);
+	enabled = atomic_read(&blkiolat->enable_cnt) ||
+		  atomic_read(&blkiolat->auto_cnt);
 	if (enabled != blkiolat->enabled) {
 		blk_mq_freeze_queue(blkiolat->rqos.q);
 		blkiolat->enabled = enabled;
@@ -728,12 +902,20 @@ int blk_iolatency_init(struct request_queue *q)
 {
 	struct blk_iolatency *blkiolat;
 	struct rq_qos *rqos;
-	int ret;
+	int ret, cpu;
 
 	blkiolat = kzalloc(sizeof(*blkiolat), GFP_KERNEL);
 	if (!blkiolat)
 		return -ENOMEM;
 
+	blkiolat->auto_stats = alloc_percpu(struct blk_rq_stat);
+	if (!blkiolat->auto_stats) {
+		kfree(blkiolat);
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu)
+		blk_rq_stat_init(per_cpu_ptr(blkiolat->auto_stats, cpu));
+
 	rqos = &blkiolat->rqos;
 	rqos->id = RQ_QOS_CGROUP;
 	rqos->ops = &blkcg_iolatency_ops;
@@ -744,6 +926,7 @@ int blk_iolatency_init(struct request_queue *q)
 	ret = blkcg_activate_policy(q, &blkcg_policy_iolatency);
 	if (ret) {
 		rq_qos_del(q, rqos);
+		free_percpu(blkiolat->auto_stats);
 		kfree(blkiolat);
 		return ret;
 	}
@@ -805,6 +988,7 @@ static ssize_t iolatency_set_limit(struct kernfs_open_file *of, char *buf,
 	char *p, *tok;
 	u64 lat_val = 0;
 	u64 oldval;
+	int prio = -1;
 	int ret;
 
 	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolatency, buf, &ctx);
@@ -832,15 +1016,27 @@ static ssize_t iolatency_set_limit(struct kernfs_open_file *of, char *buf,
 				lat_val = v * NSEC_PER_USEC;
 			else
 				goto out;
+		} else if (!strcmp(key, "prio")) {
+			unsigned int v;
+
+			if (sscanf(val, "%u", &v) != 1 ||
+			    v >= IOLATENCY_AUTO_NR_PRIOS)
+				goto out;
+			prio = v;
 		} else {
 			goto out;
 		}
 	}
 
+	/* A prio takes precedence, as it's printed along with its target */
+	if (prio >= 0)
+		lat_val = iolatency_auto_target(blkiolat, prio);
+
 	/* Walk up the tree to see if our new val is lower than it should be. */
 	blkg = ctx.blkg;
 	oldval = iolat->min_lat_nsec;
 
+	iolatency_set_auto_prio(iolat, prio);
 	iolatency_set_min_lat_nsec(blkg, lat_val);
 	if (oldval != iolat->min_lat_nsec)
 		iolatency_clear_scaling(blkg);
@@ -856,10 +1052,18 @@ static u64 iolatency_prfill_limit(struct seq_file *sf,
 	struct iolatency_grp *iolat = pd_to_lat(pd);
 	const char *dname = blkg_dev_name(pd->blkg);
 
-	if (!dname || !iolat->min_lat_nsec)
+	if (!dname || (!iolat->min_lat_nsec && iolat->auto_prio < 0))
 		return 0;
-	seq_printf(sf, "%s target=%llu\n",
-		   dname, div_u64(iolat->min_lat_nsec, NSEC_PER_USEC));
+	if (iolat->auto_prio < 0)
+		seq_printf(sf, "%s target=%llu\n",
+			   dname, div_u64(iolat->min_lat_nsec, NSEC_PER_USEC));
+	else if (!iolat->min_lat_nsec)
+		seq_printf(sf, "%s target=max prio=%d\n",
+			   dname, iolat->auto_prio);
+	else
+		seq_printf(sf, "%s target=%llu prio=%d\n",
+			   dname, div_u64(iolat->min_lat_nsec, NSEC_PER_USEC),
+			   iolat->auto_prio);
 	return 0;
 }
 
@@ -925,6 +1129,7 @@ static void iolatency_pd_init(struct blkg_policy_data *pd)
 	iolat->rq_depth.default_depth = iolat->rq_depth.queue_depth;
 	iolat->blkiolat = blkiolat;
 	iolat->cur_win_nsec = 100 * NSEC_PER_MSEC;
+	iolat->auto_prio = -1;
 	atomic64_set(&iolat->window_start, now);
 
 	/*
@@ -947,6 +1152,7 @@ static void iolatency_pd_offline(struct blkg_policy_data *pd)
 	struct iolatency_grp *iolat = pd_to_lat(pd);
 	struct blkcg_gq *blkg = lat_to_blkg(iolat);
 
+	iolatency_set_auto_prio(iolat, -1);
 	iolatency_set_min_lat_nsec(blkg, 0);
 	iolatency_clear_scaling(blkg);
 }
@@ -468,22 +468,33 @@ struct request *blk_mq_alloc_request_hctx(struct request_queue *q,
 }
 EXPORT_SYMBOL_GPL(blk_mq_alloc_request_hctx);
 
-static void __blk_mq_free_request(struct request *rq)
+static void blk_mq_put_request_tags(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq)
 {
-	struct request_queue *q = rq->q;
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
-	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(q, ctx->cpu);
 	const int sched_tag = rq->internal_tag;
 
 	if (rq->tag != -1)
 		blk_mq_put_tag(hctx, hctx->tags, ctx, rq->tag);
 	if (sched_tag != -1)
 		blk_mq_put_tag(hctx, hctx->sched_tags, ctx, sched_tag);
+}
+
+static void __blk_mq_free_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(q, rq->mq_ctx->cpu);
+
+	blk_mq_put_request_tags(hctx, rq);
 	blk_mq_sched_restart(hctx);
 	blk_queue_exit(q);
 }
 
-void blk_mq_free_request(struct request *rq)
+/*
+ * Everything blk_mq_free_request() does short of giving back the tags.
+ * Returns true if the caller dropped the last reference and must do that.
+ */
+static bool __blk_mq_release_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
 	struct elevator_queue *e = q->elevator;
@@ -512,21 +523,29 @@ void blk_mq_free_request(struct request *rq)
 		blk_put_rl(blk_rq_rl(rq));
 
 	WRITE_ONCE(rq->state, MQ_RQ_IDLE);
-	if (refcount_dec_and_test(&rq->ref))
+	return refcount_dec_and_test(&rq->ref);
+}
+
+void blk_mq_free_request(struct request *rq)
+{
+	if (__blk_mq_release_request(rq))
 		__blk_mq_free_request(rq);
 }
 EXPORT_SYMBOL_GPL(blk_mq_free_request);
 
-inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
+static inline void blk_mq_end_request_acct(struct request *rq, u64 now)
 {
-	u64 now = ktime_get_ns();
-
 	if (rq->rq_flags & RQF_STATS) {
 		blk_mq_poll_stats_start(rq->q);
 		blk_stat_add(rq, now);
 	}
 
 	blk_account_io_done(rq, now);
+}
+
+inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
+{
+	blk_mq_end_request_acct(rq, ktime_get_ns());
 
 	if (rq->end_io) {
 		rq_qos_done(rq->q, rq);
@@ -547,6 +566,71 @@ void blk_mq_end_request(struct request *rq, blk_status_t error)
 }
 EXPORT_SYMBOL(blk_mq_end_request);
 
+static void blk_mq_end_batch_flush(struct blk_mq_hw_ctx *hctx,
+				   unsigned long nr_freed)
+{
+	blk_mq_sched_restart(hctx);
+	if (nr_freed)
+		percpu_ref_put_many(&hctx->queue->q_usage_counter, nr_freed);
+}
+
+/**
+ * blk_mq_end_request_batch - end I/O on a list of requests
+ * @list:	requests linked through ->queuelist
+ *
+ * Description:
+ *	Does what blk_mq_end_request() with BLK_STS_OK does for each request
+ *	on @list, which must all be fully done. The completion time is read
+ *	once for the whole list, and the scheduler restart and the queue
+ *	usage reference are taken care of once per run of requests from the
+ *	same hardware queue rather than once per request. @list is empty on
+ *	return.
+ **/
+void blk_mq_end_request_batch(struct list_head *list)
+{
+	struct blk_mq_hw_ctx *hctx, *last_hctx = NULL;
+	unsigned long nr_freed = 0;
+	struct request *rq, *next;
+	u64 now;
+
+	if (list_empty(list))
+		return;
+
+	now = ktime_get_ns();
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		list_del_init(&rq->queuelist);
+
+		if (blk_update_request(rq, BLK_STS_OK, blk_rq_bytes(rq)))
+			BUG();
+		blk_mq_end_request_acct(rq, now);
+
+		if (rq->end_io) {
+			rq_qos_done(rq->q, rq);
+			rq->end_io(rq, BLK_STS_OK);
+			continue;
+		}
+		if (unlikely(blk_bidi_rq(rq)))
+			blk_mq_free_request(rq->next_rq);
+
+		hctx = blk_mq_map_queue(rq->q, rq->mq_ctx->cpu);
+		if (!__blk_mq_release_request(rq))
+			continue;
+
+		if (hctx != last_hctx) {
+			if (last_hctx)
+				blk_mq_end_batch_flush(last_hctx, nr_freed);
+			last_hctx = hctx;
+			nr_freed = 0;
+		}
+		blk_mq_put_request_tags(hctx, rq);
+		nr_freed++;
+	}
+
+	if (last_hctx)
+		blk_mq_end_batch_flush(last_hctx, nr_freed);
+}
+EXPORT_SYMBOL(blk_mq_end_request_batch);
+
 static void __blk_mq_complete_request_remote(void *data)
 {
 	struct request *rq = data;
@@ -554,10 +638,25 @@ static void __blk_mq_complete_request_remote(void *data)
 	rq->q->softirq_done_fn(rq);
 }
 
-static void __blk_mq_complete_request(struct request *rq)
+/*
+ * Whether a request completed on @cpu should rather be completed on the CPU
+ * it was submitted from.
+ */
+static bool blk_mq_complete_need_ipi(struct request *rq, int cpu)
 {
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
 	bool shared = false;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags))
+		return false;
+	if (!test_bit(QUEUE_FLAG_SAME_FORCE, &rq->q->queue_flags))
+		shared = cpus_share_cache(cpu, ctx->cpu);
+
+	return cpu != ctx->cpu && !shared && cpu_online(ctx->cpu);
+}
+
+static void __blk_mq_complete_request(struct request *rq)
+{
 	int cpu;
 
 	if (!blk_mq_mark_complete(rq))
@@ -571,14 +670,11 @@ static void __blk_mq_complete_request(struct request *rq)
 	}
 
 	cpu = get_cpu();
-	if (!test_bit(QUEUE_FLAG_SAME_FORCE, &rq->q->queue_flags))
-		shared = cpus_share_cache(cpu, ctx->cpu);
-
-	if (cpu != ctx->cpu && !shared && cpu_online(ctx->cpu)) {
+	if (blk_mq_complete_need_ipi(rq, cpu)) {
 		rq->csd.func = __blk_mq_complete_request_remote;
 		rq->csd.info = rq;
 		rq->csd.flags = 0;
-		smp_call_function_single_async(ctx->cpu, &rq->csd);
+		smp_call_function_single_async(rq->mq_ctx->cpu, &rq->csd);
 	} else {
 		rq->q->softirq_done_fn(rq);
 	}
@@ -621,6 +717,110 @@ void blk_mq_complete_request(struct request *rq)
 }
 EXPORT_SYMBOL(blk_mq_complete_request);
 
+/*
+ * Requests batch completed on another CPU than the one they were submitted
+ * from are handed over through the submitting CPU's list, with one IPI for
+ * whatever is queued there rather than one per request.
+ */
+struct blk_mq_batch_done {
+	spinlock_t		lock;
+	struct list_head	list;
+	call_single_data_t	csd;
+};
+
+static DEFINE_PER_CPU(struct blk_mq_batch_done, blk_mq_batch_done);
+
+static void blk_mq_batch_done_take(struct blk_mq_batch_done *bd,
+				   struct list_head *list)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&bd->lock, flags);
+	list_splice_tail_init(&bd->list, list);
+	spin_unlock_irqrestore(&bd->lock, flags);
+}
+
+static void blk_mq_batch_done_ipi(void *data)
+{
+	LIST_HEAD(list);
+
+	blk_mq_batch_done_take(data, &list);
+	blk_mq_end_request_batch(&list);
+}
+
+static void blk_mq_complete_batch_remote(int cpu, struct list_head *list)
+{
+	struct blk_mq_batch_done *bd = &per_cpu(blk_mq_batch_done, cpu);
+	unsigned long flags;
+	bool kick;
+
+	if (list_empty(list))
+		return;
+
+	spin_lock_irqsave(&bd->lock, flags);
+	kick = list_empty(&bd->list);
+	list_splice_tail_init(list, &bd->list);
+	spin_unlock_irqrestore(&bd->lock, flags);
+
+	/*
+	 * Whoever finds the list empty sends the IPI, the handler empties it
+	 * only once the csd is free again. If @cpu went away meanwhile, finish
+	 * the lot here.
+	 */
+	if (kick && smp_call_function_single_async(cpu, &bd->csd)) {
+		blk_mq_batch_done_take(bd, list);
+		blk_mq_end_request_batch(list);
+	}
+}
+
+/**
+ * blk_mq_complete_request_batch - end I/O on a list of requests
+ * @list:	requests linked through ->queuelist
+ *
+ * Description:
+ *	Batched counterpart of blk_mq_complete_request(), for drivers that
+ *	have nothing to do on completion of a successful request but end it,
+ *	typically when reaping a completion queue. The requests are ended
+ *	with blk_mq_end_request_batch() without going through the driver's
+ *	->complete handler. Those that have to be completed on the CPU they
+ *	were submitted from are grouped per CPU, with a single IPI for each.
+ *	Requests that failed should be completed one by one instead.
+ **/
+void blk_mq_complete_request_batch(struct list_head *list)
+{
+	struct request *rq, *next;
+	LIST_HEAD(remote);
+	LIST_HEAD(local);
+	int cpu, remote_cpu = -1;
+
+	cpu = get_cpu();
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		list_del_init(&rq->queuelist);
+
+		if (unlikely(blk_should_fake_timeout(rq->q)))
+			continue;
+		if (!blk_mq_mark_complete(rq))
+			continue;
+		if (rq->internal_tag != -1)
+			blk_mq_sched_completed_request(rq);
+
+		if (!blk_mq_complete_need_ipi(rq, cpu)) {
+			list_add_tail(&rq->queuelist, &local);
+			continue;
+		}
+		if (rq->mq_ctx->cpu != remote_cpu) {
+			blk_mq_complete_batch_remote(remote_cpu, &remote);
+			remote_cpu = rq->mq_ctx->cpu;
+		}
+		list_add_tail(&rq->queuelist, &remote);
+	}
+	blk_mq_complete_batch_remote(remote_cpu, &remote);
+
+	blk_mq_end_request_batch(&local);
+	put_cpu();
+}
+EXPORT_SYMBOL(blk_mq_complete_request_batch);
+
 int blk_mq_request_started(struct request *rq)
 {
 	return blk_mq_rq_state(rq) != MQ_RQ_IDLE;
@@ -3255,6 +3455,17 @@ static bool blk_mq_poll(struct request_queue *q, blk_qc_t cookie)
 
 static int __init blk_mq_init(void)
 {
+	int i;
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_batch_done *bd = &per_cpu(blk_mq_batch_done, i);
+
+		spin_lock_init(&bd->lock);
+		INIT_LIST_HEAD(&bd->list);
+		bd->csd.func = blk_mq_batch_done_ipi;
+		bd->csd.info = bd;
+	}
+
 	cpuhp_setup_state_multi(CPUHP_BLK_MQ_DEAD, "block/mq:dead", NULL,
 				blk_mq_hctx_notify_dead);
 	return 0;
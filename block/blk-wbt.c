@@ -14,6 +14,10 @@
  *   scaling step of 0 if reads show up or the heavy writers finish. Unlike
  *   positive scaling steps where we shrink the monitoring window, a negative
  *   scaling step retains the default step==0 window size.
+ * - Writes are budgeted per I/O priority class. Realtime class writes always
+ *   get the full depth, idle class writes get a small budget that drops to a
+ *   single request once we scale down, and reads from the idle class don't
+ *   count towards the latency target.
  *
  * Copyright (C) 2016 Jens Axboe
  *
@@ -22,8 +26,10 @@
 #include <linux/blk_types.h>
 #include <linux/slab.h>
 #include <linux/backing-dev.h>
+#include <linux/ioprio.h>
 #include <linux/swap.h>
 
+#include "blk.h"
 #include "blk-wbt.h"
 #include "blk-rq-qos.h"
 
@@ -108,6 +114,10 @@ static inline struct rq_wait *get_rq_wait(struct rq_wb *rwb,
 		return &rwb->rq_wait[WBT_RWQ_KSWAPD];
 	else if (wb_acct & WBT_DISCARD)
 		return &rwb->rq_wait[WBT_RWQ_DISCARD];
+	else if (wb_acct & WBT_RT)
+		return &rwb->rq_wait[WBT_RWQ_RT];
+	else if (wb_acct & WBT_IDLE)
+		return &rwb->rq_wait[WBT_RWQ_IDLE];
 
 	return &rwb->rq_wait[WBT_RWQ_BG];
 }
@@ -141,12 +151,17 @@ static void wbt_rqw_done(struct rq_wb *rwb, struct rq_wait *rqw,
 	}
 
 	/*
-	 * For discards, our limit is always the background. For writes, if
-	 * the device does write back caching, drop further down before we
-	 * wake people up.
+	 * For discards, our limit is always the background. Realtime and idle
+	 * class writes have their own fixed budgets. For other writes, if the
+	 * device does write back caching, drop further down before we wake
+	 * people up.
 	 */
 	if (wb_acct & WBT_DISCARD)
 		limit = rwb->wb_background;
+	else if (wb_acct & WBT_RT)
+		limit = rwb->rq_depth.max_depth;
+	else if (wb_acct & WBT_IDLE)
+		limit = rwb->wb_idle;
 	else if (rwb->wc && !wb_recent_wait(rwb))
 		limit = 0;
 	else
@@ -296,14 +311,19 @@ static void rwb_trace_step(struct rq_wb *rwb, const char *msg)
 static void calc_wb_limits(struct rq_wb *rwb)
 {
 	if (rwb->min_lat_nsec == 0) {
-		rwb->wb_normal = rwb->wb_background = 0;
+		rwb->wb_normal = rwb->wb_background = rwb->wb_idle = 0;
 	} else if (rwb->rq_depth.max_depth <= 2) {
 		rwb->wb_normal = rwb->rq_depth.max_depth;
-		rwb->wb_background = 1;
+		rwb->wb_background = rwb->wb_idle = 1;
 	} else {
 		rwb->wb_normal = (rwb->rq_depth.max_depth + 1) / 2;
 		rwb->wb_background = (rwb->rq_depth.max_depth + 3) / 4;
+		rwb->wb_idle = (rwb->rq_depth.max_depth + 7) / 8;
 	}
+
+	/* Once the latency target is missed, idle writes go one at a time */
+	if (rwb->wb_idle && rwb->rq_depth.scale_step > 0)
+		rwb->wb_idle = 1;
 }
 
 static void scale_up(struct rq_wb *rwb)
@@ -349,14 +369,56 @@ static void rwb_arm_timer(struct rq_wb *rwb)
 	blk_stat_activate_nsecs(rwb->cb, rwb->cur_win_nsec);
 }
 
+static void wbt_stat_add(struct blk_rq_stat *dst,
+			 const struct blk_rq_stat *src)
+{
+	if (!src->nr_samples)
+		return;
+
+	dst->min = min(dst->min, src->min);
+	dst->max = max(dst->max, src->max);
+	dst->mean = div_u64(dst->mean * dst->nr_samples +
+			    src->mean * src->nr_samples,
+			    dst->nr_samples + src->nr_samples);
+	dst->nr_samples += src->nr_samples;
+}
+
+/*
+ * Save the per-class stats of the window that just ended, and fold them into
+ * the read/write stats the scaling decision is made on.  Reads from the idle
+ * class are left out, their latency is not something we throttle for.
+ */
+static void wbt_fold_class_stats(struct rq_wb *rwb,
+				 const struct blk_rq_stat *cb_stat,
+				 struct blk_rq_stat *stat)
+{
+	int class, dir;
+
+	blk_rq_stat_init(&stat[READ]);
+	blk_rq_stat_init(&stat[WRITE]);
+
+	for (class = 0; class < WBT_NUM_CLASSES; class++) {
+		for (dir = READ; dir <= WRITE; dir++) {
+			const struct blk_rq_stat *s = &cb_stat[class * 2 + dir];
+
+			rwb->class_stat[class][dir] = *s;
+			if (dir == READ && class == WBT_CLASS_IDLE)
+				continue;
+			wbt_stat_add(&stat[dir], s);
+		}
+	}
+}
+
 static void wb_timer_fn(struct blk_stat_callback *cb)
 {
 	struct rq_wb *rwb = cb->data;
 	struct rq_depth *rqd = &rwb->rq_depth;
 	unsigned int inflight = wbt_inflight(rwb);
+	struct blk_rq_stat stat[2];
 	int status;
 
-	status = latency_exceeded(rwb, cb->stat);
+	wbt_fold_class_stats(rwb, cb->stat, stat);
+	status = latency_exceeded(rwb, stat);
 
 	trace_wbt_timer(rwb->rqos.q->backing_dev_info, status, rqd->scale_step,
 			inflight);
@@ -455,7 +517,8 @@ static bool close_io(struct rq_wb *rwb)
 
 #define REQ_HIPRIO	(REQ_SYNC | REQ_META | REQ_PRIO)
 
-static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
+static inline unsigned int get_limit(struct rq_wb *rwb, enum wbt_flags wb_acct,
+				     unsigned long rw)
 {
 	unsigned int limit;
 
@@ -469,15 +532,24 @@ static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
 	if ((rw & REQ_OP_MASK) == REQ_OP_DISCARD)
 		return rwb->wb_background;
 
+	/*
+	 * Writes from the idle I/O class get their own small budget, even
+	 * when they are synchronous: whoever waits for them is in the idle
+	 * class too.
+	 */
+	if (wb_acct & WBT_IDLE)
+		return rwb->wb_idle;
+
 	/*
 	 * At this point we know it's a buffered write. If this is
 	 * kswapd trying to free memory, or REQ_SYNC is set, then
 	 * it's WB_SYNC_ALL writeback, and we'll use the max limit for
-	 * that. If the write is marked as a background write, then use
-	 * the idle limit, or go to normal if we haven't had competing
-	 * IO for a bit.
+	 * that. Realtime I/O class writes get the max limit as well. If
+	 * the write is marked as a background write, then use the idle
+	 * limit, or go to normal if we haven't had competing IO for a bit.
 	 */
-	if ((rw & REQ_HIPRIO) || wb_recent_wait(rwb) || current_is_kswapd())
+	if ((rw & REQ_HIPRIO) || (wb_acct & WBT_RT) || wb_recent_wait(rwb) ||
+	    current_is_kswapd())
 		limit = rwb->rq_depth.max_depth;
 	else if ((rw & REQ_BACKGROUND) || close_io(rwb)) {
 		/*
@@ -496,6 +568,7 @@ struct wbt_wait_data {
 	struct task_struct *task;
 	struct rq_wb *rwb;
 	struct rq_wait *rqw;
+	enum wbt_flags wb_acct;
 	unsigned long rw;
 	bool got_token;
 };
@@ -510,7 +583,8 @@ static int wbt_wake_function(struct wait_queue_entry *curr, unsigned int mode,
 	 * If we fail to get a budget, return -1 to interrupt the wake up
 	 * loop in __wake_up_common.
 	 */
-	if (!rq_wait_inc_below(data->rqw, get_limit(data->rwb, data->rw)))
+	if (!rq_wait_inc_below(data->rqw, get_limit(data->rwb, data->wb_acct,
+						     data->rw)))
 		return -1;
 
 	data->got_token = true;
@@ -537,12 +611,14 @@ static void __wbt_wait(struct rq_wb *rwb, enum wbt_flags wb_acct,
 		.task = current,
 		.rwb = rwb,
 		.rqw = rqw,
+		.wb_acct = wb_acct,
 		.rw = rw,
 	};
 	bool has_sleeper;
 
 	has_sleeper = wq_has_sleeper(&rqw->wait);
-	if (!has_sleeper && rq_wait_inc_below(rqw, get_limit(rwb, rw)))
+	if (!has_sleeper &&
+	    rq_wait_inc_below(rqw, get_limit(rwb, wb_acct, rw)))
 		return;
 
 	prepare_to_wait_exclusive(&rqw->wait, &data.wq, TASK_UNINTERRUPTIBLE);
@@ -551,7 +627,7 @@ static void __wbt_wait(struct rq_wb *rwb, enum wbt_flags wb_acct,
 			break;
 
 		if (!has_sleeper &&
-		    rq_wait_inc_below(rqw, get_limit(rwb, rw))) {
+		    rq_wait_inc_below(rqw, get_limit(rwb, wb_acct, rw))) {
 			finish_wait(&rqw->wait, &data.wq);
 
 			/*
@@ -595,6 +671,35 @@ static inline bool wbt_should_throttle(struct rq_wb *rwb, struct bio *bio)
 	}
 }
 
+static int wbt_ioprio_class(unsigned short ioprio)
+{
+	switch (IOPRIO_PRIO_CLASS(ioprio)) {
+	case IOPRIO_CLASS_RT:
+		return WBT_CLASS_RT;
+	case IOPRIO_CLASS_IDLE:
+		return WBT_CLASS_IDLE;
+	default:
+		return WBT_CLASS_BE;
+	}
+}
+
+/*
+ * The I/O priority class of a bio, as blk_init_request_from_bio() will
+ * assign it to the request.
+ */
+static int wbt_bio_class(struct bio *bio)
+{
+	unsigned short ioprio = bio_prio(bio);
+
+	if (!ioprio_valid(ioprio)) {
+		struct io_context *ioc = rq_ioc(bio);
+
+		if (ioc)
+			ioprio = ioc->ioprio;
+	}
+	return wbt_ioprio_class(ioprio);
+}
+
 static enum wbt_flags bio_to_wbt_flags(struct rq_wb *rwb, struct bio *bio)
 {
 	enum wbt_flags flags = 0;
@@ -609,6 +714,16 @@ static enum wbt_flags bio_to_wbt_flags(struct rq_wb *rwb, struct bio *bio)
 			flags |= WBT_KSWAPD;
 		if (bio_op(bio) == REQ_OP_DISCARD)
 			flags |= WBT_DISCARD;
+		if (!(flags & (WBT_KSWAPD | WBT_DISCARD))) {
+			switch (wbt_bio_class(bio)) {
+			case WBT_CLASS_RT:
+				flags |= WBT_RT;
+				break;
+			case WBT_CLASS_IDLE:
+				flags |= WBT_IDLE;
+				break;
+			}
+		}
 		flags |= WBT_TRACKED;
 	}
 	return flags;
@@ -734,14 +849,63 @@ u64 wbt_default_latency_nsec(struct request_queue *q)
 		return 75000000ULL;
 }
 
+ssize_t wbt_class_stat_show(struct request_queue *q, char *page)
+{
+	static const char * const names[WBT_NUM_CLASSES] = {
+		[WBT_CLASS_RT]		= "rt",
+		[WBT_CLASS_BE]		= "be",
+		[WBT_CLASS_IDLE]	= "idle",
+	};
+	static const int rwqs[WBT_NUM_CLASSES] = {
+		[WBT_CLASS_RT]		= WBT_RWQ_RT,
+		[WBT_CLASS_BE]		= WBT_RWQ_BG,
+		[WBT_CLASS_IDLE]	= WBT_RWQ_IDLE,
+	};
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	struct rq_wb *rwb;
+	ssize_t ret = 0;
+	int class;
+
+	if (!rqos)
+		return 0;
+	rwb = RQWB(rqos);
+
+	for (class = 0; class < WBT_NUM_CLASSES; class++) {
+		const struct blk_rq_stat *stat = rwb->class_stat[class];
+		unsigned int limit;
+
+		if (class == WBT_CLASS_RT)
+			limit = rwb->rq_depth.max_depth;
+		else if (class == WBT_CLASS_IDLE)
+			limit = rwb->wb_idle;
+		else
+			limit = rwb->wb_normal;
+
+		ret += sprintf(page + ret,
+			       "%s inflight=%d limit=%u rd_samples=%u rd_mean_us=%llu rd_max_us=%llu wr_samples=%u wr_mean_us=%llu wr_max_us=%llu\n",
+			       names[class],
+			       atomic_read(&rwb->rq_wait[rwqs[class]].inflight),
+			       limit,
+			       stat[READ].nr_samples,
+			       div_u64(stat[READ].mean, NSEC_PER_USEC),
+			       div_u64(stat[READ].max, NSEC_PER_USEC),
+			       stat[WRITE].nr_samples,
+			       div_u64(stat[WRITE].mean, NSEC_PER_USEC),
+			       div_u64(stat[WRITE].max, NSEC_PER_USEC));
+	}
+	return ret;
+}
+
+/* Stats are bucketed by I/O priority class and data direction */
 static int wbt_data_dir(const struct request *rq)
 {
 	const int op = req_op(rq);
+	const int class = wbt_ioprio_class(rq->ioprio);
 
 	if (op == REQ_OP_READ)
-		return READ;
+		return class * 2 + READ;
 	else if (op_is_write(op))
-		return WRITE;
+		return class * 2 + WRITE;
 
 	/* don't account */
 	return -1;
@@ -794,7 +958,8 @@ int wbt_init(struct request_queue *q)
 	if (!rwb)
 		return -ENOMEM;
 
-	rwb->cb = blk_stat_alloc_callback(wb_timer_fn, wbt_data_dir, 2, rwb);
+	rwb->cb = blk_stat_alloc_callback(wb_timer_fn, wbt_data_dir,
+					  2 * WBT_NUM_CLASSES, rwb);
 	if (!rwb->cb) {
 		kfree(rwb);
 		return -ENOMEM;
@@ -802,6 +967,10 @@ int wbt_init(struct request_queue *q)
 
 	for (i = 0; i < WBT_NUM_RWQ; i++)
 		rq_wait_init(&rwb->rq_wait[i]);
+	for (i = 0; i < WBT_NUM_CLASSES; i++) {
+		blk_rq_stat_init(&rwb->class_stat[i][READ]);
+		blk_rq_stat_init(&rwb->class_stat[i][WRITE]);
+	}
 
 	rwb->rqos.id = RQ_QOS_WBT;
 	rwb->rqos.ops = &wbt_rqos_ops;
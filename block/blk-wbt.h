@@ -16,17 +16,32 @@ enum wbt_flags {
 	WBT_READ		= 2,	/* read */
 	WBT_KSWAPD		= 4,	/* write, from kswapd */
 	WBT_DISCARD		= 8,	/* discard */
+	WBT_RT			= 16,	/* write, from the RT I/O class */
+	WBT_IDLE		= 32,	/* write, from the idle I/O class */
 
-	WBT_NR_BITS		= 4,	/* number of bits */
+	WBT_NR_BITS		= 6,	/* number of bits */
 };
 
 enum {
 	WBT_RWQ_BG		= 0,
 	WBT_RWQ_KSWAPD,
 	WBT_RWQ_DISCARD,
+	WBT_RWQ_RT,
+	WBT_RWQ_IDLE,
 	WBT_NUM_RWQ,
 };
 
+/*
+ * I/O priority classes that latency stats are kept for. Requests without a
+ * class are counted as best effort.
+ */
+enum {
+	WBT_CLASS_RT		= 0,
+	WBT_CLASS_BE,
+	WBT_CLASS_IDLE,
+	WBT_NUM_CLASSES,
+};
+
 /*
  * Enable states. Either off, or on by default (done at init time),
  * or on through manual setup in sysfs.
@@ -43,6 +58,7 @@ struct rq_wb {
 	 */
 	unsigned int wb_background;		/* background writeback */
 	unsigned int wb_normal;			/* normal writeback */
+	unsigned int wb_idle;			/* idle I/O class writes */
 
 	short enable_state;			/* WBT_STATE_* */
 
@@ -68,6 +84,9 @@ struct rq_wb {
 	struct rq_qos rqos;
 	struct rq_wait rq_wait[WBT_NUM_RWQ];
 	struct rq_depth rq_depth;
+
+	/* Latencies per I/O class over the last window, [class][READ/WRITE] */
+	struct blk_rq_stat class_stat[WBT_NUM_CLASSES][2];
 };
 
 static inline struct rq_wb *RQWB(struct rq_qos *rqos)
@@ -101,6 +120,8 @@ void wbt_set_write_cache(struct request_queue *, bool);
 
 u64 wbt_default_latency_nsec(struct request_queue *);
 
+ssize_t wbt_class_stat_show(struct request_queue *, char *);
+
 #else
 
 static inline void wbt_track(struct request *rq, enum wbt_flags flags)
@@ -136,6 +157,10 @@ static inline u64 wbt_default_latency_nsec(struct request_queue *q)
 {
 	return 0;
 }
+static inline ssize_t wbt_class_stat_show(struct request_queue *q, char *page)
+{
+	return 0;
+}
 
 #endif /* CONFIG_BLK_WBT */
 
@@ -0,0 +1,848 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Flash I/O scheduler - read-priority scheduler for single queue UFS and
+ *  eMMC devices, for the blk-mq scheduling framework
+ *
+ *  On this kind of storage seeks are free but a deep queue of writes in the
+ *  device makes reads wait behind them. So:
+ *
+ *  - Reads from the foreground (RT tasks, the RT I/O class, boosted best
+ *    effort priorities and metadata) are kept on their own FIFO and always
+ *    dispatched first, even in the middle of a write batch.
+ *  - Other reads are served in FIFO order ahead of writes, but don't break a
+ *    write batch unless they have expired.
+ *  - Writes are dispatched in batches of sector-sorted requests, so the device
+ *    sees large sequential streams, and at most write_depth of them are in
+ *    flight at once.
+ *  - write_depth follows the completion latency of foreground reads measured
+ *    through blk-stat: it is halved whenever they miss read_lat_usec, and
+ *    grows back while they are well within it.
+ *  - An expired write is served once reads have starved writes
+ *    writes_starved times, so writes can't be starved forever.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/ioprio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/sched/rt.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-debugfs.h"
+#include "blk-mq-sched.h"
+#include "blk-stat.h"
+
+static const int read_expire = HZ / 4;	/* max time before a read is favoured */
+static const int write_expire = 2 * HZ;	/* ditto for writes, these limits are SOFT! */
+static const int writes_starved = 4;	/* max times reads can starve a write */
+static const int write_batch = 32;	/* max writes dispatched as one batch */
+static const u64 read_lat_nsec = 2000000ULL;	/* foreground read target */
+
+/* Window over which read latencies are gathered, once we start throttling */
+#define FLASH_STAT_WINDOW_MSECS	100
+
+enum {
+	FLASH_READ_PRIO	= 0,	/* foreground reads */
+	FLASH_READ,		/* other reads */
+	FLASH_WRITE,
+	FLASH_NUM_QUEUES,
+};
+
+struct flash_data {
+	struct request_queue *q;
+	struct blk_stat_callback *cb;
+
+	/*
+	 * requests are present on both a sort_list (by data direction) and a
+	 * fifo_list (by queue)
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[FLASH_NUM_QUEUES];
+	struct list_head dispatch;
+
+	struct request *next_write;	/* next write of the current batch */
+	unsigned int batching;		/* writes dispatched in the batch */
+	unsigned int starved;		/* times reads have starved writes */
+
+	atomic_t writes_inflight;
+	unsigned int write_depth;	/* current limit on writes_inflight */
+	unsigned int max_write_depth;
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int writes_starved;
+	int write_batch;
+	int front_merges;
+	u64 read_lat_nsec;
+
+	spinlock_t lock;
+};
+
+/*
+ * The queue a request goes to is decided when it's allocated, in the context
+ * of the submitter, and kept in elv.priv[0]. elv.priv[1] is set while a write
+ * counts towards writes_inflight.
+ */
+static inline int flash_rq_queue(const struct request *rq)
+{
+	return (uintptr_t)rq->elv.priv[0];
+}
+
+static bool flash_read_is_prio(struct bio *bio)
+{
+	struct io_context *ioc;
+	int ioprio;
+
+	if (bio && (bio->bi_opf & (REQ_META | REQ_PRIO)))
+		return true;
+	if (rt_task(current))
+		return true;
+
+	ioprio = bio ? bio_prio(bio) : 0;
+	if (!ioprio_valid(ioprio)) {
+		ioc = rq_ioc(bio);
+		if (ioc && ioprio_valid(ioc->ioprio))
+			ioprio = ioc->ioprio;
+		else
+			ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE,
+						   task_nice_ioprio(current));
+	}
+
+	switch (IOPRIO_PRIO_CLASS(ioprio)) {
+	case IOPRIO_CLASS_RT:
+		return true;
+	case IOPRIO_CLASS_BE:
+		return IOPRIO_PRIO_DATA(ioprio) < IOPRIO_NORM;
+	default:
+		return false;
+	}
+}
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static inline void
+flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	list_del_init(&rq->queuelist);
+
+	/*
+	 * We might not be on the rbtree, if we are doing an insert merge
+	 */
+	if (!RB_EMPTY_NODE(&rq->rb_node))
+		flash_del_rq_rb(fd, rq);
+
+	elv_rqhash_del(q, rq);
+	if (q->last_merge == rq)
+		q->last_merge = NULL;
+}
+
+static void flash_request_merged(struct request_queue *q, struct request *req,
+				 enum elv_merge type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		elv_rb_add(flash_rb_root(fd, req), req);
+	}
+}
+
+static void flash_merged_requests(struct request_queue *q, struct request *req,
+				  struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before((unsigned long)next->fifo_time,
+				(unsigned long)req->fifo_time)) {
+			list_move(&req->queuelist, &next->queuelist);
+			req->fifo_time = next->fifo_time;
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+static inline struct request *flash_fifo_head(struct flash_data *fd, int queue)
+{
+	if (list_empty(&fd->fifo_list[queue]))
+		return NULL;
+	return rq_entry_fifo(fd->fifo_list[queue].next);
+}
+
+static inline bool flash_fifo_expired(struct flash_data *fd, int queue)
+{
+	struct request *rq = flash_fifo_head(fd, queue);
+
+	return rq && time_after_eq(jiffies, (unsigned long)rq->fifo_time);
+}
+
+/*
+ * Pick the next write: continue the current batch in sector order if it
+ * isn't over, else start a new one from the oldest write.
+ */
+static struct request *flash_next_write(struct flash_data *fd)
+{
+	if (fd->next_write && fd->batching < fd->write_batch)
+		return fd->next_write;
+
+	fd->batching = 0;
+	return flash_fifo_head(fd, FLASH_WRITE);
+}
+
+static struct request *__flash_dispatch_request(struct flash_data *fd,
+						struct blk_mq_hw_ctx *hctx)
+{
+	struct request *rq;
+	bool writes, in_batch;
+
+	if (!list_empty(&fd->dispatch)) {
+		rq = list_first_entry(&fd->dispatch, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		goto done;
+	}
+
+	writes = !list_empty(&fd->fifo_list[FLASH_WRITE]);
+	in_batch = fd->next_write && fd->batching < fd->write_batch;
+
+	/*
+	 * Let an expired write through if reads have had their turn often
+	 * enough, even ahead of foreground reads.
+	 */
+	if (writes && fd->starved >= fd->writes_starved &&
+	    flash_fifo_expired(fd, FLASH_WRITE))
+		goto dispatch_write;
+
+	rq = flash_fifo_head(fd, FLASH_READ_PRIO);
+	if (rq)
+		goto dispatch_read;
+
+	/* Other reads wait for the current write batch, unless expired */
+	rq = flash_fifo_head(fd, FLASH_READ);
+	if (rq && (!in_batch || flash_fifo_expired(fd, FLASH_READ)))
+		goto dispatch_read;
+
+	if (!writes)
+		return NULL;
+
+dispatch_write:
+	/*
+	 * Keep the device's write queue short. A completion will run the
+	 * queue again.
+	 */
+	if (atomic_read(&fd->writes_inflight) >= READ_ONCE(fd->write_depth)) {
+		blk_mq_sched_mark_restart_hctx(hctx);
+		return NULL;
+	}
+
+	rq = flash_next_write(fd);
+	fd->starved = 0;
+	fd->batching++;
+	fd->next_write = flash_latter_request(rq);
+	rq->elv.priv[1] = (void *)1;
+	atomic_inc(&fd->writes_inflight);
+	goto remove;
+
+dispatch_read:
+	if (writes)
+		fd->starved++;
+remove:
+	flash_remove_request(rq->q, rq);
+done:
+	rq->rq_flags |= RQF_STARTED;
+	return rq;
+}
+
+/*
+ * One confusing aspect here is that we get called for a specific
+ * hardware queue, but we may return a request that is for a
+ * different hardware queue. This is because flash has shared
+ * state for all hardware queues, like mq-deadline.
+ */
+static struct request *flash_dispatch_request(struct blk_mq_hw_ctx *hctx)
+{
+	struct flash_data *fd = hctx->queue->elevator->elevator_data;
+	struct request *rq;
+
+	spin_lock(&fd->lock);
+	rq = __flash_dispatch_request(fd, hctx);
+	spin_unlock(&fd->lock);
+
+	return rq;
+}
+
+static void flash_put_write(struct flash_data *fd, struct request *rq)
+{
+	if (rq->elv.priv[1]) {
+		rq->elv.priv[1] = NULL;
+		atomic_dec(&fd->writes_inflight);
+	}
+}
+
+static int flash_lat_bucket(const struct request *rq)
+{
+	if (!(rq->rq_flags & RQF_ELVPRIV))
+		return -1;
+	return flash_rq_queue(rq);
+}
+
+/*
+ * Adjust the write depth given the latency of reads over the last window:
+ * halve it when reads are missing their target, grow it back slowly while
+ * they are well within it or while there are no reads at all.
+ */
+static void flash_stat_timer_fn(struct blk_stat_callback *cb)
+{
+	struct flash_data *fd = cb->data;
+	struct blk_rq_stat *stat = &cb->stat[FLASH_READ_PRIO];
+	unsigned int depth = fd->write_depth;
+	u64 target = fd->read_lat_nsec;
+
+	/* Without foreground reads, hold other reads to twice the target */
+	if (!stat->nr_samples) {
+		stat = &cb->stat[FLASH_READ];
+		target *= 2;
+	}
+
+	if (stat->nr_samples && stat->mean > target)
+		depth = max(depth / 2, 1U);
+	else if (!stat->nr_samples || stat->mean <= target / 2)
+		depth += max(fd->max_write_depth / 8, 1U);
+	depth = min(depth, fd->max_write_depth);
+	WRITE_ONCE(fd->write_depth, depth);
+
+	/* Keep watching until writes are back to full depth */
+	if (depth < fd->max_write_depth)
+		blk_stat_activate_msecs(fd->cb, FLASH_STAT_WINDOW_MSECS);
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int i;
+
+	blk_stat_remove_callback(fd->q, fd->cb);
+	blk_stat_free_callback(fd->cb);
+
+	for (i = 0; i < FLASH_NUM_QUEUES; i++)
+		BUG_ON(!list_empty(&fd->fifo_list[i]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static int flash_init_queue(struct request_queue *q, struct elevator_type *e)
+{
+	struct flash_data *fd;
+	struct elevator_queue *eq;
+	int i;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	fd = kzalloc_node(sizeof(*fd), GFP_KERNEL, q->node);
+	if (!fd)
+		goto err_eq;
+
+	fd->cb = blk_stat_alloc_callback(flash_stat_timer_fn, flash_lat_bucket,
+					 FLASH_NUM_QUEUES, fd);
+	if (!fd->cb)
+		goto err_fd;
+
+	fd->q = q;
+	for (i = 0; i < FLASH_NUM_QUEUES; i++)
+		INIT_LIST_HEAD(&fd->fifo_list[i]);
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	INIT_LIST_HEAD(&fd->dispatch);
+	atomic_set(&fd->writes_inflight, 0);
+	fd->max_write_depth = max(q->tag_set->queue_depth, 1U);
+	fd->write_depth = fd->max_write_depth;
+	fd->fifo_expire[READ] = read_expire;
+	fd->fifo_expire[WRITE] = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->write_batch = write_batch;
+	fd->front_merges = 1;
+	fd->read_lat_nsec = read_lat_nsec;
+	spin_lock_init(&fd->lock);
+
+	eq->elevator_data = fd;
+	q->elevator = eq;
+
+	blk_stat_add_callback(q, fd->cb);
+	return 0;
+
+err_fd:
+	kfree(fd);
+err_eq:
+	kobject_put(&eq->kobj);
+	return -ENOMEM;
+}
+
+static int flash_request_merge(struct request_queue *q, struct request **rq,
+			       struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	sector_t sector = bio_end_sector(bio);
+	struct request *__rq;
+
+	if (!fd->front_merges)
+		return ELEVATOR_NO_MERGE;
+
+	__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+	if (__rq) {
+		BUG_ON(sector != blk_rq_pos(__rq));
+
+		if (elv_bio_merge_ok(__rq, bio)) {
+			*rq = __rq;
+			return ELEVATOR_FRONT_MERGE;
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static bool flash_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio)
+{
+	struct request_queue *q = hctx->queue;
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *free = NULL;
+	bool ret;
+
+	spin_lock(&fd->lock);
+	ret = blk_mq_sched_try_merge(q, bio, &free);
+	spin_unlock(&fd->lock);
+
+	if (free)
+		blk_mq_free_request(free);
+
+	return ret;
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void flash_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
+				 bool at_head)
+{
+	struct request_queue *q = hctx->queue;
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	if (blk_mq_sched_try_insert_merge(q, rq))
+		return;
+
+	blk_mq_sched_request_inserted(rq);
+
+	if (at_head || blk_rq_is_passthrough(rq) ||
+	    !(rq->rq_flags & RQF_ELVPRIV)) {
+		if (at_head)
+			list_add(&rq->queuelist, &fd->dispatch);
+		else
+			list_add_tail(&rq->queuelist, &fd->dispatch);
+	} else {
+		elv_rb_add(flash_rb_root(fd, rq), rq);
+
+		if (rq_mergeable(rq)) {
+			elv_rqhash_add(q, rq);
+			if (!q->last_merge)
+				q->last_merge = rq;
+		}
+
+		/*
+		 * set expire time and add to fifo list
+		 */
+		rq->fifo_time = jiffies + fd->fifo_expire[data_dir];
+		list_add_tail(&rq->queuelist,
+			      &fd->fifo_list[flash_rq_queue(rq)]);
+	}
+}
+
+static void flash_insert_requests(struct blk_mq_hw_ctx *hctx,
+				  struct list_head *list, bool at_head)
+{
+	struct request_queue *q = hctx->queue;
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	spin_lock(&fd->lock);
+	while (!list_empty(list)) {
+		struct request *rq;
+
+		rq = list_first_entry(list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		flash_insert_request(hctx, rq, at_head);
+	}
+	spin_unlock(&fd->lock);
+}
+
+static void flash_prepare_request(struct request *rq, struct bio *bio)
+{
+	int queue;
+
+	if (op_is_write(rq->cmd_flags))
+		queue = FLASH_WRITE;
+	else if (flash_read_is_prio(bio))
+		queue = FLASH_READ_PRIO;
+	else
+		queue = FLASH_READ;
+
+	rq->elv.priv[0] = (void *)(uintptr_t)queue;
+	rq->elv.priv[1] = NULL;
+}
+
+static void flash_finish_request(struct request *rq)
+{
+	flash_put_write(rq->q->elevator->elevator_data, rq);
+}
+
+static void flash_requeue_request(struct request *rq)
+{
+	if (rq->rq_flags & RQF_ELVPRIV)
+		flash_put_write(rq->q->elevator->elevator_data, rq);
+}
+
+/*
+ * Start gathering read latencies as soon as a read misses the target, as
+ * kyber does.
+ */
+static void flash_completed_request(struct request *rq)
+{
+	struct flash_data *fd = rq->q->elevator->elevator_data;
+	u64 now;
+
+	if (!(rq->rq_flags & RQF_ELVPRIV) || rq_data_dir(rq) != READ)
+		return;
+
+	/* If we are already monitoring latencies, don't check again. */
+	if (blk_stat_is_active(fd->cb))
+		return;
+
+	now = ktime_get_ns();
+	if (now < rq->io_start_time_ns)
+		return;
+
+	if (now - rq->io_start_time_ns > fd->read_lat_nsec)
+		blk_stat_activate_msecs(fd->cb, FLASH_STAT_WINDOW_MSECS);
+}
+
+static bool flash_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct flash_data *fd = hctx->queue->elevator->elevator_data;
+	int i;
+
+	if (!list_empty_careful(&fd->dispatch))
+		return true;
+	for (i = 0; i < FLASH_NUM_QUEUES; i++)
+		if (!list_empty_careful(&fd->fifo_list[i]))
+			return true;
+	return false;
+}
+
+/*
+ * sysfs parts below
+ */
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static void
+flash_var_store(int *var, const char *page)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_read_expire_show, fd->fifo_expire[READ], 1);
+SHOW_FUNCTION(flash_write_expire_show, fd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_write_batch_show, fd->write_batch, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	flash_var_store(&__data, (page));				\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return count;							\
+}
+STORE_FUNCTION(flash_read_expire_store, &fd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_expire_store, &fd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_store, &fd->write_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+static ssize_t flash_read_lat_usec_show(struct elevator_queue *e, char *page)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	return sprintf(page, "%llu\n", div_u64(fd->read_lat_nsec, 1000));
+}
+
+static ssize_t flash_read_lat_usec_store(struct elevator_queue *e,
+					 const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+	unsigned long long usec;
+	int ret;
+
+	ret = kstrtoull(page, 10, &usec);
+	if (ret)
+		return ret;
+	if (!usec)
+		return -EINVAL;
+
+	fd->read_lat_nsec = usec * 1000;
+	return count;
+}
+
+#define FLASH_ATTR(name) \
+	__ATTR(name, 0644, flash_##name##_show, flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FLASH_ATTR(read_expire),
+	FLASH_ATTR(write_expire),
+	FLASH_ATTR(writes_starved),
+	FLASH_ATTR(write_batch),
+	FLASH_ATTR(front_merges),
+	FLASH_ATTR(read_lat_usec),
+	__ATTR_NULL
+};
+
+#ifdef CONFIG_BLK_DEBUG_FS
+#define FLASH_DEBUGFS_QUEUE_ATTRS(queue, name)				\
+static void *flash_##name##_fifo_start(struct seq_file *m,		\
+				       loff_t *pos)			\
+	__acquires(&fd->lock)						\
+{									\
+	struct request_queue *q = m->private;				\
+	struct flash_data *fd = q->elevator->elevator_data;		\
+									\
+	spin_lock(&fd->lock);						\
+	return seq_list_start(&fd->fifo_list[queue], *pos);		\
+}									\
+									\
+static void *flash_##name##_fifo_next(struct seq_file *m, void *v,	\
+				      loff_t *pos)			\
+{									\
+	struct request_queue *q = m->private;				\
+	struct flash_data *fd = q->elevator->elevator_data;		\
+									\
+	return seq_list_next(v, &fd->fifo_list[queue], pos);		\
+}									\
+									\
+static void flash_##name##_fifo_stop(struct seq_file *m, void *v)	\
+	__releases(&fd->lock)						\
+{									\
+	struct request_queue *q = m->private;				\
+	struct flash_data *fd = q->elevator->elevator_data;		\
+									\
+	spin_unlock(&fd->lock);						\
+}									\
+									\
+static const struct seq_operations flash_##name##_fifo_seq_ops = {	\
+	.start	= flash_##name##_fifo_start,				\
+	.next	= flash_##name##_fifo_next,				\
+	.stop	= flash_##name##_fifo_stop,				\
+	.show	= blk_mq_debugfs_rq_show,				\
+};
+FLASH_DEBUGFS_QUEUE_ATTRS(FLASH_READ_PRIO, read_prio)
+FLASH_DEBUGFS_QUEUE_ATTRS(FLASH_READ, read)
+FLASH_DEBUGFS_QUEUE_ATTRS(FLASH_WRITE, write)
+#undef FLASH_DEBUGFS_QUEUE_ATTRS
+
+static int flash_batching_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	seq_printf(m, "%u\n", fd->batching);
+	return 0;
+}
+
+static int flash_starved_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	seq_printf(m, "%u\n", fd->starved);
+	return 0;
+}
+
+static int flash_write_depth_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	seq_printf(m, "%u/%u inflight %d\n", fd->write_depth,
+		   fd->max_write_depth, atomic_read(&fd->writes_inflight));
+	return 0;
+}
+
+static void *flash_dispatch_start(struct seq_file *m, loff_t *pos)
+	__acquires(&fd->lock)
+{
+	struct request_queue *q = m->private;
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	spin_lock(&fd->lock);
+	return seq_list_start(&fd->dispatch, *pos);
+}
+
+static void *flash_dispatch_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct request_queue *q = m->private;
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return seq_list_next(v, &fd->dispatch, pos);
+}
+
+static void flash_dispatch_stop(struct seq_file *m, void *v)
+	__releases(&fd->lock)
+{
+	struct request_queue *q = m->private;
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	spin_unlock(&fd->lock);
+}
+
+static const struct seq_operations flash_dispatch_seq_ops = {
+	.start	= flash_dispatch_start,
+	.next	= flash_dispatch_next,
+	.stop	= flash_dispatch_stop,
+	.show	= blk_mq_debugfs_rq_show,
+};
+
+#define FLASH_QUEUE_ATTRS(name)						\
+	{#name "_fifo_list", 0400, .seq_ops = &flash_##name##_fifo_seq_ops}
+static const struct blk_mq_debugfs_attr flash_queue_debugfs_attrs[] = {
+	FLASH_QUEUE_ATTRS(read_prio),
+	FLASH_QUEUE_ATTRS(read),
+	FLASH_QUEUE_ATTRS(write),
+	{"batching", 0400, flash_batching_show},
+	{"starved", 0400, flash_starved_show},
+	{"write_depth", 0400, flash_write_depth_show},
+	{"dispatch", 0400, .seq_ops = &flash_dispatch_seq_ops},
+	{},
+};
+#undef FLASH_QUEUE_ATTRS
+#endif
+
+static struct elevator_type flash_sched = {
+	.ops.mq = {
+		.insert_requests	= flash_insert_requests,
+		.dispatch_request	= flash_dispatch_request,
+		.prepare_request	= flash_prepare_request,
+		.finish_request		= flash_finish_request,
+		.requeue_request	= flash_requeue_request,
+		.completed_request	= flash_completed_request,
+		.next_request		= elv_rb_latter_request,
+		.former_request		= elv_rb_former_request,
+		.bio_merge		= flash_bio_merge,
+		.request_merge		= flash_request_merge,
+		.requests_merged	= flash_merged_requests,
+		.request_merged		= flash_request_merged,
+		.has_work		= flash_has_work,
+		.init_sched		= flash_init_queue,
+		.exit_sched		= flash_exit_queue,
+	},
+
+	.uses_mq	= true,
+#ifdef CONFIG_BLK_DEBUG_FS
+	.queue_debugfs_attrs = flash_queue_debugfs_attrs,
+#endif
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+MODULE_ALIAS("flash-iosched");
+
+static int __init flash_init(void)
+{
+	return elv_register(&flash_sched);
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&flash_sched);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Read-priority I/O scheduler for flash storage");
@@ -29,10 +29,19 @@
 #include <linux/keyslot-manager.h>
 #include <linux/atomic.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/pm_runtime.h>
+#include <linux/rculist.h>
 #include <linux/wait.h>
 #include <linux/blkdev.h>
 
+/* Number of per-CPU slot hints, indexed by the low bits of the key hash */
+#define KSM_NR_SLOT_HINTS	8
+
+struct keyslot_hints {
+	unsigned int slot[KSM_NR_SLOT_HINTS];
+};
+
 struct keyslot {
 	atomic_t slot_refs;
 	struct list_head idle_slot_node;
@@ -63,13 +72,17 @@ struct keyslot_manager {
 
 	/*
 	 * Hash table which maps key hashes to keyslots, so that we can find a
-	 * key's keyslot in O(1) time rather than O(num_slots).  Protected by
-	 * 'lock'.  A cryptographic hash function is used so that timing attacks
-	 * can't leak information about the raw keys.
+	 * key's keyslot in O(1) time rather than O(num_slots).  Modified under
+	 * 'lock', and walked under RCU by the lockless lookup.  A cryptographic
+	 * hash function is used so that timing attacks can't leak information
+	 * about the raw keys.
 	 */
 	struct hlist_head *slot_hashtable;
 	unsigned int slot_hashtable_size;
 
+	/* The slots each CPU last got for a key, tried before the hash table */
+	struct keyslot_hints __percpu *slot_hints;
+
 	/* Per-keyslot data */
 	struct keyslot slots[];
 };
@@ -208,6 +221,10 @@ struct keyslot_manager *keyslot_manager_create(
 	for (i = 0; i < ksm->slot_hashtable_size; i++)
 		INIT_HLIST_HEAD(&ksm->slot_hashtable[i]);
 
+	ksm->slot_hints = alloc_percpu(struct keyslot_hints);
+	if (!ksm->slot_hints)
+		goto err_free_ksm;
+
 	return ksm;
 
 err_free_ksm:
@@ -240,6 +257,16 @@ static void remove_slot_from_lru_list(struct keyslot_manager *ksm, int slot)
 	spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
 }
 
+static bool keyslot_has_key(const struct keyslot *slotp,
+			    const struct blk_crypto_key *key)
+{
+	return slotp->key.hash == key->hash &&
+	       slotp->key.crypto_mode == key->crypto_mode &&
+	       slotp->key.size == key->size &&
+	       slotp->key.data_unit_size == key->data_unit_size &&
+	       !crypto_memneq(slotp->key.raw, key->raw, key->size);
+}
+
 static int find_keyslot(struct keyslot_manager *ksm,
 			const struct blk_crypto_key *key)
 {
@@ -247,11 +274,7 @@ static int find_keyslot(struct keyslot_manager *ksm,
 	const struct keyslot *slotp;
 
 	hlist_for_each_entry(slotp, head, hash_node) {
-		if (slotp->key.hash == key->hash &&
-		    slotp->key.crypto_mode == key->crypto_mode &&
-		    slotp->key.size == key->size &&
-		    slotp->key.data_unit_size == key->data_unit_size &&
-		    !crypto_memneq(slotp->key.raw, key->raw, key->size))
+		if (keyslot_has_key(slotp, key))
 			return slotp - ksm->slots;
 	}
 	return -ENOKEY;
@@ -272,6 +295,66 @@ static int find_and_grab_keyslot(struct keyslot_manager *ksm,
 	return slot;
 }
 
+static inline unsigned int keyslot_hint_idx(const struct blk_crypto_key *key)
+{
+	return key->hash & (KSM_NR_SLOT_HINTS - 1);
+}
+
+/*
+ * Take a reference to @slot if it's in use and holds @key.  A slot is only
+ * reprogrammed or evicted while it has no references, so once we hold one the
+ * key can't change under us and can be compared safely.
+ */
+static bool try_grab_busy_keyslot(struct keyslot_manager *ksm,
+				  unsigned int slot,
+				  const struct blk_crypto_key *key)
+{
+	struct keyslot *slotp = &ksm->slots[slot];
+
+	if (READ_ONCE(slotp->key.hash) != key->hash)
+		return false;
+	if (!atomic_inc_not_zero(&slotp->slot_refs))
+		return false;
+	if (keyslot_has_key(slotp, key))
+		return true;
+	keyslot_manager_put_slot(ksm, slot);
+	return false;
+}
+
+/*
+ * Lockless lookup of a slot which is in use and holds @key: first the slot
+ * this CPU last got for a key with the same hash bits, then the hash table.
+ * The hash table is walked under RCU while slots may be moving between
+ * buckets, which can make us miss the slot, but then we just fall back to the
+ * locked lookup.  Slots are never freed while the ksm is in use, so the walk
+ * never touches freed memory.
+ */
+static int find_and_grab_busy_keyslot(struct keyslot_manager *ksm,
+				      const struct blk_crypto_key *key)
+{
+	const struct hlist_head *head;
+	const struct keyslot *slotp;
+	unsigned int slot;
+
+	slot = this_cpu_read(ksm->slot_hints->slot[keyslot_hint_idx(key)]);
+	if (try_grab_busy_keyslot(ksm, slot, key))
+		return slot;
+
+	head = hash_bucket_for_key(ksm, key);
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(slotp, head, hash_node) {
+		slot = slotp - ksm->slots;
+		if (try_grab_busy_keyslot(ksm, slot, key)) {
+			rcu_read_unlock();
+			this_cpu_write(ksm->slot_hints->slot[keyslot_hint_idx(key)],
+				       slot);
+			return slot;
+		}
+	}
+	rcu_read_unlock();
+	return -ENOKEY;
+}
+
 /**
  * keyslot_manager_get_slot_for_key() - Program a key into a keyslot.
  * @ksm: The keyslot manager to program the key into.
@@ -282,7 +365,10 @@ static int find_and_grab_keyslot(struct keyslot_manager *ksm,
  * exists, return it with incremented refcount.  Otherwise, wait for a keyslot
  * to become idle and program it.
  *
- * Context: Process context. Takes and releases ksm->lock.
+ * The common case of a key whose slot is already in use by other I/O is
+ * handled without taking ksm->lock.
+ *
+ * Context: Process context. May take and release ksm->lock.
  * Return: The keyslot on success, else a -errno value.
  */
 int keyslot_manager_get_slot_for_key(struct keyslot_manager *ksm,
@@ -295,18 +381,23 @@ int keyslot_manager_get_slot_for_key(struct keyslot_manager *ksm,
 	if (keyslot_manager_is_passthrough(ksm))
 		return 0;
 
+	slot = find_and_grab_busy_keyslot(ksm, key);
+	if (slot >= 0)
+		return slot;
+
+	/* The key's slot may be idle, which needs it off the LRU list */
 	down_read(&ksm->lock);
 	slot = find_and_grab_keyslot(ksm, key);
 	up_read(&ksm->lock);
 	if (slot != -ENOKEY)
-		return slot;
+		goto out_set_hint;
 
 	for (;;) {
 		keyslot_manager_hw_enter(ksm);
 		slot = find_and_grab_keyslot(ksm, key);
 		if (slot != -ENOKEY) {
 			keyslot_manager_hw_exit(ksm);
-			return slot;
+			goto out_set_hint;
 		}
 
 		/*
@@ -332,17 +423,25 @@ int keyslot_manager_get_slot_for_key(struct keyslot_manager *ksm,
 		return err;
 	}
 
-	/* Move this slot to the hash list for the new key. */
+	/*
+	 * Move this slot to the hash list for the new key.  The key must be
+	 * visible before the reference, as the lockless lookup compares it
+	 * once it has taken a reference of its own.
+	 */
 	if (idle_slot->key.crypto_mode != BLK_ENCRYPTION_MODE_INVALID)
-		hlist_del(&idle_slot->hash_node);
-	hlist_add_head(&idle_slot->hash_node, hash_bucket_for_key(ksm, key));
-
-	atomic_set(&idle_slot->slot_refs, 1);
+		hlist_del_rcu(&idle_slot->hash_node);
 	idle_slot->key = *key;
+	hlist_add_head_rcu(&idle_slot->hash_node, hash_bucket_for_key(ksm, key));
+
+	atomic_set_release(&idle_slot->slot_refs, 1);
 
 	remove_slot_from_lru_list(ksm, slot);
 
 	keyslot_manager_hw_exit(ksm);
+out_set_hint:
+	if (slot >= 0)
+		this_cpu_write(ksm->slot_hints->slot[keyslot_hint_idx(key)],
+			       slot);
 	return slot;
 }
 
@@ -482,7 +581,7 @@ int keyslot_manager_evict_key(struct keyslot_manager *ksm,
 	if (err)
 		goto out_unlock;
 
-	hlist_del(&slotp->hash_node);
+	hlist_del_rcu(&slotp->hash_node);
 	memzero_explicit(&slotp->key, sizeof(slotp->key));
 	err = 0;
 out_unlock:
@@ -537,6 +636,7 @@ EXPORT_SYMBOL_GPL(keyslot_manager_private);
 void keyslot_manager_destroy(struct keyslot_manager *ksm)
 {
 	if (ksm) {
+		free_percpu(ksm->slot_hints);
 		kvfree(ksm->slot_hashtable);
 		memzero_explicit(ksm, struct_size(ksm, slots, ksm->num_slots));
 		kvfree(ksm);
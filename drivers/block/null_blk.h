@@ -20,6 +20,7 @@ struct nullb_cmd {
 	blk_status_t error;
 	struct nullb_queue *nq;
 	struct hrtimer timer;
+	u64 deadline; /* batch_completion: when the command is done */
 };
 
 struct nullb_queue {
@@ -30,6 +31,9 @@ struct nullb_queue {
 	unsigned int requeue_selection;
 
 	struct nullb_cmd *cmds;
+
+	struct llist_head cq; /* batch_completion: commands in flight */
+	struct hrtimer cq_timer;
 };
 
 struct nullb_device {
@@ -63,6 +67,7 @@ struct nullb_device {
 	bool memory_backed; /* if data is stored in memory */
 	bool discard; /* if support discard */
 	bool zoned; /* if device is zoned */
+	bool batch_completion; /* complete requests in batches */
 };
 
 struct nullb {
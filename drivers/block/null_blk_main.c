@@ -172,6 +172,10 @@ static unsigned long g_completion_nsec = 10000;
 module_param_named(completion_nsec, g_completion_nsec, ulong, 0444);
 MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
 
+static bool g_batch_completion;
+module_param_named(batch_completion, g_batch_completion, bool, 0444);
+MODULE_PARM_DESC(batch_completion, "Reap timer completions in batches per hardware queue, and allow polling for them (irqmode=2, queue_mode=2 only). Default: false");
+
 static int g_hw_queue_depth = 64;
 module_param_named(hw_queue_depth, g_hw_queue_depth, int, 0444);
 MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: 64");
@@ -293,6 +297,7 @@ NULLB_DEVICE_ATTR(mbps, uint);
 NULLB_DEVICE_ATTR(cache_size, ulong);
 NULLB_DEVICE_ATTR(zoned, bool);
 NULLB_DEVICE_ATTR(zone_size, ulong);
+NULLB_DEVICE_ATTR(batch_completion, bool);
 
 static ssize_t nullb_device_power_show(struct config_item *item, char *page)
 {
@@ -408,6 +413,7 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_badblocks,
 	&nullb_device_attr_zoned,
 	&nullb_device_attr_zone_size,
+	&nullb_device_attr_batch_completion,
 	NULL,
 };
 
@@ -460,7 +466,7 @@ nullb_group_drop_item(struct config_group *group, struct config_item *item)
 
 static ssize_t memb_group_features_show(struct config_item *item, char *page)
 {
-	return snprintf(page, PAGE_SIZE, "memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size\n");
+	return snprintf(page, PAGE_SIZE, "memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size,batch_completion\n");
 }
 
 CONFIGFS_ATTR_RO(memb_group_, features);
@@ -521,6 +527,7 @@ static struct nullb_device *null_alloc_dev(void)
 	dev->use_per_node_hctx = g_use_per_node_hctx;
 	dev->zoned = g_zoned;
 	dev->zone_size = g_zone_size;
+	dev->batch_completion = g_batch_completion;
 	return dev;
 }
 
@@ -654,6 +661,80 @@ static void null_cmd_end_timer(struct nullb_cmd *cmd)
 	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
 }
 
+/*
+ * With batch_completion, commands queue up on a per hardware queue completion
+ * queue instead of each arming its own timer, and are reaped from there by
+ * the queue's timer or by polling, as many as are due at a time.
+ *
+ * The timer is armed after queueing commands due at @deadline. If it is still
+ * queued it will see them when it fires, so it only ever needs moving earlier.
+ */
+static void null_arm_cq_timer(struct nullb_queue *nq, u64 deadline)
+{
+	struct hrtimer *timer = &nq->cq_timer;
+
+	if (hrtimer_is_queued(timer) &&
+	    hrtimer_get_expires_tv64(timer) <= (s64)deadline)
+		return;
+	hrtimer_start(timer, ns_to_ktime(deadline), HRTIMER_MODE_ABS);
+}
+
+static void null_cmd_end_batch(struct nullb_cmd *cmd)
+{
+	struct nullb_queue *nq = cmd->nq;
+
+	cmd->deadline = ktime_get_ns() + nq->dev->completion_nsec;
+	llist_add(&cmd->ll_list, &nq->cq);
+	null_arm_cq_timer(nq, cmd->deadline);
+}
+
+/*
+ * Complete the commands on @nq's completion queue that are due, and put the
+ * others back. Returns 1 if the one with @tag was among those completed.
+ */
+static int null_reap_cq(struct nullb_queue *nq, unsigned int tag)
+{
+	struct llist_node *first = NULL, *last = NULL, *entry;
+	struct nullb_cmd *cmd, *next;
+	u64 now = ktime_get_ns(), wake = U64_MAX;
+	LIST_HEAD(done);
+	int found = 0;
+
+	entry = llist_reverse_order(llist_del_all(&nq->cq));
+	llist_for_each_entry_safe(cmd, next, entry, ll_list) {
+		if (cmd->deadline > now) {
+			cmd->ll_list.next = first;
+			first = &cmd->ll_list;
+			if (!last)
+				last = first;
+			wake = min(wake, cmd->deadline);
+			continue;
+		}
+
+		if (cmd->rq->tag == tag)
+			found = 1;
+		if (cmd->error == BLK_STS_OK)
+			list_add_tail(&cmd->rq->queuelist, &done);
+		else
+			blk_mq_complete_request(cmd->rq);
+	}
+
+	if (first) {
+		llist_add_batch(first, last, &nq->cq);
+		null_arm_cq_timer(nq, wake);
+	}
+
+	blk_mq_complete_request_batch(&done);
+	return found;
+}
+
+static enum hrtimer_restart null_cq_timer_expired(struct hrtimer *timer)
+{
+	null_reap_cq(container_of(timer, struct nullb_queue, cq_timer), -1U);
+
+	return HRTIMER_NORESTART;
+}
+
 static void null_softirq_done_fn(struct request *rq)
 {
 	struct nullb *nullb = rq->q->queuedata;
@@ -1295,7 +1376,10 @@ static blk_status_t null_handle_cmd(struct nullb_cmd *cmd)
 		end_cmd(cmd);
 		break;
 	case NULL_IRQ_TIMER:
-		null_cmd_end_timer(cmd);
+		if (dev->batch_completion)
+			null_cmd_end_batch(cmd);
+		else
+			null_cmd_end_timer(cmd);
 		break;
 	}
 	return BLK_STS_OK;
@@ -1458,14 +1542,28 @@ static blk_status_t null_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return null_handle_cmd(cmd);
 }
 
+static int null_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	return null_reap_cq(hctx->driver_data, tag);
+}
+
 static const struct blk_mq_ops null_mq_ops = {
 	.queue_rq       = null_queue_rq,
 	.complete	= null_softirq_done_fn,
 	.timeout	= null_timeout_rq,
 };
 
+static const struct blk_mq_ops null_mq_batch_ops = {
+	.queue_rq       = null_queue_rq,
+	.complete	= null_softirq_done_fn,
+	.timeout	= null_timeout_rq,
+	.poll		= null_poll,
+};
+
 static void cleanup_queue(struct nullb_queue *nq)
 {
+	if (nq->dev)
+		hrtimer_cancel(&nq->cq_timer);
 	kfree(nq->tag_map);
 	kfree(nq->cmds);
 }
@@ -1546,6 +1644,10 @@ static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
 	init_waitqueue_head(&nq->wait);
 	nq->queue_depth = nullb->queue_depth;
 	nq->dev = nullb->dev;
+
+	init_llist_head(&nq->cq);
+	hrtimer_init(&nq->cq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	nq->cq_timer.function = null_cq_timer_expired;
 }
 
 static void null_init_queues(struct nullb *nullb)
@@ -1648,7 +1750,10 @@ static int null_gendisk_register(struct nullb *nullb)
 
 static int null_init_tag_set(struct nullb *nullb, struct blk_mq_tag_set *set)
 {
-	set->ops = &null_mq_ops;
+	if (nullb ? nullb->dev->batch_completion : g_batch_completion)
+		set->ops = &null_mq_batch_ops;
+	else
+		set->ops = &null_mq_ops;
 	set->nr_hw_queues = nullb ? nullb->dev->submit_queues :
 						g_submit_queues;
 	set->queue_depth = nullb ? nullb->dev->hw_queue_depth :
@@ -1682,6 +1787,10 @@ static void null_validate_conf(struct nullb_device *dev)
 	dev->queue_mode = min_t(unsigned int, dev->queue_mode, NULL_Q_MQ);
 	dev->irqmode = min_t(unsigned int, dev->irqmode, NULL_IRQ_TIMER);
 
+	/* completes through blk-mq, with the timer as interrupt */
+	if (dev->queue_mode != NULL_Q_MQ || dev->irqmode != NULL_IRQ_TIMER)
+		dev->batch_completion = false;
+
 	/* Do memory allocation, so set blocking */
 	if (dev->memory_backed)
 		dev->blocking = true;
@@ -1893,6 +2002,12 @@ static int __init null_init(void)
 	else if (g_submit_queues <= 0)
 		g_submit_queues = 1;
 
+	if (g_batch_completion &&
+	    (g_queue_mode != NULL_Q_MQ || g_irqmode != NULL_IRQ_TIMER)) {
+		pr_warn("null_blk: batch_completion needs queue_mode=2 irqmode=2\n");
+		g_batch_completion = false;
+	}
+
 	if (g_queue_mode == NULL_Q_MQ && shared_tags) {
 		ret = null_init_tag_set(NULL, &tag_set);
 		if (ret)
@@ -22,6 +22,7 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/percpu.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -324,14 +325,20 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	return ++fiq->reqctr;
+	return atomic64_inc_return(&fiq->reqctr);
+}
+
+static unsigned req_in_len(struct fuse_req *req)
+{
+	return sizeof(struct fuse_in_header) +
+		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
 }
 
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req,
 				bool sync)
 {
-	req->in.h.len = sizeof(struct fuse_in_header) +
-		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->in.h.len = req_in_len(req);
+	req->cq = NULL;
 	list_add_tail(&req->list, &fiq->pending);
 	if (sync)
 		wake_up_sync(&fiq->waitq);
@@ -340,6 +347,45 @@ static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req,
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 }
 
+/*
+ * Queue the request on the per-CPU queue of the current CPU if a reader of a
+ * channel bound to it is idle and not yet claimed by another request.  Returns
+ * false if it must go to the input queue instead, where any reader takes it.
+ * This way a request never waits for a bound reader that is busy, maybe with a
+ * request which itself waits for this one.
+ */
+static bool queue_request_cpu(struct fuse_conn *fc, struct fuse_req *req,
+			      bool sync)
+{
+	struct fuse_cqueue __percpu *cqs = READ_ONCE(fc->cq);
+	struct fuse_cqueue *cq;
+
+	if (!cqs)
+		return false;
+
+	cq = raw_cpu_ptr(cqs);
+	if (!READ_ONCE(cq->nr_waiting))
+		return false;
+
+	spin_lock(&cq->lock);
+	if (!cq->connected || cq->nr_pending >= cq->nr_waiting) {
+		spin_unlock(&cq->lock);
+		return false;
+	}
+	req->in.h.len = req_in_len(req);
+	req->cq = cq;
+	list_add_tail(&req->list, &cq->pending);
+	cq->nr_pending++;
+	if (sync)
+		wake_up_sync(&cq->waitq);
+	else
+		wake_up(&cq->waitq);
+	spin_unlock(&cq->lock);
+	kill_fasync(&fc->iq.fasync, SIGIO, POLL_IN);
+
+	return true;
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -370,8 +416,10 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->lock);
 		req->in.h.unique = fuse_get_unique(fiq);
+		if (queue_request_cpu(fc, req, false))
+			continue;
+		spin_lock(&fiq->lock);
 		queue_request(fiq, req, 0);
 		spin_unlock(&fiq->lock);
 	}
@@ -465,6 +513,9 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 	}
 
 	if (!test_bit(FR_FORCE, &req->flags)) {
+		struct fuse_cqueue *cq;
+		bool pending;
+
 		/* Only fatal signals may interrupt this */
 		err = wait_event_killable(req->waitq,
 					test_bit(FR_FINISHED, &req->flags));
@@ -472,15 +523,25 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 			return;
 
 		spin_lock(&fiq->lock);
+		/* req->cq only changes under fiq->lock */
+		cq = req->cq;
+		if (cq)
+			spin_lock(&cq->lock);
 		/* Request is not yet in userspace, bail out */
-		if (test_bit(FR_PENDING, &req->flags)) {
+		pending = test_bit(FR_PENDING, &req->flags);
+		if (pending) {
 			list_del(&req->list);
-			spin_unlock(&fiq->lock);
+			if (cq)
+				cq->nr_pending--;
+		}
+		if (cq)
+			spin_unlock(&cq->lock);
+		spin_unlock(&fiq->lock);
+		if (pending) {
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->lock);
 	}
 
 	/*
@@ -495,22 +556,25 @@ static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_iqueue *fiq = &fc->iq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->lock);
-		req->out.h.error = -ENOTCONN;
-	} else {
-		req->in.h.unique = fuse_get_unique(fiq);
+	req->in.h.unique = fuse_get_unique(fiq);
+	/* acquire extra reference, since request is still needed
+	   after request_end() */
+	__fuse_get_request(req);
+	if (!queue_request_cpu(fc, req, true)) {
+		spin_lock(&fiq->lock);
+		if (!fiq->connected) {
+			spin_unlock(&fiq->lock);
+			__fuse_put_request(req);
+			req->out.h.error = -ENOTCONN;
+			return;
+		}
 		queue_request(fiq, req, 1);
-		/* acquire extra reference, since request is still needed
-		   after request_end() */
-		__fuse_get_request(req);
 		spin_unlock(&fiq->lock);
-
-		request_wait_answer(fc, req);
-		/* Pairs with smp_wmb() in request_end() */
-		smp_rmb();
 	}
+
+	request_wait_answer(fc, req);
+	/* Pairs with smp_wmb() in request_end() */
+	smp_rmb();
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
@@ -1107,6 +1171,98 @@ static int request_pending(struct fuse_iqueue *fiq)
 		forget_pending(fiq);
 }
 
+static bool cqueue_ready(struct fuse_iqueue *fiq, struct fuse_cqueue *cq)
+{
+	return !list_empty(&cq->pending) || !fiq->connected ||
+		request_pending(fiq);
+}
+
+/*
+ * Move the pending requests of a per-CPU queue to the input queue.
+ *
+ * Called with fiq->lock and cq->lock held.
+ */
+static void cqueue_requeue(struct fuse_iqueue *fiq, struct fuse_cqueue *cq)
+{
+	struct fuse_req *req;
+
+	list_for_each_entry(req, &cq->pending, list)
+		req->cq = NULL;
+	list_splice_tail_init(&cq->pending, &fiq->pending);
+	cq->nr_pending = 0;
+	wake_up_all(&fiq->waitq);
+}
+
+/*
+ * Readers of a bound channel wait on both the per-CPU queue and the input
+ * queue, exclusively on both.  Only waiting readers get requests queued on
+ * the per-CPU queue.
+ */
+static int cqueue_wait(struct fuse_iqueue *fiq, struct fuse_cqueue *cq)
+{
+	DEFINE_WAIT(cwait);
+	DEFINE_WAIT(iwait);
+	int err = 0;
+
+	spin_lock(&cq->lock);
+	cq->nr_waiting++;
+	spin_unlock(&cq->lock);
+
+	for (;;) {
+		prepare_to_wait_exclusive(&cq->waitq, &cwait,
+					  TASK_INTERRUPTIBLE);
+		prepare_to_wait_exclusive(&fiq->waitq, &iwait,
+					  TASK_INTERRUPTIBLE);
+		if (cqueue_ready(fiq, cq))
+			break;
+		if (signal_pending(current)) {
+			err = -ERESTARTSYS;
+			break;
+		}
+		schedule();
+	}
+	finish_wait(&fiq->waitq, &iwait);
+	finish_wait(&cq->waitq, &cwait);
+
+	spin_lock(&fiq->lock);
+	spin_lock(&cq->lock);
+	cq->nr_waiting--;
+	/*
+	 * A reader leaving without a request may have been claimed by one,
+	 * let any reader have the requests no waiting reader is left for.
+	 */
+	if (err && cq->nr_pending > cq->nr_waiting)
+		cqueue_requeue(fiq, cq);
+	spin_unlock(&cq->lock);
+	spin_unlock(&fiq->lock);
+
+	return err;
+}
+
+static struct fuse_req *cqueue_dequeue(struct fuse_iqueue *fiq,
+				       struct fuse_cqueue *cq)
+{
+	struct fuse_req *req = NULL;
+
+	spin_lock(&cq->lock);
+	if (!list_empty(&cq->pending)) {
+		req = list_entry(cq->pending.next, struct fuse_req, list);
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+		cq->nr_pending--;
+	}
+	spin_unlock(&cq->lock);
+
+	/*
+	 * The wakeup which got us here may have been for the input queue,
+	 * pass it on.
+	 */
+	if (req && request_pending(fiq))
+		wake_up(&fiq->waitq);
+
+	return req;
+}
+
 /*
  * Transfer an interrupt request to userspace
  *
@@ -1276,6 +1432,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
 	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_cqueue *cq = READ_ONCE(fud->cq);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1283,6 +1440,12 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 
  restart:
 	for (;;) {
+		if (cq) {
+			req = cqueue_dequeue(fiq, cq);
+			if (req)
+				goto dequeued;
+		}
+
 		spin_lock(&fiq->lock);
 		if (!fiq->connected || request_pending(fiq))
 			break;
@@ -1290,12 +1453,19 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 
 		if (file->f_flags & O_NONBLOCK)
 			return -EAGAIN;
-		err = wait_event_interruptible_exclusive(fiq->waitq,
+		if (cq)
+			err = cqueue_wait(fiq, cq);
+		else
+			err = wait_event_interruptible_exclusive(fiq->waitq,
 				!fiq->connected || request_pending(fiq));
 		if (err)
 			return err;
 	}
 
+	/* The wakeup may have been for the per-CPU queue, pass it on */
+	if (cq && !list_empty_careful(&cq->pending))
+		wake_up(&cq->waitq);
+
 	if (!fiq->connected) {
 		err = (fc->aborted && fc->abort_err) ? -ECONNABORTED : -ENODEV;
 		goto err_unlock;
@@ -1320,6 +1490,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	list_del_init(&req->list);
 	spin_unlock(&fiq->lock);
 
+ dequeued:
 	in = &req->in;
 	reqsize = in->h.len;
 
@@ -2100,6 +2271,7 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	__poll_t mask = EPOLLOUT | EPOLLWRNORM;
 	struct fuse_iqueue *fiq;
+	struct fuse_cqueue *cq;
 	struct fuse_dev *fud = fuse_get_dev(file);
 
 	if (!fud)
@@ -2107,11 +2279,15 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 
 	fiq = &fud->fc->iq;
 	poll_wait(file, &fiq->waitq, wait);
+	cq = READ_ONCE(fud->cq);
+	if (cq)
+		poll_wait(file, &cq->waitq, wait);
 
 	spin_lock(&fiq->lock);
 	if (!fiq->connected)
 		mask = EPOLLERR;
-	else if (request_pending(fiq))
+	else if (request_pending(fiq) ||
+		 (cq && !list_empty_careful(&cq->pending)))
 		mask |= EPOLLIN | EPOLLRDNORM;
 	spin_unlock(&fiq->lock);
 
@@ -2150,6 +2326,29 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/* Called with fiq->lock held */
+static void abort_cqueues(struct fuse_conn *fc, struct list_head *to_end)
+{
+	struct fuse_req *req;
+	int cpu;
+
+	if (!fc->cq)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_cqueue *cq = per_cpu_ptr(fc->cq, cpu);
+
+		spin_lock(&cq->lock);
+		cq->connected = 0;
+		list_for_each_entry(req, &cq->pending, list)
+			clear_bit(FR_PENDING, &req->flags);
+		list_splice_tail_init(&cq->pending, to_end);
+		cq->nr_pending = 0;
+		wake_up_all(&cq->waitq);
+		spin_unlock(&cq->lock);
+	}
+}
+
 /*
  * Abort all requests.
  *
@@ -2209,6 +2408,7 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 		list_for_each_entry(req, &fiq->pending, list)
 			clear_bit(FR_PENDING, &req->flags);
 		list_splice_tail_init(&fiq->pending, &to_end);
+		abort_cqueues(fc, &to_end);
 		while (forget_pending(fiq))
 			kfree(dequeue_forget(fiq, 1, NULL));
 		wake_up_all(&fiq->waitq);
@@ -2232,6 +2432,102 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Unbind the channel from its per-CPU queue.  The requests left on a queue
+ * without any channel are moved to the input queue.
+ *
+ * Called with fiq->lock held.
+ */
+static void fuse_dev_unbind(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = &fud->fc->iq;
+	struct fuse_cqueue *cq = fud->cq;
+
+	if (!cq)
+		return;
+
+	spin_lock(&cq->lock);
+	if (!--cq->nr_devs && !list_empty(&cq->pending))
+		cqueue_requeue(fiq, cq);
+	spin_unlock(&cq->lock);
+	WRITE_ONCE(fud->cq, NULL);
+}
+
+static int fuse_cqueues_alloc(struct fuse_conn *fc)
+{
+	struct fuse_cqueue __percpu *cqs;
+	int cpu;
+
+	if (fc->cq)
+		return 0;
+
+	cqs = alloc_percpu(struct fuse_cqueue);
+	if (!cqs)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_cqueue *cq = per_cpu_ptr(cqs, cpu);
+
+		cq->connected = 1;
+		spin_lock_init(&cq->lock);
+		init_waitqueue_head(&cq->waitq);
+		INIT_LIST_HEAD(&cq->pending);
+		cq->nr_devs = 0;
+		cq->nr_waiting = 0;
+		cq->nr_pending = 0;
+	}
+
+	/* Publish under fiq->lock so that fuse_abort_conn() sees them */
+	spin_lock(&fc->iq.lock);
+	if (fc->iq.connected) {
+		WRITE_ONCE(fc->cq, cqs);
+		cqs = NULL;
+	}
+	spin_unlock(&fc->iq.lock);
+
+	if (cqs) {
+		free_percpu(cqs);
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+/* Called with fuse_mutex held */
+static int fuse_dev_bind_cpu(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_cqueue *cq = NULL;
+	int err;
+
+	if (cpu != ~0U) {
+		if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+			return -EINVAL;
+
+		err = fuse_cqueues_alloc(fc);
+		if (err)
+			return err;
+		cq = per_cpu_ptr(fc->cq, cpu);
+	}
+
+	spin_lock(&fiq->lock);
+	if (!fiq->connected) {
+		spin_unlock(&fiq->lock);
+		return -ENODEV;
+	}
+	fuse_dev_unbind(fud);
+	if (cq) {
+		spin_lock(&cq->lock);
+		cq->nr_devs++;
+		spin_unlock(&cq->lock);
+		WRITE_ONCE(fud->cq, cq);
+	}
+	spin_unlock(&fiq->lock);
+
+	return 0;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2241,6 +2537,10 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		struct fuse_pqueue *fpq = &fud->pq;
 		LIST_HEAD(to_end);
 
+		spin_lock(&fc->iq.lock);
+		fuse_dev_unbind(fud);
+		spin_unlock(&fc->iq.lock);
+
 		spin_lock(&fpq->lock);
 		WARN_ON(!list_empty(&fpq->io));
 		list_splice_init(&fpq->processing, &to_end);
@@ -2292,6 +2592,8 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 {
 	int res;
 	int oldfd;
+	u32 cpu;
+	struct fuse_passthrough_node pn;
 	struct fuse_dev *fud = NULL;
 
 	switch (cmd) {
@@ -2329,6 +2631,27 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				res = fuse_passthrough_open(fud, oldfd);
 		}
 		break;
+	case FUSE_DEV_IOC_PASSTHROUGH_NODE:
+		res = -EFAULT;
+		if (!copy_from_user(&pn, (void __user *)arg, sizeof(pn))) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud)
+				res = fuse_passthrough_node(fud->fc, &pn);
+		}
+		break;
+	case FUSE_DEV_IOC_BIND_CPU:
+		res = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *)arg)) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud) {
+				mutex_lock(&fuse_mutex);
+				res = fuse_dev_bind_cpu(fud, cpu);
+				mutex_unlock(&fuse_mutex);
+			}
+		}
+		break;
 	default:
 		res = -ENOTTY;
 		break;
@@ -401,16 +401,32 @@ static struct dentry *fuse_lookup(struct inode *dir, struct dentry *entry,
 	struct fuse_entry_out outarg;
 	struct inode *inode;
 	struct dentry *newent;
+	struct path lower = {};
+	struct cred *cred = NULL;
 	bool outarg_valid = true;
 	bool locked;
 
 	if (fuse_is_bad(dir))
 		return ERR_PTR(-EIO);
 
-	locked = fuse_lock_inode(dir);
-	err = fuse_lookup_name(dir->i_sb, get_node_id(dir), &entry->d_name,
-			       &outarg, &inode);
-	fuse_unlock_inode(dir, locked);
+	err = fuse_passthrough_lookup(dir, &entry->d_name, &lower, &cred);
+	if (err != -ENOENT) {
+		locked = fuse_lock_inode(dir);
+		err = fuse_lookup_name(dir->i_sb, get_node_id(dir),
+				       &entry->d_name, &outarg, &inode);
+		fuse_unlock_inode(dir, locked);
+	} else {
+		inode = NULL;
+	}
+	if (lower.dentry) {
+		/* the child mirrors the lower entry, unless opted out */
+		if (!err && inode &&
+		    !test_bit(FUSE_I_PASSTHROUGH_OPT_OUT,
+			      &get_fuse_inode(inode)->state) &&
+		    !((d_inode(lower.dentry)->i_mode ^ inode->i_mode) & S_IFMT))
+			fuse_passthrough_node_set(inode, &lower, cred);
+		fuse_passthrough_node_put(&lower, cred);
+	}
 	if (err == -ENOENT) {
 		outarg_valid = false;
 		err = 0;
@@ -1000,6 +1016,66 @@ static int fuse_do_getattr(struct inode *inode, struct kstat *stat,
 	return err;
 }
 
+/*
+ * Take size, blocks and times from the lower inode of the passthrough, and
+ * the rest from the attributes the daemon last gave.
+ */
+static int fuse_passthrough_getattr(struct inode *inode, struct kstat *stat)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	const struct cred *old_cred;
+	struct fuse_attr attr;
+	struct kstat lstat;
+	struct path path;
+	struct cred *cred;
+	u64 attr_version;
+	int err;
+
+	/* with writeback cache, the size and times of the inode are ahead */
+	if (fc->writeback_cache && S_ISREG(inode->i_mode))
+		return -EOPNOTSUPP;
+
+	if (!fuse_passthrough_node_get(inode, &path, &cred))
+		return -EOPNOTSUPP;
+
+	attr_version = fuse_get_attr_version(fc);
+	old_cred = override_creds(cred);
+	err = vfs_getattr(&path, &lstat, STATX_BASIC_STATS,
+			  AT_STATX_SYNC_AS_STAT);
+	revert_creds(old_cred);
+	fuse_passthrough_node_put(&path, cred);
+	if (err)
+		return err;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.ino = fi->orig_ino;
+	attr.mode = fi->orig_i_mode;
+	attr.uid = from_kuid(fc->user_ns, inode->i_uid);
+	attr.gid = from_kgid(fc->user_ns, inode->i_gid);
+	attr.rdev = new_encode_dev(inode->i_rdev);
+	attr.nlink = inode->i_nlink;
+	attr.size = lstat.size;
+	attr.blocks = lstat.blocks;
+	attr.blksize = 1 << inode->i_blkbits;
+	attr.atime = lstat.atime.tv_sec;
+	attr.atimensec = lstat.atime.tv_nsec;
+	attr.mtime = lstat.mtime.tv_sec;
+	attr.mtimensec = lstat.mtime.tv_nsec;
+	attr.ctime = lstat.ctime.tv_sec;
+	attr.ctimensec = lstat.ctime.tv_nsec;
+
+	/*
+	 * Only the size and times come from the lower inode. Keep the timeout
+	 * the daemon gave, or permission checks would ask it every time.
+	 */
+	fuse_change_attributes(inode, &attr, fi->i_time, attr_version);
+	if (stat)
+		fuse_fillattr(inode, &attr, stat);
+
+	return 0;
+}
+
 static int fuse_update_get_attr(struct inode *inode, struct file *file,
 				struct kstat *stat, unsigned int flags)
 {
@@ -1015,6 +1091,8 @@ static int fuse_update_get_attr(struct inode *inode, struct file *file,
 		sync = time_before64(fi->i_time, get_jiffies_64());
 
 	if (sync) {
+		if (!fuse_passthrough_getattr(inode, stat))
+			return 0;
 		forget_all_cached_acls(inode);
 		err = fuse_do_getattr(inode, stat, file);
 	} else if (stat) {
@@ -1416,6 +1494,7 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	int plus, err;
 	size_t nbytes;
 	struct page *page;
+	struct fuse_file *ff = file->private_data;
 	struct inode *inode = file_inode(file);
 	struct fuse_conn *fc = get_fuse_conn(inode);
 	struct fuse_req *req;
@@ -1425,6 +1504,9 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	if (ff->passthrough.filp)
+		return fuse_passthrough_readdir(file, ctx);
+
 	req = fuse_get_req(fc, 1);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
@@ -1509,6 +1591,9 @@ static const char *fuse_get_link(struct dentry *dentry,
 
 static int fuse_dir_open(struct inode *inode, struct file *file)
 {
+	if (!fuse_is_bad(inode) && !fuse_passthrough_opendir(inode, file))
+		return 0;
+
 	return fuse_open_common(inode, file, true);
 }
 
@@ -1522,6 +1607,13 @@ static int fuse_dir_release(struct inode *inode, struct file *file)
 static int fuse_dir_fsync(struct file *file, loff_t start, loff_t end,
 			  int datasync)
 {
+	struct fuse_file *ff = file->private_data;
+
+	/* the daemon does not know about this file */
+	if (ff->passthrough_dir)
+		return vfs_fsync_range(ff->passthrough.filp, start, end,
+				       datasync);
+
 	return fuse_fsync_common(file, start, end, datasync, 1);
 }
 
@@ -1529,9 +1621,10 @@ static long fuse_dir_ioctl(struct file *file, unsigned int cmd,
 			    unsigned long arg)
 {
 	struct fuse_conn *fc = get_fuse_conn(file->f_mapping->host);
+	struct fuse_file *ff = file->private_data;
 
 	/* FUSE_IOCTL_DIR only supported for API version >= 7.18 */
-	if (fc->minor < 18)
+	if (fc->minor < 18 || ff->passthrough_dir)
 		return -ENOTTY;
 
 	return fuse_ioctl_common(file, cmd, arg, FUSE_IOCTL_DIR);
@@ -1541,8 +1634,9 @@ static long fuse_dir_compat_ioctl(struct file *file, unsigned int cmd,
 				   unsigned long arg)
 {
 	struct fuse_conn *fc = get_fuse_conn(file->f_mapping->host);
+	struct fuse_file *ff = file->private_data;
 
-	if (fc->minor < 18)
+	if (fc->minor < 18 || ff->passthrough_dir)
 		return -ENOTTY;
 
 	return fuse_ioctl_common(file, cmd, arg,
@@ -93,10 +93,10 @@ static void fuse_file_put(struct fuse_file *ff, bool sync, bool isdir)
 	if (refcount_dec_and_test(&ff->count)) {
 		struct fuse_req *req = ff->reserved_req;
 
-		if (ff->fc->no_open && !isdir) {
+		if ((ff->fc->no_open && !isdir) || ff->passthrough_dir) {
 			/*
 			 * Drop the release request when client does not
-			 * implement 'open'
+			 * implement 'open', or did not see it
 			 */
 			__clear_bit(FR_BACKGROUND, &req->flags);
 			iput(req->misc.release.inode);
@@ -108,6 +108,13 @@ struct fuse_inode {
 
 	/** Lock for serializing lookup and readdir for back compatibility*/
 	struct mutex mutex;
+
+	/** Lower path of the directory and metadata passthrough, protected
+	 * by fc->lock */
+	struct path passthrough_path;
+
+	/** Credentials to access passthrough_path with */
+	struct cred *passthrough_cred;
 };
 
 /** FUSE inode state bits */
@@ -120,6 +127,8 @@ enum {
 	FUSE_I_SIZE_UNSTABLE,
 	/* Bad inode */
 	FUSE_I_BAD,
+	/** Opted out of the directory and metadata passthrough */
+	FUSE_I_PASSTHROUGH_OPT_OUT,
 };
 
 struct fuse_conn;
@@ -133,6 +142,8 @@ struct fuse_conn;
 struct fuse_passthrough {
 	struct file *filp;
 	struct cred *cred;
+	/** Spare asynchronous request, reused to avoid an allocation */
+	struct fuse_aio_req *aio_req;
 };
 
 /** FUSE specific file data */
@@ -172,6 +183,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Directory opened in passthrough, without FUSE_OPENDIR */
+	bool passthrough_dir:1;
 };
 
 /** One input argument of a request */
@@ -341,6 +355,9 @@ struct fuse_req {
 	/* Request flags, updated with test/set/clear_bit() */
 	unsigned long flags;
 
+	/** Per-CPU queue the request was queued on, NULL for the input queue */
+	struct fuse_cqueue *cq;
+
 	/** The request input */
 	struct fuse_in in;
 
@@ -419,7 +436,7 @@ struct fuse_iqueue {
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** The list of pending requests */
 	struct list_head pending;
@@ -438,6 +455,38 @@ struct fuse_iqueue {
 	struct fasync_struct *fasync;
 };
 
+/**
+ * Per-CPU input queue
+ *
+ * Requests issued on a CPU which has channels bound to it with
+ * FUSE_DEV_IOC_BIND_CPU are queued here rather than on the input queue, so
+ * that the daemon threads reading these channels neither contend on the
+ * input queue lock nor get woken up for the requests of other CPUs.
+ * Interrupts, forgets and notification replies always use the input queue.
+ */
+struct fuse_cqueue {
+	/** Connection established */
+	unsigned connected;
+
+	/** Lock protecting accesses to members of this structure */
+	spinlock_t lock;
+
+	/** Readers of the bound channels are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Number of channels bound to this queue */
+	unsigned nr_devs;
+
+	/** Number of readers of the bound channels waiting for a request */
+	unsigned nr_waiting;
+
+	/** Number of requests on the pending list */
+	unsigned nr_pending;
+};
+
 struct fuse_pqueue {
 	/** Connection established */
 	unsigned connected;
@@ -462,6 +511,9 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Per-CPU queue the channel is bound to, or NULL */
+	struct fuse_cqueue *cq;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -506,6 +558,9 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-CPU input queues, allocated when a channel is first bound */
+	struct fuse_cqueue __percpu *cq;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -1042,6 +1097,8 @@ struct posix_acl *fuse_get_acl(struct inode *inode, int type);
 int fuse_set_acl(struct inode *inode, struct posix_acl *acl, int type);
 
 /* passthrough.c */
+int fuse_passthrough_init(void);
+void fuse_passthrough_cleanup(void);
 int fuse_passthrough_open(struct fuse_dev *fud, u32 lower_fd);
 int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
 			   struct fuse_open_out *openarg);
@@ -1049,5 +1106,16 @@ void fuse_passthrough_release(struct fuse_passthrough *passthrough);
 ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
 ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+int fuse_passthrough_node(struct fuse_conn *fc,
+			  struct fuse_passthrough_node *pn);
+void fuse_passthrough_node_set(struct inode *inode, const struct path *path,
+			       struct cred *cred);
+bool fuse_passthrough_node_get(struct inode *inode, struct path *path,
+			       struct cred **cred);
+void fuse_passthrough_node_put(struct path *path, struct cred *cred);
+int fuse_passthrough_lookup(struct inode *dir, const struct qstr *name,
+			    struct path *path, struct cred **cred);
+int fuse_passthrough_opendir(struct inode *inode, struct file *file);
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx);
 
 #endif /* _FS_FUSE_I_H */
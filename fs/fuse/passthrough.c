@@ -5,7 +5,11 @@
 #include <linux/file.h>
 #include <linux/fuse.h>
 #include <linux/idr.h>
+#include <linux/llist.h>
+#include <linux/namei.h>
+#include <linux/slab.h>
 #include <linux/uio.h>
+#include <linux/workqueue.h>
 
 #define PASSTHROUGH_IOCB_MASK                                                  \
 	(IOCB_APPEND | IOCB_DSYNC | IOCB_HIPRI | IOCB_NOWAIT | IOCB_SYNC)
@@ -13,8 +17,25 @@
 struct fuse_aio_req {
 	struct kiocb iocb;
 	struct kiocb *iocb_fuse;
+	struct llist_node node;
+	long res;
+	long res2;
 };
 
+/*
+ * Write completions arriving in interrupt context are collected per CPU and
+ * finished from a work item, so that the superblock write reference is
+ * dropped and the attributes are copied up in process context, once per
+ * file for a run of completions rather than once per request.
+ */
+struct fuse_aio_batch {
+	struct llist_head list;
+	struct work_struct work;
+};
+
+static struct kmem_cache *fuse_aio_req_cachep;
+static DEFINE_PER_CPU(struct fuse_aio_batch, fuse_aio_batch);
+
 static void fuse_file_accessed(struct file *dst_file, struct file *src_file)
 {
 	struct inode *dst_inode;
@@ -58,7 +79,31 @@ static void fuse_copyattr(struct file *dst_file, struct file *src_file)
 	i_size_write(dst, i_size_read(src));
 }
 
-static void fuse_aio_cleanup_handler(struct fuse_aio_req *aio_req)
+/*
+ * Each passthrough file keeps one request around, which is all the common
+ * case of a single asynchronous request in flight per file ever needs.
+ */
+static struct fuse_aio_req *fuse_aio_req_alloc(struct fuse_file *ff)
+{
+	struct fuse_aio_req *aio_req;
+
+	aio_req = xchg(&ff->passthrough.aio_req, NULL);
+	if (!aio_req)
+		aio_req = kmem_cache_alloc(fuse_aio_req_cachep, GFP_KERNEL);
+
+	return aio_req;
+}
+
+/* Must be called before completing iocb_fuse, which may release the file */
+static void fuse_aio_req_free(struct fuse_aio_req *aio_req)
+{
+	struct fuse_file *ff = aio_req->iocb_fuse->ki_filp->private_data;
+
+	if (cmpxchg(&ff->passthrough.aio_req, NULL, aio_req))
+		kmem_cache_free(fuse_aio_req_cachep, aio_req);
+}
+
+static void fuse_aio_end_write(struct fuse_aio_req *aio_req, bool copyattr)
 {
 	struct kiocb *iocb = &aio_req->iocb;
 	struct kiocb *iocb_fuse = aio_req->iocb_fuse;
@@ -67,11 +112,51 @@ static void fuse_aio_cleanup_handler(struct fuse_aio_req *aio_req)
 		__sb_writers_acquired(file_inode(iocb->ki_filp)->i_sb,
 				      SB_FREEZE_WRITE);
 		file_end_write(iocb->ki_filp);
-		fuse_copyattr(iocb_fuse->ki_filp, iocb->ki_filp);
+		if (copyattr)
+			fuse_copyattr(iocb_fuse->ki_filp, iocb->ki_filp);
 	}
 
 	iocb_fuse->ki_pos = iocb->ki_pos;
-	kfree(aio_req);
+}
+
+static void fuse_aio_cleanup_handler(struct fuse_aio_req *aio_req)
+{
+	fuse_aio_end_write(aio_req, true);
+	fuse_aio_req_free(aio_req);
+}
+
+static void fuse_aio_batch_work(struct work_struct *work)
+{
+	struct fuse_aio_batch *batch =
+		container_of(work, struct fuse_aio_batch, work);
+	struct fuse_aio_req *aio_req, *next;
+	struct llist_node *list;
+
+	list = llist_reverse_order(llist_del_all(&batch->list));
+
+	/*
+	 * Finish all the writes before completing any of them, so that no
+	 * completion is reported before the attributes it changed.
+	 */
+	llist_for_each_entry(aio_req, list, node) {
+		struct file *filp = aio_req->iocb_fuse->ki_filp;
+		bool copyattr = true;
+
+		if (aio_req->node.next) {
+			next = llist_entry(aio_req->node.next,
+					   struct fuse_aio_req, node);
+			copyattr = next->iocb_fuse->ki_filp != filp;
+		}
+		fuse_aio_end_write(aio_req, copyattr);
+	}
+
+	llist_for_each_entry_safe(aio_req, next, list, node) {
+		struct kiocb *iocb_fuse = aio_req->iocb_fuse;
+		long res = aio_req->res, res2 = aio_req->res2;
+
+		fuse_aio_req_free(aio_req);
+		iocb_fuse->ki_complete(iocb_fuse, res, res2);
+	}
 }
 
 static void fuse_aio_rw_complete(struct kiocb *iocb, long res, long res2)
@@ -80,6 +165,17 @@ static void fuse_aio_rw_complete(struct kiocb *iocb, long res, long res2)
 		container_of(iocb, struct fuse_aio_req, iocb);
 	struct kiocb *iocb_fuse = aio_req->iocb_fuse;
 
+	if ((iocb->ki_flags & IOCB_WRITE) && in_interrupt()) {
+		struct fuse_aio_batch *batch = this_cpu_ptr(&fuse_aio_batch);
+
+		aio_req->res = res;
+		aio_req->res2 = res2;
+		if (llist_add(&aio_req->node, &batch->list))
+			queue_work_on(smp_processor_id(), system_highpri_wq,
+				      &batch->work);
+		return;
+	}
+
 	fuse_aio_cleanup_handler(aio_req);
 	iocb_fuse->ki_complete(iocb_fuse, res, res2);
 }
@@ -104,7 +200,7 @@ ssize_t fuse_passthrough_read_iter(struct kiocb *iocb_fuse,
 	} else {
 		struct fuse_aio_req *aio_req;
 
-		aio_req = kmalloc(sizeof(struct fuse_aio_req), GFP_KERNEL);
+		aio_req = fuse_aio_req_alloc(ff);
 		if (!aio_req) {
 			ret = -ENOMEM;
 			goto out;
@@ -155,7 +251,7 @@ ssize_t fuse_passthrough_write_iter(struct kiocb *iocb_fuse,
 	} else {
 		struct fuse_aio_req *aio_req;
 
-		aio_req = kmalloc(sizeof(struct fuse_aio_req), GFP_KERNEL);
+		aio_req = fuse_aio_req_alloc(ff);
 		if (!aio_req) {
 			ret = -ENOMEM;
 			goto out;
@@ -248,6 +344,7 @@ int fuse_passthrough_open(struct fuse_dev *fud, u32 lower_fd)
 
 	passthrough->filp = passthrough_filp;
 	passthrough->cred = prepare_creds();
+	passthrough->aio_req = NULL;
 
 	idr_preload(GFP_KERNEL);
 	spin_lock(&fc->passthrough_req_lock);
@@ -303,4 +400,266 @@ void fuse_passthrough_release(struct fuse_passthrough *passthrough)
 		put_cred(passthrough->cred);
 		passthrough->cred = NULL;
 	}
+	if (passthrough->aio_req) {
+		kmem_cache_free(fuse_aio_req_cachep, passthrough->aio_req);
+		passthrough->aio_req = NULL;
+	}
+}
+
+void fuse_passthrough_node_set(struct inode *inode, const struct path *path,
+			       struct cred *cred)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct path old_path;
+	struct cred *old_cred;
+
+	if (path) {
+		path_get(path);
+		get_new_cred(cred);
+	}
+
+	spin_lock(&fc->lock);
+	old_path = fi->passthrough_path;
+	old_cred = fi->passthrough_cred;
+	if (path) {
+		fi->passthrough_path = *path;
+		fi->passthrough_cred = cred;
+	} else {
+		fi->passthrough_path.mnt = NULL;
+		fi->passthrough_path.dentry = NULL;
+		fi->passthrough_cred = NULL;
+	}
+	spin_unlock(&fc->lock);
+
+	if (old_path.dentry)
+		fuse_passthrough_node_put(&old_path, old_cred);
+}
+
+bool fuse_passthrough_node_get(struct inode *inode, struct path *path,
+			       struct cred **cred)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	if (!READ_ONCE(fi->passthrough_path.dentry))
+		return false;
+
+	spin_lock(&fc->lock);
+	*path = fi->passthrough_path;
+	*cred = fi->passthrough_cred;
+	if (path->dentry) {
+		path_get(path);
+		get_new_cred(*cred);
+	}
+	spin_unlock(&fc->lock);
+
+	return path->dentry != NULL;
+}
+
+void fuse_passthrough_node_put(struct path *path, struct cred *cred)
+{
+	path_put(path);
+	put_cred(cred);
+}
+
+int fuse_passthrough_node(struct fuse_conn *fc,
+			  struct fuse_passthrough_node *pn)
+{
+	struct file *lower = NULL;
+	struct inode *inode;
+	struct cred *cred;
+	int err;
+
+	if (!fc->passthrough)
+		return -EPERM;
+
+	if (pn->flags & ~FUSE_PASSTHROUGH_NODE_OPT_OUT)
+		return -EINVAL;
+
+	if (!(pn->flags & FUSE_PASSTHROUGH_NODE_OPT_OUT)) {
+		lower = fget(pn->fd);
+		if (!lower)
+			return -EBADF;
+
+		if (file_inode(lower)->i_sb->s_stack_depth >=
+		    FILESYSTEM_MAX_STACK_DEPTH) {
+			pr_err("FUSE: fs stacking depth exceeded for passthrough\n");
+			err = -EINVAL;
+			goto out_fput;
+		}
+	}
+
+	down_read(&fc->killsb);
+	err = -ENOENT;
+	if (!fc->sb)
+		goto out_unlock;
+
+	inode = ilookup5(fc->sb, pn->nodeid, fuse_inode_eq, &pn->nodeid);
+	if (!inode)
+		goto out_unlock;
+
+	err = 0;
+	if (!lower) {
+		set_bit(FUSE_I_PASSTHROUGH_OPT_OUT,
+			&get_fuse_inode(inode)->state);
+		fuse_passthrough_node_set(inode, NULL, NULL);
+	} else if ((file_inode(lower)->i_mode ^ inode->i_mode) & S_IFMT) {
+		err = -EINVAL;
+	} else {
+		err = -ENOMEM;
+		cred = prepare_creds();
+		if (cred) {
+			clear_bit(FUSE_I_PASSTHROUGH_OPT_OUT,
+				  &get_fuse_inode(inode)->state);
+			fuse_passthrough_node_set(inode, &lower->f_path, cred);
+			put_cred(cred);
+			err = 0;
+		}
+	}
+	iput(inode);
+
+out_unlock:
+	up_read(&fc->killsb);
+out_fput:
+	if (lower)
+		fput(lower);
+
+	return err;
+}
+
+/*
+ * Look @name up in the lower directory of @dir.  Returns -ENOENT if it is
+ * missing there, or 0 with @path set to the lower entry if it is found, in
+ * which case the caller puts @path and @cred.  @path is left empty if @dir
+ * has no passthrough or the lower lookup failed otherwise.
+ */
+int fuse_passthrough_lookup(struct inode *dir, const struct qstr *name,
+			    struct path *path, struct cred **cred)
+{
+	const struct cred *old_cred;
+	struct path parent;
+	struct dentry *lower;
+
+	if (!fuse_passthrough_node_get(dir, &parent, cred))
+		return 0;
+
+	old_cred = override_creds(*cred);
+	lower = lookup_one_len_unlocked(name->name, parent.dentry, name->len);
+	revert_creds(old_cred);
+
+	if (IS_ERR(lower)) {
+		fuse_passthrough_node_put(&parent, *cred);
+		return 0;
+	}
+
+	if (d_is_negative(lower)) {
+		dput(lower);
+		fuse_passthrough_node_put(&parent, *cred);
+		return -ENOENT;
+	}
+
+	path->mnt = parent.mnt;
+	path->dentry = lower;
+	dput(parent.dentry);
+
+	return 0;
+}
+
+/*
+ * Open a directory with passthrough in the kernel, without FUSE_OPENDIR.
+ * Returns -EOPNOTSUPP if the daemon has to open it.
+ */
+int fuse_passthrough_opendir(struct inode *inode, struct file *file)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_file *ff;
+	struct file *lower;
+	struct path path;
+	struct cred *cred;
+
+	if (!fuse_passthrough_node_get(inode, &path, &cred))
+		return -EOPNOTSUPP;
+
+	ff = fuse_file_alloc(fc);
+	if (!ff) {
+		fuse_passthrough_node_put(&path, cred);
+		return -ENOMEM;
+	}
+
+	lower = dentry_open(&path, O_RDONLY | O_DIRECTORY, cred);
+	path_put(&path);
+	if (IS_ERR(lower)) {
+		put_cred(cred);
+		fuse_file_free(ff);
+		return -EOPNOTSUPP;
+	}
+
+	ff->fh = 0;
+	ff->open_flags = FOPEN_KEEP_CACHE;
+	ff->nodeid = get_node_id(inode);
+	ff->passthrough.filp = lower;
+	ff->passthrough.cred = cred;
+	ff->passthrough_dir = true;
+	file->private_data = ff;
+
+	return 0;
+}
+
+/*
+ * Directory entries come straight from the lower directory, so d_ino is the
+ * lower inode number rather than the one the daemon reports through stat().
+ */
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int err;
+
+	/*
+	 * Seeks only move the FUSE file, catch the lower file up so that
+	 * rewinddir() and seekdir() work.
+	 */
+	if (passthrough_filp->f_pos != ctx->pos) {
+		loff_t pos = vfs_llseek(passthrough_filp, ctx->pos, SEEK_SET);
+
+		if (pos < 0)
+			return pos;
+	}
+
+	old_cred = override_creds(ff->passthrough.cred);
+	err = iterate_dir(passthrough_filp, ctx);
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+
+	return err;
+}
+
+int __init fuse_passthrough_init(void)
+{
+	int cpu;
+
+	fuse_aio_req_cachep = KMEM_CACHE(fuse_aio_req, SLAB_HWCACHE_ALIGN);
+	if (!fuse_aio_req_cachep)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_aio_batch *batch = per_cpu_ptr(&fuse_aio_batch, cpu);
+
+		init_llist_head(&batch->list);
+		INIT_WORK(&batch->work, fuse_aio_batch_work);
+	}
+
+	return 0;
+}
+
+void fuse_passthrough_cleanup(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		flush_work(&per_cpu_ptr(&fuse_aio_batch, cpu)->work);
+	kmem_cache_destroy(fuse_aio_req_cachep);
 }
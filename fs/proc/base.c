@@ -3419,6 +3419,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_PROCESS_RECLAIM
 	REG("reclaim", 0222, proc_reclaim_operations),
 #endif
+#ifdef CONFIG_LRU_GEN
+	REG("lru_gen",    S_IRUSR, proc_pid_lru_gen_operations),
+#endif
 #ifdef CONFIG_PROC_PAGE_MONITOR
 	REG("clear_refs", S_IWUSR, proc_clear_refs_operations),
 	REG("smaps",      S_IRUGO, proc_pid_smaps_operations),
@@ -209,6 +209,7 @@ extern const struct inode_operations proc_link_inode_operations;
 
 extern const struct inode_operations proc_pid_link_inode_operations;
 extern const struct file_operations proc_reclaim_operations;
+extern const struct file_operations proc_pid_lru_gen_operations;
 
 void proc_init_kmemcache(void);
 void set_proc_pid_nlink(void);
@@ -21,6 +21,10 @@
 #include <linux/pkeys.h>
 #include <linux/mm_inline.h>
 #include <linux/ctype.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
+#include <linux/poll.h>
+#include <linux/proc_fs.h>
 
 #include <asm/elf.h>
 #include <asm/tlb.h>
@@ -77,6 +81,15 @@ void task_mem(struct seq_file *m, struct mm_struct *mm)
 		    " kB\nVmPTE:\t", mm_pgtables_bytes(mm) >> 10, 8);
 	SEQ_PUT_DEC(" kB\nVmSwap:\t", swap);
 	seq_puts(m, " kB\n");
+#ifdef CONFIG_SWAP
+	seq_put_decimal_ull(m, "SwapInFaults:\t",
+			    atomic_long_read(&mm->swap_ra.faults));
+	seq_put_decimal_ull(m, "\nSwapRaPages:\t",
+			    atomic_long_read(&mm->swap_ra.pages));
+	seq_put_decimal_ull(m, "\nSwapRaHits:\t",
+			    atomic_long_read(&mm->swap_ra.hits));
+	seq_putc(m, '\n');
+#endif
 	hugetlb_report_usage(m, mm);
 }
 #undef SEQ_PUT_DEC
@@ -1915,6 +1928,8 @@ static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 
 	if (rp->nr_to_reclaim && (addr != end))
 		goto cont;
+	if (addr != end)
+		rp->stop_addr = addr;
 
 	cond_resched();
 	return 0;
@@ -1994,15 +2009,100 @@ struct reclaim_param reclaim_task_anon(struct task_struct *task,
 	return rp;
 }
 
+/*
+ * Parses "file", "anon", "all" or "<start> <len>" in @type_buf, the
+ * addresses being returned in @start and @end for the latter.
+ */
+static int reclaim_parse(char *type_buf, enum reclaim_type *type,
+			 unsigned long *start, unsigned long *end)
+{
+	char *token;
+	unsigned long long len, len_in, tmp;
+
+	if (!strcmp(type_buf, "file"))
+		*type = RECLAIM_FILE;
+	else if (!strcmp(type_buf, "anon"))
+		*type = RECLAIM_ANON;
+	else if (!strcmp(type_buf, "all"))
+		*type = RECLAIM_ALL;
+	else if (isdigit(*type_buf))
+		*type = RECLAIM_RANGE;
+	else
+		return -EINVAL;
+
+	if (*type != RECLAIM_RANGE) {
+		*start = 0;
+		*end = TASK_SIZE;
+		return 0;
+	}
+
+	token = strsep(&type_buf, " ");
+	if (!token)
+		return -EINVAL;
+	tmp = memparse(token, &token);
+	if (tmp & ~PAGE_MASK || tmp > ULONG_MAX)
+		return -EINVAL;
+	*start = tmp;
+
+	token = strsep(&type_buf, " ");
+	if (!token)
+		return -EINVAL;
+	len_in = memparse(token, &token);
+	len = (len_in + ~PAGE_MASK) & PAGE_MASK;
+	if (len > ULONG_MAX)
+		return -EINVAL;
+	/*
+	 * Check to see whether len was rounded up from small -ve
+	 * to zero.
+	 */
+	if (len_in && !len)
+		return -EINVAL;
+
+	*end = *start + len;
+	if (*end < *start)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Walks the VMAs of @type between @start and @end, the caller holding
+ * mmap_sem. Returns non-zero if walk->pmd_entry stopped the walk.
+ */
+static int reclaim_mm(struct mm_struct *mm, enum reclaim_type type,
+		      unsigned long start, unsigned long end,
+		      struct mm_walk *walk)
+{
+	struct reclaim_param *rp = walk->private;
+	struct vm_area_struct *vma;
+	int ret = 0;
+
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end && !ret;
+	     vma = vma->vm_next) {
+		if (is_vm_hugetlb_page(vma))
+			continue;
+
+		if (type == RECLAIM_ANON && vma->vm_file)
+			continue;
+
+		if (type == RECLAIM_FILE && !vma->vm_file)
+			continue;
+
+		rp->vma = vma;
+		ret = walk_page_range(max(vma->vm_start, start),
+				      min(vma->vm_end, end), walk);
+	}
+
+	return ret;
+}
+
 static ssize_t reclaim_write(struct file *file, const char __user *buf,
 				size_t count, loff_t *ppos)
 {
 	struct task_struct *task;
 	char buffer[200];
 	struct mm_struct *mm;
-	struct vm_area_struct *vma;
 	enum reclaim_type type;
-	char *type_buf;
 	struct mm_walk reclaim_walk = {};
 	unsigned long start = 0;
 	unsigned long end = 0;
@@ -2015,48 +2115,8 @@ static ssize_t reclaim_write(struct file *file, const char __user *buf,
 	if (copy_from_user(buffer, buf, count))
 		return -EFAULT;
 
-	type_buf = strstrip(buffer);
-	if (!strcmp(type_buf, "file"))
-		type = RECLAIM_FILE;
-	else if (!strcmp(type_buf, "anon"))
-		type = RECLAIM_ANON;
-	else if (!strcmp(type_buf, "all"))
-		type = RECLAIM_ALL;
-	else if (isdigit(*type_buf))
-		type = RECLAIM_RANGE;
-	else
-		goto out_err;
-
-	if (type == RECLAIM_RANGE) {
-		char *token;
-		unsigned long long len, len_in, tmp;
-
-		token = strsep(&type_buf, " ");
-		if (!token)
-			goto out_err;
-		tmp = memparse(token, &token);
-		if (tmp & ~PAGE_MASK || tmp > ULONG_MAX)
-			goto out_err;
-		start = tmp;
-
-		token = strsep(&type_buf, " ");
-		if (!token)
-			goto out_err;
-		len_in = memparse(token, &token);
-		len = (len_in + ~PAGE_MASK) & PAGE_MASK;
-		if (len > ULONG_MAX)
-			goto out_err;
-		/*
-		 * Check to see whether len was rounded up from small -ve
-		 * to zero.
-		 */
-		if (len_in && !len)
-			goto out_err;
-
-		end = start + len;
-		if (end < start)
-			goto out_err;
-	}
+	if (reclaim_parse(strstrip(buffer), &type, &start, &end))
+		return -EINVAL;
 
 	task = get_proc_task(file->f_path.dentry->d_inode);
 	if (!task)
@@ -2074,51 +2134,626 @@ static ssize_t reclaim_write(struct file *file, const char __user *buf,
 	reclaim_walk.private = &rp;
 
 	down_read(&mm->mmap_sem);
-	if (type == RECLAIM_RANGE) {
-		vma = find_vma(mm, start);
-		while (vma) {
-			if (vma->vm_start > end)
-				break;
-			if (is_vm_hugetlb_page(vma))
-				continue;
+	reclaim_mm(mm, type, start, end, &reclaim_walk);
+	flush_tlb_mm(mm);
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+out:
+	put_task_struct(task);
+	return count;
+}
 
-			rp.vma = vma;
-			walk_page_range(max(vma->vm_start, start),
-					min(vma->vm_end, end),
-					&reclaim_walk);
-			vma = vma->vm_next;
-		}
+const struct file_operations proc_reclaim_operations = {
+	.write		= reclaim_write,
+	.llseek		= noop_llseek,
+};
+
+/*
+ * Asynchronous process reclaim. Each open file of /proc/reclaim queues
+ * requests, one per line written, as "<pid> file|anon|all" or
+ * "<pid> <start> <len>". A single kthread serves the requests of all the
+ * files round-robin, reclaiming at most sysctl_process_reclaim_rate pages
+ * per second, and the results of a file are read back from it as
+ * "<pid> <type> <scanned> <reclaimed> <error>" lines. poll() reports when
+ * results are available.
+ */
+int sysctl_process_reclaim_rate;
+
+/* pages reclaimed from a request before the next one gets its turn */
+#define RECLAIM_ASYNC_SLICE	(SWAP_CLUSTER_MAX * 8)
+
+struct reclaim_client {
+	struct kref kref;
+	wait_queue_head_t wait;
+	/* completed requests */
+	struct list_head done;
+	bool closed;
+};
+
+struct reclaim_req {
+	struct reclaim_param rp;
+	struct list_head list;
+	struct reclaim_client *client;
+	struct pid *pid;
+	enum reclaim_type type;
+	/* what remains to be walked */
+	unsigned long start;
+	unsigned long end;
+	int err;
+};
+
+static const char * const reclaim_type_names[] = {
+	[RECLAIM_FILE]	= "file",
+	[RECLAIM_ANON]	= "anon",
+	[RECLAIM_ALL]	= "all",
+	[RECLAIM_RANGE]	= "range",
+};
+
+/* protects the queue, and the done lists and closed flags of the clients */
+static DEFINE_SPINLOCK(reclaim_queue_lock);
+static LIST_HEAD(reclaim_queue);
+static DECLARE_WAIT_QUEUE_HEAD(reclaim_queue_wait);
+
+static void reclaim_client_free(struct kref *kref)
+{
+	kfree(container_of(kref, struct reclaim_client, kref));
+}
+
+static void reclaim_req_free(struct reclaim_req *req)
+{
+	put_pid(req->pid);
+	kfree(req);
+}
+
+/* queued and running requests hold a reference to their client */
+static void reclaim_req_put(struct reclaim_req *req)
+{
+	struct reclaim_client *client = req->client;
+
+	reclaim_req_free(req);
+	kref_put(&client->kref, reclaim_client_free);
+}
+
+static int reclaim_async_pte_range(pmd_t *pmd, unsigned long addr,
+				   unsigned long end, struct mm_walk *walk)
+{
+	struct reclaim_param *rp = walk->private;
+	struct reclaim_req *req = container_of(rp, struct reclaim_req, rp);
+
+	if (!rp->nr_to_reclaim) {
+		/* out of budget, resume from here on the next turn */
+		req->start = addr;
+		return 1;
+	}
+
+	reclaim_pte_range(pmd, addr, end, walk);
+	if (rp->stop_addr) {
+		/* out of budget within the range, resume where it stopped */
+		req->start = rp->stop_addr;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Reclaims up to @budget pages for @req */
+static void reclaim_req_run(struct reclaim_req *req, int budget)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+	struct mm_walk walk = {
+		.pmd_entry = reclaim_async_pte_range,
+		.private = &req->rp,
+	};
+
+	task = get_pid_task(req->pid, PIDTYPE_PID);
+	if (!task) {
+		req->err = -ESRCH;
+		return;
+	}
+	mm = get_task_mm(task);
+	put_task_struct(task);
+	if (!mm) {
+		req->err = -ESRCH;
+		return;
+	}
+
+	walk.mm = mm;
+	req->rp.nr_to_reclaim = budget;
+	req->rp.stop_addr = 0;
+
+	down_read(&mm->mmap_sem);
+	if (!reclaim_mm(mm, req->type, req->start, req->end, &walk))
+		req->start = req->end;
+	flush_tlb_mm(mm);
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+}
+
+/* Completes @req, unless it has pages left to reclaim */
+static void reclaim_req_finish(struct reclaim_req *req)
+{
+	struct reclaim_client *client = req->client;
+	bool drop = false;
+
+	spin_lock(&reclaim_queue_lock);
+	if (client->closed) {
+		drop = true;
+	} else if (!req->err && req->start < req->end) {
+		list_add_tail(&req->list, &reclaim_queue);
 	} else {
-		for (vma = mm->mmap; vma; vma = vma->vm_next) {
-			if (is_vm_hugetlb_page(vma))
-				continue;
+		/* the file holds its own reference until it's closed */
+		list_add_tail(&req->list, &client->done);
+		kref_put(&client->kref, reclaim_client_free);
+		wake_up_interruptible(&client->wait);
+	}
+	spin_unlock(&reclaim_queue_lock);
 
-			if (type == RECLAIM_ANON && vma->vm_file)
-				continue;
+	if (drop)
+		reclaim_req_put(req);
+}
+
+static int reclaim_async_thread(void *unused)
+{
+	unsigned long last = jiffies;
+	long tokens = 0;
+	/* fraction of a page earned, in pages * jiffies / HZ */
+	u32 credit = 0;
+
+	set_freezable();
 
-			if (type == RECLAIM_FILE && !vma->vm_file)
+	while (!kthread_should_stop()) {
+		int rate = READ_ONCE(sysctl_process_reclaim_rate);
+		int budget = RECLAIM_ASYNC_SLICE;
+		struct reclaim_req *req;
+		int reclaimed;
+
+		wait_event_freezable(reclaim_queue_wait,
+				     !list_empty_careful(&reclaim_queue) ||
+				     kthread_should_stop());
+
+		if (rate) {
+			long want = min_t(long, rate, SWAP_CLUSTER_MAX);
+			unsigned long elapsed = min(jiffies - last,
+						    (unsigned long)HZ);
+
+			/* refill, holding at most a second worth of pages */
+			tokens += div_u64_rem((u64)elapsed * rate + credit, HZ,
+					      &credit);
+			if (tokens >= rate) {
+				tokens = rate;
+				credit = 0;
+			}
+			last = jiffies;
+			if (tokens < want) {
+				schedule_timeout_idle(DIV_ROUND_UP((want - tokens) *
+							HZ, rate));
 				continue;
+			}
+			budget = min_t(long, budget, tokens);
+		}
+
+		spin_lock(&reclaim_queue_lock);
+		req = list_first_entry_or_null(&reclaim_queue,
+					       struct reclaim_req, list);
+		if (req)
+			list_del_init(&req->list);
+		spin_unlock(&reclaim_queue_lock);
+
+		if (!req)
+			continue;
+
+		reclaimed = req->rp.nr_reclaimed;
+		reclaim_req_run(req, budget);
+		if (rate)
+			tokens -= req->rp.nr_reclaimed - reclaimed;
+
+		reclaim_req_finish(req);
+		cond_resched();
+	}
+
+	return 0;
+}
 
-			rp.vma = vma;
-			walk_page_range(vma->vm_start, vma->vm_end,
-				&reclaim_walk);
+static int reclaim_async_open(struct inode *inode, struct file *file)
+{
+	struct reclaim_client *client;
+
+	client = kzalloc(sizeof(*client), GFP_KERNEL);
+	if (!client)
+		return -ENOMEM;
+
+	kref_init(&client->kref);
+	init_waitqueue_head(&client->wait);
+	INIT_LIST_HEAD(&client->done);
+	file->private_data = client;
+
+	return nonseekable_open(inode, file);
+}
+
+static int reclaim_async_release(struct inode *inode, struct file *file)
+{
+	struct reclaim_client *client = file->private_data;
+	struct reclaim_req *req, *next;
+	LIST_HEAD(queued);
+	LIST_HEAD(done);
+
+	spin_lock(&reclaim_queue_lock);
+	client->closed = true;
+	list_for_each_entry_safe(req, next, &reclaim_queue, list) {
+		if (req->client == client)
+			list_move(&req->list, &queued);
+	}
+	list_splice_init(&client->done, &done);
+	spin_unlock(&reclaim_queue_lock);
+
+	list_for_each_entry_safe(req, next, &queued, list)
+		reclaim_req_put(req);
+	list_for_each_entry_safe(req, next, &done, list)
+		reclaim_req_free(req);
+
+	/* a running request drops the last reference when it finishes */
+	kref_put(&client->kref, reclaim_client_free);
+
+	return 0;
+}
+
+/* Parses "<pid> <type>" in @line into a new request */
+static struct reclaim_req *reclaim_req_create(char *line)
+{
+	struct task_struct *task;
+	struct reclaim_req *req;
+	char *token;
+	pid_t nr;
+	int err;
+
+	token = strsep(&line, " ");
+	if (!line || kstrtoint(token, 10, &nr) || nr <= 0)
+		return ERR_PTR(-EINVAL);
+
+	req = kzalloc(sizeof(*req), GFP_KERNEL);
+	if (!req)
+		return ERR_PTR(-ENOMEM);
+
+	err = reclaim_parse(skip_spaces(line), &req->type, &req->start,
+			    &req->end);
+	if (err)
+		goto free;
+
+	err = -ESRCH;
+	req->pid = find_get_pid(nr);
+	task = get_pid_task(req->pid, PIDTYPE_PID);
+	if (!task)
+		goto free;
+
+	/* the same permission as for opening /proc/<pid>/mem */
+	if (!ptrace_may_access(task, PTRACE_MODE_ATTACH_FSCREDS))
+		err = -EPERM;
+	else
+		err = 0;
+	put_task_struct(task);
+	if (err)
+		goto free;
+
+	return req;
+
+free:
+	reclaim_req_free(req);
+	return ERR_PTR(err);
+}
+
+static ssize_t reclaim_async_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct reclaim_client *client = file->private_data;
+	struct reclaim_req *req, *next;
+	char *buffer, *pos, *line;
+	size_t consumed = 0;
+	LIST_HEAD(reqs);
+	int err = 0;
+
+	buffer = memdup_user_nul(buf, min_t(size_t, count, PAGE_SIZE - 1));
+	if (IS_ERR(buffer))
+		return PTR_ERR(buffer);
+
+	pos = buffer;
+	while ((line = strsep(&pos, "\n"))) {
+		size_t len = strlen(line) + !!pos;
+
+		/* a line cut by the size limit is left to the next write */
+		if (!pos && count >= PAGE_SIZE && consumed)
+			break;
+
+		line = strstrip(line);
+		if (*line) {
+			req = reclaim_req_create(line);
+			if (IS_ERR(req)) {
+				err = PTR_ERR(req);
+				break;
+			}
+			list_add_tail(&req->list, &reqs);
 		}
+		consumed += len;
 	}
+	kfree(buffer);
 
-	flush_tlb_mm(mm);
+	/*
+	 * The lines before a rejected one are queued, the next write starts
+	 * with it and fails.
+	 */
+	if (list_empty(&reqs))
+		return err ? : consumed;
+
+	spin_lock(&reclaim_queue_lock);
+	list_for_each_entry_safe(req, next, &reqs, list) {
+		req->client = client;
+		kref_get(&client->kref);
+		list_move_tail(&req->list, &reclaim_queue);
+	}
+	spin_unlock(&reclaim_queue_lock);
+	wake_up(&reclaim_queue_wait);
+
+	return consumed;
+}
+
+static ssize_t reclaim_async_read(struct file *file, char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct reclaim_client *client = file->private_data;
+	struct reclaim_req *req;
+	ssize_t copied = 0;
+	char line[80];
+	int len;
+
+	if (!(file->f_flags & O_NONBLOCK) &&
+	    wait_event_interruptible(client->wait,
+				     !list_empty_careful(&client->done)))
+		return -ERESTARTSYS;
+
+	for (;;) {
+		spin_lock(&reclaim_queue_lock);
+		req = list_first_entry_or_null(&client->done,
+					       struct reclaim_req, list);
+		if (req) {
+			len = scnprintf(line, sizeof(line), "%d %s %d %d %d\n",
+					pid_vnr(req->pid),
+					reclaim_type_names[req->type],
+					req->rp.nr_scanned,
+					req->rp.nr_reclaimed, req->err);
+			if (len <= count - copied)
+				list_del(&req->list);
+			else
+				req = NULL;
+		}
+		spin_unlock(&reclaim_queue_lock);
+
+		if (!req)
+			break;
+
+		if (copy_to_user(buf + copied, line, len)) {
+			spin_lock(&reclaim_queue_lock);
+			list_add(&req->list, &client->done);
+			spin_unlock(&reclaim_queue_lock);
+			return copied ? : -EFAULT;
+		}
+		copied += len;
+		reclaim_req_free(req);
+	}
+
+	if (copied)
+		return copied;
+
+	return list_empty_careful(&client->done) ? -EAGAIN : -EINVAL;
+}
+
+static __poll_t reclaim_async_poll(struct file *file, poll_table *wait)
+{
+	struct reclaim_client *client = file->private_data;
+	__poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+	poll_wait(file, &client->wait, wait);
+	if (!list_empty_careful(&client->done))
+		mask |= EPOLLIN | EPOLLRDNORM;
+
+	return mask;
+}
+
+static const struct file_operations proc_reclaim_async_operations = {
+	.open		= reclaim_async_open,
+	.release	= reclaim_async_release,
+	.write		= reclaim_async_write,
+	.read		= reclaim_async_read,
+	.poll		= reclaim_async_poll,
+	.llseek		= no_llseek,
+};
+
+static int __init proc_reclaim_async_init(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(reclaim_async_thread, NULL, "proc_reclaimd");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	proc_create("reclaim", 0600, NULL, &proc_reclaim_async_operations);
+	return 0;
+}
+fs_initcall(proc_reclaim_async_init);
+#endif
+
+#ifdef CONFIG_LRU_GEN
+/*
+ * Working set of a process on the multi-gen LRU: its mapped pages per
+ * generation, counted from the youngest one of their lruvecs, and per idle
+ * age, in power of two seconds.
+ */
+#define LRU_GEN_IDLE_BINS	8
+
+struct lru_gen_ws {
+	unsigned long gens[MAX_NR_GENS][ANON_AND_FILE];
+	unsigned long bins[LRU_GEN_IDLE_BINS][ANON_AND_FILE];
+	unsigned long unevictable[ANON_AND_FILE];
+};
+
+static void lru_gen_ws_account(struct lru_gen_ws *ws, struct page *page,
+			       unsigned long nr)
+{
+	int age, bin;
+	unsigned long idle;
+	int type = page_is_file_cache(page);
+
+	age = lru_gen_page_age(page, &idle);
+	if (age < 0) {
+		ws->unevictable[type] += nr;
+		return;
+	}
+
+	idle = jiffies_to_msecs(idle) / MSEC_PER_SEC;
+	bin = min_t(int, fls_long(idle), LRU_GEN_IDLE_BINS - 1);
+
+	ws->gens[age][type] += nr;
+	ws->bins[bin][type] += nr;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static void lru_gen_ws_pmd_entry(pmd_t *pmd, unsigned long addr,
+				 struct mm_walk *walk)
+{
+	struct page *page;
+
+	/* FOLL_DUMP will return -EFAULT on huge zero page */
+	page = follow_trans_huge_pmd(walk->vma, addr, pmd, FOLL_DUMP);
+	if (!IS_ERR_OR_NULL(page) && !is_zone_device_page(page))
+		lru_gen_ws_account(walk->private, page, HPAGE_PMD_NR);
+}
+#else
+static void lru_gen_ws_pmd_entry(pmd_t *pmd, unsigned long addr,
+				 struct mm_walk *walk)
+{
+}
+#endif
+
+static int lru_gen_ws_pte_range(pmd_t *pmd, unsigned long addr,
+				unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_ws *ws = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *orig_pte, *pte;
+
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		if (pmd_present(*pmd))
+			lru_gen_ws_pmd_entry(pmd, addr, walk);
+		spin_unlock(ptl);
+		goto out;
+	}
+
+	if (pmd_trans_unstable(pmd))
+		goto out;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		if (!pte_present(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || is_zone_device_page(page))
+			continue;
+
+		lru_gen_ws_account(ws, compound_head(page), 1);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+out:
+	cond_resched();
+	return 0;
+}
+
+static int lru_gen_ws_show(struct seq_file *m, void *v)
+{
+	struct mm_struct *mm = m->private;
+	struct vm_area_struct *vma;
+	struct lru_gen_ws *ws;
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_ws_pte_range,
+		.mm = mm,
+	};
+	int i, ret;
+
+	if (!mm || !mmget_not_zero(mm))
+		return -ESRCH;
+
+	ws = kzalloc(sizeof(*ws), GFP_KERNEL);
+	if (!ws) {
+		ret = -ENOMEM;
+		goto out_put_mm;
+	}
+	walk.private = ws;
+
+	ret = down_read_killable(&mm->mmap_sem);
+	if (ret)
+		goto out_free;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (is_vm_hugetlb_page(vma) || (vma->vm_flags & VM_PFNMAP))
+			continue;
+
+		walk_page_vma(vma, &walk);
+	}
 	up_read(&mm->mmap_sem);
+
+	seq_printf(m, "%-8s %10s %10s\n", "gen", "anon", "file");
+	for (i = 0; i < MAX_NR_GENS; i++)
+		seq_printf(m, "%-8d %10lu %10lu\n", i,
+			   ws->gens[i][LRU_GEN_ANON], ws->gens[i][LRU_GEN_FILE]);
+	seq_printf(m, "%-8s %10lu %10lu\n", "none",
+		   ws->unevictable[LRU_GEN_ANON],
+		   ws->unevictable[LRU_GEN_FILE]);
+
+	seq_printf(m, "\n%-8s %10s %10s\n", "idle_s", "anon", "file");
+	for (i = 0; i < LRU_GEN_IDLE_BINS; i++)
+		seq_printf(m, "%-8lu %10lu %10lu\n", i ? 1UL << (i - 1) : 0,
+			   ws->bins[i][LRU_GEN_ANON], ws->bins[i][LRU_GEN_FILE]);
+
+out_free:
+	kfree(ws);
+out_put_mm:
 	mmput(mm);
-out:
-	put_task_struct(task);
-	return count;
+	return ret;
+}
+
+static int lru_gen_ws_open(struct inode *inode, struct file *file)
+{
+	struct mm_struct *mm = proc_mem_open(inode, PTRACE_MODE_READ);
+	int ret;
 
-out_err:
-	return -EINVAL;
+	if (IS_ERR(mm))
+		return PTR_ERR(mm);
+
+	ret = single_open(file, lru_gen_ws_show, mm);
+	if (ret && mm)
+		mmdrop(mm);
+
+	return ret;
 }
 
-const struct file_operations proc_reclaim_operations = {
-	.write		= reclaim_write,
-	.llseek		= noop_llseek,
+static int lru_gen_ws_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq = file->private_data;
+	struct mm_struct *mm = seq->private;
+
+	if (mm)
+		mmdrop(mm);
+
+	return single_release(inode, file);
+}
+
+const struct file_operations proc_pid_lru_gen_operations = {
+	.open		= lru_gen_ws_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= lru_gen_ws_release,
 };
 #endif
 
@@ -112,6 +112,8 @@ static int sdcardfs_d_revalidate(struct dentry *dentry, unsigned int flags)
 		}
 		if (data)
 			data_put(data);
+		if (err)
+			revalidate_derived_permission(parent_dentry, dentry);
 		iput(inode);
 	}
 
@@ -75,6 +75,7 @@ void get_derived_permission_new(struct dentry *parent, struct dentry *dentry,
 	 * of using the inode permissions.
 	 */
 
+	info->data->packagelist_gen = packagelist_generation();
 	inherit_derived_state(d_inode(parent), d_inode(dentry));
 
 	/* Files don't get special labels */
@@ -266,67 +267,64 @@ void fixup_lower_ownership(struct dentry *dentry, const char *name)
 	sdcardfs_put_lower_path(dentry, &path);
 }
 
-static int descendant_may_need_fixup(struct sdcardfs_inode_data *data,
-		struct limit_search *limit)
+/*
+ * Package directories derive their owner from the package list. Instead of
+ * walking the dcache on every package list change, recompute the state of a
+ * package directory when it is revalidated after such a change. Everything
+ * below it inherits from it through top_data.
+ */
+void revalidate_derived_permission(struct dentry *parent, struct dentry *dentry)
 {
-	if (data->perm == PERM_ROOT)
-		return (limit->flags & BY_USERID) ?
-				data->userid == limit->userid : 1;
-	if (data->perm == PERM_PRE_ROOT || data->perm == PERM_ANDROID)
-		return 1;
-	return 0;
-}
+	struct sdcardfs_inode_data *data = SDCARDFS_I(d_inode(dentry))->data;
 
-static int needs_fixup(perm_t perm)
-{
-	if (perm == PERM_ANDROID_DATA || perm == PERM_ANDROID_OBB
-			|| perm == PERM_ANDROID_MEDIA)
-		return 1;
-	return 0;
+	if (data->perm != PERM_ANDROID_PACKAGE ||
+			READ_ONCE(data->packagelist_gen) == packagelist_generation())
+		return;
+
+	get_derived_permission(parent, dentry);
+	fixup_tmp_permissions(d_inode(dentry));
 }
 
-static void __fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit, int depth)
+/*
+ * Revalidation only reaches the package directory itself. Permission checks
+ * and attributes of inodes below it go through here, which walks up to the
+ * package directory when its state is behind the package list. Returns
+ * -ECHILD if that is needed under RCU walk.
+ */
+int revalidate_top_permission(struct inode *inode, bool rcu)
 {
-	struct dentry *child;
-	struct sdcardfs_inode_info *info;
+	struct sdcardfs_inode_data *top = top_data_get(SDCARDFS_I(inode));
+	struct dentry *dentry;
+	struct dentry *parent;
+	int err = 0;
 
-	/*
-	 * All paths will terminate their recursion on hitting PERM_ANDROID_OBB,
-	 * PERM_ANDROID_MEDIA, or PERM_ANDROID_DATA. This happens at a depth of
-	 * at most 3.
-	 */
-	WARN(depth > 3, "%s: Max expected depth exceeded!\n", __func__);
-	spin_lock_nested(&dentry->d_lock, depth);
-	if (!d_inode(dentry)) {
-		spin_unlock(&dentry->d_lock);
-		return;
+	if (!top)
+		return 0;
+	if (top->perm != PERM_ANDROID_PACKAGE ||
+			READ_ONCE(top->packagelist_gen) == packagelist_generation())
+		goto out;
+	if (rcu) {
+		err = -ECHILD;
+		goto out;
 	}
-	info = SDCARDFS_I(d_inode(dentry));
 
-	if (needs_fixup(info->data->perm)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			spin_lock_nested(&child->d_lock, depth + 1);
-			if (!(limit->flags & BY_NAME) || qstr_case_eq(&child->d_name, &limit->name)) {
-				if (d_inode(child)) {
-					get_derived_permission(dentry, child);
-					fixup_tmp_permissions(d_inode(child));
-					spin_unlock(&child->d_lock);
-					break;
-				}
-			}
-			spin_unlock(&child->d_lock);
-		}
-	} else if (descendant_may_need_fixup(info->data, limit)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			__fixup_perms_recursive(child, limit, depth + 1);
+	dentry = d_find_alias(inode);
+	if (!dentry)
+		goto out;
+	while (!IS_ROOT(dentry)) {
+		parent = dget_parent(dentry);
+		if (SDCARDFS_I(d_inode(dentry))->data == top) {
+			revalidate_derived_permission(parent, dentry);
+			dput(parent);
+			break;
 		}
+		dput(dentry);
+		dentry = parent;
 	}
-	spin_unlock(&dentry->d_lock);
-}
-
-void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit)
-{
-	__fixup_perms_recursive(dentry, limit, 0);
+	dput(dentry);
+out:
+	data_put(top);
+	return err;
 }
 
 /* main function for updating derived permission */
@@ -560,11 +560,16 @@ static int sdcardfs_permission(struct vfsmount *mnt, struct inode *inode, int ma
 {
 	int err;
 	struct inode tmp;
-	struct sdcardfs_inode_data *top = top_data_get(SDCARDFS_I(inode));
+	struct sdcardfs_inode_data *top;
 
 	if (IS_ERR(mnt))
 		return PTR_ERR(mnt);
 
+	err = revalidate_top_permission(inode, mask & MAY_NOT_BLOCK);
+	if (err)
+		return err;
+
+	top = top_data_get(SDCARDFS_I(inode));
 	if (!top)
 		return -EINVAL;
 
@@ -615,6 +620,7 @@ static int sdcardfs_setattr(struct vfsmount *mnt, struct dentry *dentry, struct
 	const struct cred *saved_cred = NULL;
 
 	inode = d_inode(dentry);
+	revalidate_top_permission(inode, false);
 	top = top_data_get(SDCARDFS_I(inode));
 
 	if (!top)
@@ -783,6 +789,7 @@ static int sdcardfs_getattr(const struct path *path, struct kstat *stat,
 		goto out;
 	sdcardfs_copy_and_fix_attrs(d_inode(dentry),
 			      d_inode(lower_path.dentry));
+	revalidate_top_permission(d_inode(dentry), false);
 	err = sdcardfs_fillattr(mnt, d_inode(dentry), &lower_stat, stat);
 out:
 	sdcardfs_put_lower_path(dentry, &lower_path);
@@ -19,7 +19,8 @@
  */
 
 #include "sdcardfs.h"
-#include <linux/hashtable.h>
+#include <linux/rhashtable.h>
+#include <linux/jhash.h>
 #include <linux/ctype.h>
 #include <linux/delay.h>
 #include <linux/radix-tree.h>
@@ -32,16 +33,26 @@
 #include <linux/configfs.h>
 
 struct hashtable_entry {
-	struct hlist_node hlist;
+	struct rhlist_head node;
 	struct hlist_node dlist; /* for deletion cleanup */
 	struct qstr key;
 	atomic_t value;
 };
 
-static DEFINE_HASHTABLE(package_to_appid, 8);
-static DEFINE_HASHTABLE(package_to_userid, 8);
-static DEFINE_HASHTABLE(ext_to_groupid, 8);
+/*
+ * Lookups are lock-free under RCU and the tables resize with the number of
+ * packages. Updates are serialized by sdcardfs_super_list_lock.
+ */
+static struct rhashtable package_to_appid;
+static struct rhltable package_to_userid;	/* one entry per excluded user */
+static struct rhashtable ext_to_groupid;
 
+/*
+ * Bumped after every change that may alter the permissions derived for a
+ * package directory. Directories derived against an older generation are
+ * recomputed the next time they are revalidated.
+ */
+static atomic_t packagelist_gen = ATOMIC_INIT(0);
 
 static struct kmem_cache *hashtable_entry_cachep;
 
@@ -68,23 +79,65 @@ static inline int qstr_copy(const struct qstr *src, struct qstr *dest)
 	return !!dest->name;
 }
 
+/* keys are qstrs, whose hash is already case insensitive */
+static u32 hashtable_key_hash(const void *data, u32 len, u32 seed)
+{
+	const struct qstr *key = data;
+
+	return jhash_1word(key->hash, seed);
+}
+
+static u32 hashtable_entry_hash(const void *data, u32 len, u32 seed)
+{
+	const struct hashtable_entry *entry = data;
+
+	return hashtable_key_hash(&entry->key, len, seed);
+}
+
+static int hashtable_entry_cmp(struct rhashtable_compare_arg *arg,
+			       const void *obj)
+{
+	const struct hashtable_entry *entry = obj;
+
+	return !qstr_case_eq(arg->key, &entry->key);
+}
+
+static const struct rhashtable_params hashtable_params = {
+	.head_offset = offsetof(struct hashtable_entry, node),
+	.key_offset = offsetof(struct hashtable_entry, key),
+	.hashfn = hashtable_key_hash,
+	.obj_hashfn = hashtable_entry_hash,
+	.obj_cmpfn = hashtable_entry_cmp,
+	.automatic_shrinking = true,
+};
+
+unsigned int packagelist_generation(void)
+{
+	unsigned int gen = atomic_read(&packagelist_gen);
+
+	/* Pairs with the barrier in packagelist_changed() */
+	smp_rmb();
+	return gen;
+}
+
+static void packagelist_changed(void)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&packagelist_gen);
+}
+
 
 static appid_t __get_appid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	appid_t ret_id;
+	appid_t ret_id = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return ret_id;
-		}
-	}
+	hash_cur = rhashtable_lookup(&package_to_appid, key, hashtable_params);
+	if (hash_cur)
+		ret_id = atomic_read(&hash_cur->value);
 	rcu_read_unlock();
-	return 0;
+	return ret_id;
 }
 
 appid_t get_appid(const char *key)
@@ -98,19 +151,14 @@ appid_t get_appid(const char *key)
 static appid_t __get_ext_gid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	appid_t ret_id;
+	appid_t ret_id = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return ret_id;
-		}
-	}
+	hash_cur = rhashtable_lookup(&ext_to_groupid, key, hashtable_params);
+	if (hash_cur)
+		ret_id = atomic_read(&hash_cur->value);
 	rcu_read_unlock();
-	return 0;
+	return ret_id;
 }
 
 appid_t get_ext_gid(const char *key)
@@ -124,12 +172,12 @@ appid_t get_ext_gid(const char *key)
 static appid_t __is_excluded(const struct qstr *app_name, userid_t user)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = app_name->hash;
+	struct rhlist_head *list, *pos;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == user &&
-				qstr_case_eq(app_name, &hash_cur->key)) {
+	list = rhltable_lookup(&package_to_userid, app_name, hashtable_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, node) {
+		if (atomic_read(&hash_cur->value) == user) {
 			rcu_read_unlock();
 			return 1;
 		}
@@ -182,7 +230,6 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	if (!ret)
 		return NULL;
 	INIT_HLIST_NODE(&ret->dlist);
-	INIT_HLIST_NODE(&ret->hlist);
 
 	if (!qstr_copy(key, &ret->key)) {
 		kmem_cache_free(hashtable_entry_cachep, ret);
@@ -193,100 +240,68 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	return ret;
 }
 
+static void free_hashtable_entry(struct hashtable_entry *entry)
+{
+	kfree(entry->key.name);
+	kmem_cache_free(hashtable_entry_cachep, entry);
+}
+
 static int insert_packagelist_appid_entry_locked(const struct qstr *key, appid_t value)
 {
 	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			atomic_set(&hash_cur->value, value);
-			return 0;
-		}
+	hash_cur = rhashtable_lookup_fast(&package_to_appid, key,
+					  hashtable_params);
+	if (hash_cur) {
+		atomic_set(&hash_cur->value, value);
+		return 0;
 	}
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_appid, &new_entry->hlist, hash);
-	return 0;
+	err = rhashtable_insert_fast(&package_to_appid, &new_entry->node.rhead,
+				     hashtable_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
 }
 
 static int insert_ext_gid_entry_locked(const struct qstr *key, appid_t value)
 {
-	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
 	/* An extension can only belong to one gid */
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key))
-			return -EINVAL;
-	}
+	if (rhashtable_lookup_fast(&ext_to_groupid, key, hashtable_params))
+		return -EINVAL;
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(ext_to_groupid, &new_entry->hlist, hash);
-	return 0;
+	err = rhashtable_insert_fast(&ext_to_groupid, &new_entry->node.rhead,
+				     hashtable_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
 }
 
 static int insert_userid_exclude_entry_locked(const struct qstr *key, userid_t value)
 {
-	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
 	/* Only insert if not already present */
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == value &&
-				qstr_case_eq(key, &hash_cur->key))
-			return 0;
-	}
+	if (__is_excluded(key, value))
+		return 0;
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_userid, &new_entry->hlist, hash);
-	return 0;
-}
-
-static void fixup_all_perms_name(const struct qstr *key)
-{
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_NAME,
-		.name = QSTR_INIT(key->name, key->len),
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
-}
-
-static void fixup_all_perms_name_userid(const struct qstr *key, userid_t userid)
-{
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_NAME | BY_USERID,
-		.name = QSTR_INIT(key->name, key->len),
-		.userid = userid,
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
-}
-
-static void fixup_all_perms_userid(userid_t userid)
-{
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_USERID,
-		.userid = userid,
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
+	err = rhltable_insert(&package_to_userid, &new_entry->node,
+			      hashtable_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
 }
 
 static int insert_packagelist_entry(const struct qstr *key, appid_t value)
@@ -296,7 +311,7 @@ static int insert_packagelist_entry(const struct qstr *key, appid_t value)
 	mutex_lock(&sdcardfs_super_list_lock);
 	err = insert_packagelist_appid_entry_locked(key, value);
 	if (!err)
-		fixup_all_perms_name(key);
+		packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 
 	return err;
@@ -320,64 +335,72 @@ static int insert_userid_exclude_entry(const struct qstr *key, userid_t value)
 	mutex_lock(&sdcardfs_super_list_lock);
 	err = insert_userid_exclude_entry_locked(key, value);
 	if (!err)
-		fixup_all_perms_name_userid(key, value);
+		packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 
 	return err;
 }
 
-static void free_hashtable_entry(struct hashtable_entry *entry)
+/* Unlink every entry of the list and free them after a grace period */
+static void remove_entries_locked(struct rhashtable *ht,
+				  struct hlist_head *free_list)
 {
-	kfree(entry->key.name);
-	kmem_cache_free(hashtable_entry_cachep, entry);
+	struct hashtable_entry *hash_cur;
+	struct hlist_node *h_t;
+
+	hlist_for_each_entry(hash_cur, free_list, dlist) {
+		if (ht->rhlist)
+			rhltable_remove(container_of(ht, struct rhltable, ht),
+					&hash_cur->node, hashtable_params);
+		else
+			rhashtable_remove_fast(ht, &hash_cur->node.rhead,
+					       hashtable_params);
+	}
+	synchronize_rcu();
+	hlist_for_each_entry_safe(hash_cur, h_t, free_list, dlist)
+		free_hashtable_entry(hash_cur);
 }
 
 static void remove_packagelist_entry_locked(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	struct hlist_node *h_t;
+	struct rhlist_head *list, *pos;
 	HLIST_HEAD(free_list);
+	HLIST_HEAD(free_user_list);
 
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-		}
-	}
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-			break;
-		}
-	}
-	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
-		free_hashtable_entry(hash_cur);
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key, hashtable_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, node)
+		hlist_add_head(&hash_cur->dlist, &free_user_list);
+	hash_cur = rhashtable_lookup(&package_to_appid, key, hashtable_params);
+	if (hash_cur)
+		hlist_add_head(&hash_cur->dlist, &free_list);
+	rcu_read_unlock();
+
+	remove_entries_locked(&package_to_userid.ht, &free_user_list);
+	remove_entries_locked(&package_to_appid, &free_list);
 }
 
 static void remove_packagelist_entry(const struct qstr *key)
 {
 	mutex_lock(&sdcardfs_super_list_lock);
 	remove_packagelist_entry_locked(key);
-	fixup_all_perms_name(key);
+	packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
 static void remove_ext_gid_entry_locked(const struct qstr *key, gid_t group)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
+	HLIST_HEAD(free_list);
 
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) && atomic_read(&hash_cur->value) == group) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			free_hashtable_entry(hash_cur);
-			break;
-		}
-	}
+	rcu_read_lock();
+	hash_cur = rhashtable_lookup(&ext_to_groupid, key, hashtable_params);
+	if (hash_cur && atomic_read(&hash_cur->value) == group)
+		hlist_add_head(&hash_cur->dlist, &free_list);
+	rcu_read_unlock();
+
+	remove_entries_locked(&ext_to_groupid, &free_list);
 }
 
 static void remove_ext_gid_entry(const struct qstr *key, gid_t group)
@@ -387,76 +410,85 @@ static void remove_ext_gid_entry(const struct qstr *key, gid_t group)
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
-static void remove_userid_all_entry_locked(userid_t userid)
+/*
+ * Collect the entries of ht matching userid. A resize restarts the walk, so
+ * entries may be seen twice: those already on the list are skipped.
+ */
+static void collect_entries_locked(struct rhashtable *ht, userid_t userid,
+				   struct hlist_head *free_list)
 {
+	struct rhashtable_iter iter;
 	struct hashtable_entry *hash_cur;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-	int i;
 
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		if (atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-		}
-	}
-	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist) {
-		free_hashtable_entry(hash_cur);
+	rhashtable_walk_enter(ht, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur))
+			continue;
+		if (atomic_read(&hash_cur->value) == userid &&
+				hlist_unhashed(&hash_cur->dlist))
+			hlist_add_head(&hash_cur->dlist, free_list);
 	}
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
+}
+
+static void remove_userid_all_entry_locked(userid_t userid)
+{
+	HLIST_HEAD(free_list);
+
+	collect_entries_locked(&package_to_userid.ht, userid, &free_list);
+	remove_entries_locked(&package_to_userid.ht, &free_list);
 }
 
 static void remove_userid_all_entry(userid_t userid)
 {
 	mutex_lock(&sdcardfs_super_list_lock);
 	remove_userid_all_entry_locked(userid);
-	fixup_all_perms_userid(userid);
+	packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
 static void remove_userid_exclude_entry_locked(const struct qstr *key, userid_t userid)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) &&
-				atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			free_hashtable_entry(hash_cur);
+	struct rhlist_head *list, *pos;
+	HLIST_HEAD(free_list);
+
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key, hashtable_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, node) {
+		if (atomic_read(&hash_cur->value) == userid) {
+			hlist_add_head(&hash_cur->dlist, &free_list);
 			break;
 		}
 	}
+	rcu_read_unlock();
+
+	remove_entries_locked(&package_to_userid.ht, &free_list);
 }
 
 static void remove_userid_exclude_entry(const struct qstr *key, userid_t userid)
 {
 	mutex_lock(&sdcardfs_super_list_lock);
 	remove_userid_exclude_entry_locked(key, userid);
-	fixup_all_perms_name_userid(key, userid);
+	packagelist_changed();
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
-static void packagelist_destroy(void)
+static void free_hashtable_entry_fn(void *ptr, void *arg)
 {
-	struct hashtable_entry *hash_cur;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-	int i;
+	free_hashtable_entry(ptr);
+}
 
+/* Nothing can look the tables up anymore, free the entries right away */
+static void packagelist_destroy(void)
+{
 	mutex_lock(&sdcardfs_super_list_lock);
-	hash_for_each_rcu(package_to_appid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
-	}
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
-	}
-	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
-		free_hashtable_entry(hash_cur);
+	rhashtable_free_and_destroy(&package_to_appid, free_hashtable_entry_fn,
+				    NULL);
+	rhltable_free_and_destroy(&package_to_userid, free_hashtable_entry_fn,
+				  NULL);
 	mutex_unlock(&sdcardfs_super_list_lock);
 	pr_info("sdcardfs: destroyed packagelist pkgld\n");
 }
@@ -524,15 +556,15 @@ static ssize_t package_details_excluded_userids_show(struct config_item *item,
 {
 	struct package_details *package_details = to_package_details(item);
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = package_details->name.hash;
+	struct rhlist_head *list, *pos;
 	int count = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(&package_details->name, &hash_cur->key))
-			count += scnprintf(page + count, PAGE_SIZE - count,
-					"%d ", atomic_read(&hash_cur->value));
-	}
+	list = rhltable_lookup(&package_to_userid, &package_details->name,
+			       hashtable_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, node)
+		count += scnprintf(page + count, PAGE_SIZE - count,
+				"%d ", atomic_read(&hash_cur->value));
 	rcu_read_unlock();
 	if (count)
 		count--;
@@ -751,22 +783,28 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 {
 	struct hashtable_entry *hash_cur_app;
 	struct hashtable_entry *hash_cur_user;
-	int i;
+	struct rhashtable_iter iter;
+	struct rhlist_head *list, *pos;
 	int count = 0, written = 0;
 	const char errormsg[] = "<truncated>\n";
-	unsigned int hash;
 
-	rcu_read_lock();
-	hash_for_each_rcu(package_to_appid, i, hash_cur_app, hlist) {
+	rhashtable_walk_enter(&package_to_appid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur_app = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur_app)) {
+			/* A resize restarted the walk, start over */
+			if (PTR_ERR(hash_cur_app) == -EAGAIN)
+				count = 0;
+			continue;
+		}
 		written = scnprintf(page + count, PAGE_SIZE - sizeof(errormsg) - count, "%s %d\n",
 					hash_cur_app->key.name, atomic_read(&hash_cur_app->value));
-		hash = hash_cur_app->key.hash;
-		hash_for_each_possible_rcu(package_to_userid, hash_cur_user, hlist, hash) {
-			if (qstr_case_eq(&hash_cur_app->key, &hash_cur_user->key)) {
-				written += scnprintf(page + count + written - 1,
-					PAGE_SIZE - sizeof(errormsg) - count - written + 1,
-					" %d\n", atomic_read(&hash_cur_user->value)) - 1;
-			}
+		list = rhltable_lookup(&package_to_userid, &hash_cur_app->key,
+				       hashtable_params);
+		rhl_for_each_entry_rcu(hash_cur_user, pos, list, node) {
+			written += scnprintf(page + count + written - 1,
+				PAGE_SIZE - sizeof(errormsg) - count - written + 1,
+				" %d\n", atomic_read(&hash_cur_user->value)) - 1;
 		}
 		if (count + written == PAGE_SIZE - sizeof(errormsg) - 1) {
 			count += scnprintf(page + count, PAGE_SIZE - count, errormsg);
@@ -774,7 +812,8 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 		}
 		count += written;
 	}
-	rcu_read_unlock();
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
 
 	return count;
 }
@@ -862,6 +901,8 @@ static void configfs_sdcardfs_exit(void)
 
 int packagelist_init(void)
 {
+	int err;
+
 	hashtable_entry_cachep =
 		kmem_cache_create("packagelist_hashtable_entry",
 					sizeof(struct hashtable_entry), 0, 0, NULL);
@@ -870,13 +911,34 @@ int packagelist_init(void)
 		return -ENOMEM;
 	}
 
+	err = rhashtable_init(&package_to_appid, &hashtable_params);
+	if (err)
+		goto out_cache;
+	err = rhltable_init(&package_to_userid, &hashtable_params);
+	if (err)
+		goto out_appid;
+	err = rhashtable_init(&ext_to_groupid, &hashtable_params);
+	if (err)
+		goto out_userid;
+
 	configfs_sdcardfs_init();
 	return 0;
+
+out_userid:
+	rhltable_destroy(&package_to_userid);
+out_appid:
+	rhashtable_destroy(&package_to_appid);
+out_cache:
+	pr_err("sdcardfs: failed creating packagelist hashtables\n");
+	kmem_cache_destroy(hashtable_entry_cachep);
+	return err;
 }
 
 void packagelist_exit(void)
 {
 	configfs_sdcardfs_exit();
 	packagelist_destroy();
+	rhashtable_free_and_destroy(&ext_to_groupid, free_hashtable_entry_fn,
+				    NULL);
 	kmem_cache_destroy(hashtable_entry_cachep);
 }
@@ -167,6 +167,8 @@ struct sdcardfs_inode_data {
 	perm_t perm;
 	userid_t userid;
 	uid_t d_uid;
+	/* package list generation this state was derived against */
+	unsigned int packagelist_gen;
 	bool under_android;
 	bool under_cache;
 	bool under_obb;
@@ -497,21 +499,15 @@ extern appid_t is_excluded(const char *app_name, userid_t userid);
 extern int check_caller_access_to_name(struct inode *parent_node, const struct qstr *name);
 extern int packagelist_init(void);
 extern void packagelist_exit(void);
+extern unsigned int packagelist_generation(void);
 
 /* for derived_perm.c */
-#define BY_NAME		(1 << 0)
-#define BY_USERID	(1 << 1)
-struct limit_search {
-	unsigned int flags;
-	struct qstr name;
-	userid_t userid;
-};
-
 extern void setup_derived_state(struct inode *inode, perm_t perm,
 			userid_t userid, uid_t uid);
 extern void get_derived_permission(struct dentry *parent, struct dentry *dentry);
 extern void get_derived_permission_new(struct dentry *parent, struct dentry *dentry, const struct qstr *name);
-extern void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit);
+extern void revalidate_derived_permission(struct dentry *parent, struct dentry *dentry);
+extern int revalidate_top_permission(struct inode *inode, bool rcu);
 
 extern void update_derived_permission_lock(struct dentry *dentry);
 void fixup_lower_ownership(struct dentry *dentry, const char *name);
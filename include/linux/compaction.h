@@ -91,8 +91,17 @@ extern int sysctl_extfrag_threshold;
 extern int sysctl_extfrag_handler(struct ctl_table *table, int write,
 			void __user *buffer, size_t *length, loff_t *ppos);
 extern int sysctl_compact_unevictable_allowed;
+extern int sysctl_compaction_proactiveness;
+extern int sysctl_compaction_proactive_budget_ms;
+extern int compaction_proactiveness_sysctl_handler(struct ctl_table *table,
+		int write, void __user *buffer, size_t *length, loff_t *ppos);
+
+/* The order proactive compaction keeps free pages available at */
+#define COMPACTION_PROACTIVE_ORDER	pageblock_order
 
 extern int fragmentation_index(struct zone *zone, unsigned int order);
+extern unsigned int extfrag_for_order(struct zone *zone, unsigned int order);
+extern unsigned int fragmentation_score_zone(struct zone *zone);
 extern enum compact_result try_to_compact_pages(gfp_t gfp_mask,
 		unsigned int order, unsigned int alloc_flags,
 		const struct alloc_context *ac, enum compact_priority prio,
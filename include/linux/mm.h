@@ -2363,6 +2363,7 @@ extern void memmap_init_zone(unsigned long, int, unsigned long, unsigned long,
 		enum meminit_context, struct vmem_altmap *);
 extern void setup_per_zone_wmarks(void);
 extern void update_kswapd_threads(void);
+extern void kswapd_scale_update(void);
 extern int __meminit init_per_zone_wmark_min(void);
 extern void mem_init(void);
 extern void __init mmap_init(void);
@@ -2384,6 +2385,7 @@ extern void zone_pcp_reset(struct zone *zone);
 
 /* page_alloc.c */
 extern int kswapd_threads;
+extern int kswapd_threads_max;
 extern int min_free_kbytes;
 extern int watermark_boost_factor;
 extern int watermark_scale_factor;
@@ -3068,6 +3070,8 @@ struct reclaim_param {
 	int nr_to_reclaim;
 	/* pages reclaimed */
 	int nr_reclaimed;
+	/* where a pte range was left unfinished for lack of budget, or 0 */
+	unsigned long stop_addr;
 };
 extern struct reclaim_param reclaim_task_anon(struct task_struct *task,
 		int nr_to_reclaim);
@@ -3077,6 +3081,8 @@ extern int reclaim_address_space(struct address_space *mapping,
 		struct reclaim_param *rp);
 extern int proc_reclaim_notifier_register(struct notifier_block *nb);
 extern int proc_reclaim_notifier_unregister(struct notifier_block *nb);
+/* pages per second reclaimed through /proc/reclaim, 0 for no limit */
+extern int sysctl_process_reclaim_rate;
 #endif
 
 #endif /* __KERNEL__ */
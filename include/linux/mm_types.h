@@ -332,6 +332,8 @@ struct vm_area_struct {
 	void * vm_private_data;		/* was vm_pte (shared mem) */
 
 	atomic_long_t swap_readahead_info;
+	/* Swapin readahead hit ratio, see swap_ra_learn() */
+	atomic_t swap_readahead_pattern;
 #ifndef CONFIG_MMU
 	struct vm_region *vm_region;	/* NOMMU mapping region */
 #endif
@@ -447,6 +449,15 @@ struct mm_struct {
 		 */
 		struct mm_rss_stat rss_stat;
 
+#ifdef CONFIG_SWAP
+		/* Swapin readahead counters, see swapin_readahead() */
+		struct {
+			atomic_long_t faults;	/* swapin faults */
+			atomic_long_t pages;	/* pages read ahead */
+			atomic_long_t hits;	/* read ahead pages then used */
+		} swap_ra;
+#endif
+
 		struct linux_binfmt *binfmt;
 
 		/* Architecture-specific MM context */
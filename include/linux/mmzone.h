@@ -421,6 +421,7 @@ void lru_gen_init_lruvec(struct lruvec *lruvec);
 void *lru_gen_eviction(struct page *page);
 void lru_gen_refault(struct page *page, void *shadow);
 void lru_gen_look_around(struct page_vma_mapped_walk *pvmw);
+int lru_gen_page_age(struct page *page, unsigned long *idle);
 
 #ifdef CONFIG_MEMCG
 void lru_gen_init_memcg(struct mem_cgroup *memcg);
@@ -446,6 +447,11 @@ static inline void lru_gen_look_around(struct page_vma_mapped_walk *pvmw)
 {
 }
 
+static inline int lru_gen_page_age(struct page *page, unsigned long *idle)
+{
+	return -1;
+}
+
 #ifdef CONFIG_MEMCG
 static inline void lru_gen_init_memcg(struct mem_cgroup *memcg)
 {
@@ -922,6 +928,7 @@ typedef struct pglist_data {
 	enum zone_type kcompactd_classzone_idx;
 	wait_queue_head_t kcompactd_wait;
 	struct task_struct *kcompactd;
+	bool proactive_compact_trigger;
 #endif
 	/*
 	 * This is a per-node reserve of pages that are not available
@@ -1148,6 +1155,8 @@ static inline int is_highmem(struct zone *zone)
 
 /* These two functions are used to setup the per zone pages min values */
 struct ctl_table;
+int kswapd_threads_max_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 int kswapd_threads_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int min_free_kbytes_sysctl_handler(struct ctl_table *, int,
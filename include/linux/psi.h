@@ -25,6 +25,7 @@ int psi_show(struct seq_file *s, struct psi_group *group, enum psi_res res);
 
 void psi_emergency_trigger(void);
 bool psi_is_trigger_active(void);
+u64 psi_mem_stall_total(void);
 
 #ifdef CONFIG_CGROUPS
 int psi_cgroup_alloc(struct cgroup *cgrp);
@@ -51,6 +52,10 @@ static inline bool psi_is_trigger_active(void)
 {
 	return false;
 }
+static inline u64 psi_mem_stall_total(void)
+{
+	return 0;
+}
 
 #ifdef CONFIG_CGROUPS
 static inline int psi_cgroup_alloc(struct cgroup *cgrp)
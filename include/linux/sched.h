@@ -568,7 +568,7 @@ struct cpu_cycle_counter_cb {
 	u64 (*get_cpu_cycle_counter)(int cpu);
 };
 
-#define MAX_NUM_CGROUP_COLOC_ID	20
+#define MAX_NUM_CGROUP_COLOC_ID	24
 
 DECLARE_PER_CPU_READ_MOSTLY(int, sched_load_boost);
 
@@ -653,6 +653,12 @@ static inline void sched_update_cpu_freq_min_max(const cpumask_t *cpus,
 static inline void sched_set_refresh_rate(enum fps fps) { }
 #endif /* CONFIG_SCHED_WALT */
 
+struct sched_boost_client;
+extern struct sched_boost_client *sched_boost_client_register(const char *name);
+extern void sched_boost_client_unregister(struct sched_boost_client *client);
+extern int sched_boost_client_request(struct sched_boost_client *client,
+				      int type, unsigned int timeout_ms);
+
 struct sched_rt_entity {
 	struct list_head		run_list;
 	unsigned long			timeout;
@@ -869,6 +875,11 @@ struct task_struct {
 	u64 last_enqueued_ts;
 	struct related_thread_group *grp;
 	struct list_head grp_list;
+	/* Wakeup affinity tracking for automatic colocation */
+	struct task_struct *coloc_wakee;
+	struct task_struct *coloc_reported;
+	u64 coloc_wake_ts;
+	u32 coloc_wakeups;
 	u64 cpu_cycles;
 	bool misfit;
 	u32 unfilter;
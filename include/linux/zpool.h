@@ -51,6 +51,11 @@ int zpool_malloc(struct zpool *pool, size_t size, gfp_t gfp,
 
 void zpool_free(struct zpool *pool, unsigned long handle);
 
+int zpool_malloc_bulk(struct zpool *pool, size_t size, gfp_t gfp,
+			unsigned long *handles, int nr);
+
+void zpool_free_bulk(struct zpool *pool, unsigned long *handles, int nr);
+
 int zpool_shrink(struct zpool *pool, unsigned int pages,
 			unsigned int *reclaimed);
 
@@ -93,6 +98,9 @@ struct zpool_driver {
 	int (*malloc)(void *pool, size_t size, gfp_t gfp,
 				unsigned long *handle);
 	void (*free)(void *pool, unsigned long handle);
+	int (*malloc_bulk)(void *pool, size_t size, gfp_t gfp,
+				unsigned long *handles, int nr);
+	void (*free_bulk)(void *pool, unsigned long *handles, int nr);
 
 	int (*shrink)(void *pool, unsigned int pages,
 				unsigned int *reclaimed);
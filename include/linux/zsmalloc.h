@@ -47,6 +47,10 @@ void zs_destroy_pool(struct zs_pool *pool);
 unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags);
 void zs_free(struct zs_pool *pool, unsigned long obj);
 
+int zs_malloc_bulk(struct zs_pool *pool, size_t size, gfp_t flags,
+			unsigned long *handles, int nr);
+void zs_free_bulk(struct zs_pool *pool, unsigned long *handles, int nr);
+
 size_t zs_huge_class_size(struct zs_pool *pool);
 
 void *zs_map_object(struct zs_pool *pool, unsigned long handle,
@@ -788,6 +788,37 @@ struct fuse_notify_retrieve_in {
 /* 127 is reserved for the V1 interface implementation in Android (deprecated) */
 /* 126 is reserved for the V2 interface implementation in Android */
 #define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 126, __u32)
+/*
+ * Bind a channel to the request queue of a CPU, so that a blocking read on
+ * it gets the requests issued on that CPU while it waits. Requests issued
+ * while no bound reader is idle go to the shared queue. ~0U unbinds it.
+ */
+#define FUSE_DEV_IOC_BIND_CPU		_IOW(FUSE_DEV_IOC_MAGIC, 125, __u32)
+
+/*
+ * Directory and metadata passthrough
+ *
+ * Registers the lower file or directory @fd for the node @nodeid.  Its
+ * getattr then takes size, blocks and times from the lower inode, keeping
+ * the mode and ownership given by the daemon.  Registered directories are
+ * also opened and read in the kernel, and their names missing from the lower
+ * directory are negative without a FUSE_LOOKUP.  The children found by a
+ * lookup inherit the passthrough of their parent, so a registered directory
+ * must mirror the lower one.
+ *
+ * FUSE_PASSTHROUGH_NODE_OPT_OUT instead makes @nodeid, and the subtree
+ * looked up below it, go through the daemon again; @fd is ignored.
+ */
+struct fuse_passthrough_node {
+	uint64_t	nodeid;
+	uint32_t	fd;
+	uint32_t	flags;
+};
+
+#define FUSE_PASSTHROUGH_NODE_OPT_OUT	(1 << 0)
+
+#define FUSE_DEV_IOC_PASSTHROUGH_NODE	_IOW(FUSE_DEV_IOC_MAGIC, 124, \
+					     struct fuse_passthrough_node)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Time bounded scheduler boost requests.
+ *
+ * Each open file descriptor of /dev/sched_boost is a boost client. A client
+ * holds at most one request per boost type, requests of different clients
+ * stack, and all the requests of a client are dropped when it is closed.
+ */
+
+#ifndef _UAPI_LINUX_SCHED_BOOST_H
+#define _UAPI_LINUX_SCHED_BOOST_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * @type:	boost type to enable (> 0), the negated boost type to disable
+ *		(< 0) or 0 to drop all the requests of the client. The boost
+ *		types are the ones accepted by /proc/sys/kernel/sched_boost.
+ * @timeout_ms:	time after which an enable request expires, 0 keeps the
+ *		request until it is disabled or the client is closed. A new
+ *		request for an already enabled type re-arms its timeout.
+ */
+struct sched_boost_req {
+	__s32 type;
+	__u32 timeout_ms;
+};
+
+#define SCHED_BOOST_IOC_MAGIC	0xB7
+
+#define SCHED_BOOST_IOC_SET	_IOW(SCHED_BOOST_IOC_MAGIC, 1, \
+				     struct sched_boost_req)
+
+#endif /* _UAPI_LINUX_SCHED_BOOST_H */
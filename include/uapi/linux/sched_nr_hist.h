@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Per-cluster runnable tasks histograms.
+ *
+ * /dev/sched_nr_hist exposes a read-only ring of records, one per window of
+ * /proc/sys/kernel/sched_nr_hist_window_ms milliseconds, which is mapped in
+ * user space with mmap(). Windows are only published while the device is
+ * open. poll() reports when records were published since the last read() on
+ * the file, which returns the current @head of the ring as a __u32.
+ */
+
+#ifndef _UAPI_LINUX_SCHED_NR_HIST_H
+#define _UAPI_LINUX_SCHED_NR_HIST_H
+
+#include <linux/types.h>
+
+#define SCHED_NR_HIST_VERSION		1
+#define SCHED_NR_HIST_BUCKETS		8
+#define SCHED_NR_HIST_MAX_CLUSTERS	4
+
+/*
+ * Time, in nanoseconds, the CPUs of a cluster spent with N runnable tasks
+ * and with N big (misfit) tasks in a window. The last bucket accounts
+ * SCHED_NR_HIST_BUCKETS - 1 tasks or more.
+ */
+struct sched_nr_hist_cluster {
+	__u32 first_cpu;
+	__u32 nr_cpus;
+	__u64 nr_running_ns[SCHED_NR_HIST_BUCKETS];
+	__u64 nr_big_ns[SCHED_NR_HIST_BUCKETS];
+};
+
+/*
+ * @seq is odd while the record is being written: readers must copy the
+ * record and retry if @seq was odd or has changed in the meantime.
+ */
+struct sched_nr_hist_record {
+	__u32 seq;
+	__u32 nr_clusters;
+	__u64 start_ns;
+	__u64 end_ns;
+	struct sched_nr_hist_cluster clusters[SCHED_NR_HIST_MAX_CLUSTERS];
+};
+
+/*
+ * @head is the number of records published so far, modulo 2^32, the last
+ * one being records[(head - 1) % nr_records].
+ */
+struct sched_nr_hist_ring {
+	__u32 version;
+	__u32 nr_records;
+	__u32 head;
+	__u32 reserved;
+	struct sched_nr_hist_record records[];
+};
+
+#endif /* _UAPI_LINUX_SCHED_NR_HIST_H */
@@ -5,8 +5,13 @@
 
 #include "sched.h"
 #include "walt.h"
+#include <linux/debugfs.h>
+#include <linux/hrtimer.h>
+#include <linux/miscdevice.h>
 #include <linux/of.h>
 #include <linux/sched/core_ctl.h>
+#include <linux/sched_boost.h>
+#include <linux/seq_file.h>
 #include <trace/events/sched.h>
 
 /*
@@ -205,11 +210,14 @@ static void sched_boost_disable_all(void)
 	}
 }
 
+static void sched_boost_clients_reset(void);
+
 static void _sched_set_boost(int type)
 {
-	if (type == 0)
+	if (type == 0) {
 		sched_boost_disable_all();
-	else if (type > 0)
+		sched_boost_clients_reset();
+	} else if (type > 0)
 		sched_boost_enable(type);
 	else
 		sched_boost_disable(-type);
@@ -280,3 +288,312 @@ int sched_boost_handler(struct ctl_table *table, int write,
 	mutex_unlock(&boost_mutex);
 	return ret;
 }
+
+/*
+ * Boost clients
+ *
+ * A boost client owns at most one request per boost type. Requests can be
+ * bounded in time, in which case they are dropped by the client's expiry
+ * work once their hrtimer fires, and they are all dropped when the client
+ * goes away. The time spent with each boost type enabled is accounted per
+ * client so that boost usage can be audited through debugfs.
+ */
+
+struct sched_boost_request {
+	struct sched_boost_client *client;
+	struct hrtimer timer;
+	bool active;
+	/* Expiry time, KTIME_MAX for requests without timeout */
+	ktime_t expires;
+	/* Activation time of the current request */
+	ktime_t start;
+	/* Number of activations and total time spent boosted */
+	unsigned int count;
+	u64 boost_ns;
+};
+
+struct sched_boost_client {
+	struct list_head list;
+	char name[TASK_COMM_LEN];
+	pid_t tgid;
+	struct work_struct expire_work;
+	struct sched_boost_request req[MAX_NUM_BOOST_TYPE];
+};
+
+/* Boost clients and the accounting of released clients, under boost_mutex */
+static LIST_HEAD(sched_boost_clients);
+static u64 sched_boost_released_ns[MAX_NUM_BOOST_TYPE];
+
+static void sched_boost_request_stop(struct sched_boost_request *req, int type)
+{
+	if (!req->active)
+		return;
+
+	req->active = false;
+	req->boost_ns += ktime_to_ns(ktime_sub(ktime_get(), req->start));
+	_sched_set_boost(-type);
+}
+
+static void sched_boost_request_start(struct sched_boost_request *req,
+				      int type, unsigned int timeout_ms)
+{
+	ktime_t now = ktime_get();
+
+	if (!req->active) {
+		req->active = true;
+		req->start = now;
+		req->count++;
+		_sched_set_boost(type);
+	}
+
+	if (timeout_ms) {
+		req->expires = ktime_add_ms(now, timeout_ms);
+		hrtimer_start(&req->timer, ms_to_ktime(timeout_ms),
+			      HRTIMER_MODE_REL);
+	} else {
+		req->expires = KTIME_MAX;
+		hrtimer_try_to_cancel(&req->timer);
+	}
+}
+
+/*
+ * All the boosts have been disabled behind the clients' back, end their
+ * requests without touching the boost reference counts.
+ */
+static void sched_boost_clients_reset(void)
+{
+	struct sched_boost_client *client;
+	struct sched_boost_request *req;
+	ktime_t now = ktime_get();
+	int type;
+
+	list_for_each_entry(client, &sched_boost_clients, list) {
+		for (type = SCHED_BOOST_START; type < SCHED_BOOST_END; type++) {
+			req = &client->req[type];
+			if (!req->active)
+				continue;
+
+			req->active = false;
+			req->boost_ns += ktime_to_ns(ktime_sub(now, req->start));
+			hrtimer_try_to_cancel(&req->timer);
+		}
+	}
+}
+
+static void sched_boost_client_expire(struct work_struct *work)
+{
+	struct sched_boost_client *client = container_of(work,
+				struct sched_boost_client, expire_work);
+	struct sched_boost_request *req;
+	ktime_t now;
+	int type;
+
+	mutex_lock(&boost_mutex);
+	now = ktime_get();
+	for (type = SCHED_BOOST_START; type < SCHED_BOOST_END; type++) {
+		req = &client->req[type];
+		if (req->active && !ktime_before(now, req->expires))
+			sched_boost_request_stop(req, type);
+	}
+	mutex_unlock(&boost_mutex);
+}
+
+static enum hrtimer_restart sched_boost_timer_fn(struct hrtimer *timer)
+{
+	struct sched_boost_request *req = container_of(timer,
+				struct sched_boost_request, timer);
+
+	/* Boost enter/exit callbacks may sleep, expire from process context */
+	schedule_work(&req->client->expire_work);
+
+	return HRTIMER_NORESTART;
+}
+
+struct sched_boost_client *sched_boost_client_register(const char *name)
+{
+	struct sched_boost_client *client;
+	int type;
+
+	client = kzalloc(sizeof(*client), GFP_KERNEL);
+	if (!client)
+		return ERR_PTR(-ENOMEM);
+
+	strlcpy(client->name, name, sizeof(client->name));
+	client->tgid = task_tgid_nr(current);
+	INIT_WORK(&client->expire_work, sched_boost_client_expire);
+	for (type = 0; type < MAX_NUM_BOOST_TYPE; type++) {
+		client->req[type].client = client;
+		hrtimer_init(&client->req[type].timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		client->req[type].timer.function = sched_boost_timer_fn;
+	}
+
+	mutex_lock(&boost_mutex);
+	list_add_tail(&client->list, &sched_boost_clients);
+	mutex_unlock(&boost_mutex);
+
+	return client;
+}
+EXPORT_SYMBOL_GPL(sched_boost_client_register);
+
+void sched_boost_client_unregister(struct sched_boost_client *client)
+{
+	struct sched_boost_request *req;
+	int type;
+
+	for (type = SCHED_BOOST_START; type < SCHED_BOOST_END; type++)
+		hrtimer_cancel(&client->req[type].timer);
+	cancel_work_sync(&client->expire_work);
+
+	mutex_lock(&boost_mutex);
+	for (type = SCHED_BOOST_START; type < SCHED_BOOST_END; type++) {
+		req = &client->req[type];
+		sched_boost_request_stop(req, type);
+		sched_boost_released_ns[type] += req->boost_ns;
+	}
+	list_del(&client->list);
+	mutex_unlock(&boost_mutex);
+
+	kfree(client);
+}
+EXPORT_SYMBOL_GPL(sched_boost_client_unregister);
+
+/*
+ * Enable (type > 0) or disable (type < 0) a boost on behalf of a client, or
+ * drop all its requests (type == 0). Enable requests expire after timeout_ms
+ * milliseconds, unless timeout_ms is 0.
+ */
+int sched_boost_client_request(struct sched_boost_client *client, int type,
+			       unsigned int timeout_ms)
+{
+	int i;
+
+	if (!verify_boost_params(type))
+		return -EINVAL;
+
+	mutex_lock(&boost_mutex);
+	if (type > 0) {
+		sched_boost_request_start(&client->req[type], type, timeout_ms);
+	} else if (type < 0) {
+		hrtimer_try_to_cancel(&client->req[-type].timer);
+		sched_boost_request_stop(&client->req[-type], -type);
+	} else {
+		for (i = SCHED_BOOST_START; i < SCHED_BOOST_END; i++) {
+			hrtimer_try_to_cancel(&client->req[i].timer);
+			sched_boost_request_stop(&client->req[i], i);
+		}
+	}
+	mutex_unlock(&boost_mutex);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_boost_client_request);
+
+static int sched_boost_open(struct inode *inode, struct file *file)
+{
+	struct sched_boost_client *client;
+
+	client = sched_boost_client_register(current->group_leader->comm);
+	if (IS_ERR(client))
+		return PTR_ERR(client);
+
+	file->private_data = client;
+	return 0;
+}
+
+static int sched_boost_release(struct inode *inode, struct file *file)
+{
+	sched_boost_client_unregister(file->private_data);
+	return 0;
+}
+
+static long sched_boost_ioctl(struct file *file, unsigned int cmd,
+			      unsigned long arg)
+{
+	struct sched_boost_req req;
+
+	switch (cmd) {
+	case SCHED_BOOST_IOC_SET:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		return sched_boost_client_request(file->private_data,
+						  req.type, req.timeout_ms);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static const struct file_operations sched_boost_fops = {
+	.owner		= THIS_MODULE,
+	.open		= sched_boost_open,
+	.release	= sched_boost_release,
+	.unlocked_ioctl	= sched_boost_ioctl,
+	.compat_ioctl	= sched_boost_ioctl,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice sched_boost_miscdev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "sched_boost",
+	.fops	= &sched_boost_fops,
+};
+
+static int sched_boost_clients_show(struct seq_file *m, void *v)
+{
+	struct sched_boost_client *client;
+	struct sched_boost_request *req;
+	ktime_t now;
+	u64 boost_ns;
+	int type;
+
+	seq_puts(m, "tgid\tname\ttype\tactive\tcount\tboost_ms\n");
+
+	mutex_lock(&boost_mutex);
+	now = ktime_get();
+	list_for_each_entry(client, &sched_boost_clients, list) {
+		for (type = SCHED_BOOST_START; type < SCHED_BOOST_END; type++) {
+			req = &client->req[type];
+			if (!req->count)
+				continue;
+
+			boost_ns = req->boost_ns;
+			if (req->active)
+				boost_ns += ktime_to_ns(ktime_sub(now,
+								  req->start));
+
+			seq_printf(m, "%d\t%s\t%d\t%d\t%u\t%llu\n",
+				   client->tgid, client->name, type,
+				   req->active, req->count,
+				   div_u64(boost_ns, NSEC_PER_MSEC));
+		}
+	}
+
+	for (type = SCHED_BOOST_START; type < SCHED_BOOST_END; type++)
+		seq_printf(m, "released\ttype %d\t%llu ms\n", type,
+			   div_u64(sched_boost_released_ns[type],
+				   NSEC_PER_MSEC));
+	mutex_unlock(&boost_mutex);
+
+	return 0;
+}
+
+static int sched_boost_clients_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sched_boost_clients_show, NULL);
+}
+
+static const struct file_operations sched_boost_clients_fops = {
+	.open		= sched_boost_clients_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init sched_boost_clients_init(void)
+{
+	debugfs_create_file("sched_boost_clients", 0400, NULL, NULL,
+			    &sched_boost_clients_fops);
+
+	return misc_register(&sched_boost_miscdev);
+}
+late_initcall(sched_boost_clients_init);
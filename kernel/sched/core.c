@@ -2718,6 +2718,8 @@ static inline void walt_try_to_wake_up(struct task_struct *p)
 	note_task_waking(p, wallclock);
 	rq_unlock_irqrestore(rq, &rf);
 
+	walt_note_wakeup(current, p);
+
 	rcu_read_lock();
 	grp = task_related_thread_group(p);
 	if (update_preferred_cluster(grp, p, old_load, false))
@@ -7641,6 +7641,47 @@ cpu_util_next_walt(int cpu, struct task_struct *p, int dst_cpu)
 }
 #endif
 
+/*
+ * energy_cpu_util(): Predicts the contribution of @cpu to the busy time
+ * (@sum_util) and to the frequency selection (@max_util) of its performance
+ * domain if @p was migrated to @dst_cpu. A negative @dst_cpu predicts the
+ * utilization of @cpu with @p enqueued nowhere.
+ */
+static inline void
+energy_cpu_util(int cpu, struct task_struct *p, int dst_cpu,
+		unsigned long cpu_cap, unsigned long *sum_util,
+		unsigned long *max_util)
+{
+#ifdef CONFIG_SCHED_WALT
+	*sum_util = *max_util = cpu_util_next_walt(cpu, p, dst_cpu);
+#else
+	unsigned long util_cfs;
+	struct task_struct *tsk;
+
+	util_cfs = cpu_util_next(cpu, p, dst_cpu);
+
+	/*
+	 * Busy time computation: utilization clamping is not
+	 * required since the ratio (sum_util / cpu_capacity)
+	 * is already enough to scale the EM reported power
+	 * consumption at the (eventually clamped) cpu_capacity.
+	 */
+	*sum_util = schedutil_cpu_util(cpu, util_cfs, cpu_cap,
+				       ENERGY_UTIL, NULL);
+
+	/*
+	 * Performance domain frequency: utilization clamping
+	 * must be considered since it affects the selection
+	 * of the performance domain frequency.
+	 * NOTE: in case RT tasks are running, by default the
+	 * FREQUENCY_UTIL's utilization can be max OPP.
+	 */
+	tsk = cpu == dst_cpu ? p : NULL;
+	*max_util = schedutil_cpu_util(cpu, util_cfs, cpu_cap,
+				       FREQUENCY_UTIL, tsk);
+#endif
+}
+
 /*
  * compute_energy(): Estimates the energy that would be consumed if @p was
  * migrated to @dst_cpu. compute_energy() predicts what will be the utilization
@@ -7651,8 +7692,8 @@ cpu_util_next_walt(int cpu, struct task_struct *p, int dst_cpu)
 static long
 compute_energy(struct task_struct *p, int dst_cpu, struct perf_domain *pd)
 {
-	unsigned int max_util, cpu_util, cpu_cap;
-	unsigned long sum_util, energy = 0;
+	unsigned long max_util, sum_util, cpu_sum, cpu_max, cpu_cap;
+	unsigned long energy = 0;
 	int cpu;
 
 	for (; pd; pd = pd->next) {
@@ -7676,42 +7717,108 @@ compute_energy(struct task_struct *p, int dst_cpu, struct perf_domain *pd)
 		 * by compute_energy().
 		 */
 		for_each_cpu_and(cpu, pd_mask, cpu_online_mask) {
-#ifdef CONFIG_SCHED_WALT
-			cpu_util = cpu_util_next_walt(cpu, p, dst_cpu);
-			sum_util += cpu_util;
-#else
-			unsigned int util_cfs;
-			struct task_struct *tsk;
+			energy_cpu_util(cpu, p, dst_cpu, cpu_cap,
+					&cpu_sum, &cpu_max);
+			sum_util += cpu_sum;
+			max_util = max(max_util, cpu_max);
+		}
 
-			util_cfs = cpu_util_next(cpu, p, dst_cpu);
+		energy += em_pd_energy(pd->em_pd, max_util, sum_util);
+	}
 
-			/*
-			 * Busy time computation: utilization clamping is not
-			 * required since the ratio (sum_util / cpu_capacity)
-			 * is already enough to scale the EM reported power
-			 * consumption at the (eventually clamped) cpu_capacity.
-			 */
-			sum_util += schedutil_cpu_util(cpu, util_cfs, cpu_cap,
-						       ENERGY_UTIL, NULL);
+	return energy;
+}
 
-			/*
-			 * Performance domain frequency: utilization clamping
-			 * must be considered since it affects the selection
-			 * of the performance domain frequency.
-			 * NOTE: in case RT tasks are running, by default the
-			 * FREQUENCY_UTIL's utilization can be max OPP.
-			 */
-			tsk = cpu == dst_cpu ? p : NULL;
-			cpu_util = schedutil_cpu_util(cpu, util_cfs, cpu_cap,
-						      FREQUENCY_UTIL, tsk);
-#endif
-			max_util = max(max_util, cpu_util);
+/*
+ * Energy estimation cache for the wake-up path.
+ *
+ * Migrating @p to a candidate CPU only changes the utilization landscape of
+ * the candidate CPU: the CPU @p is taken from is accounted the same way for
+ * every candidate. Thus, the utilization of each CPU and the energy of each
+ * performance domain are computed once with @p enqueued nowhere, and
+ * evaluating a candidate only requires re-estimating the candidate CPU and
+ * the energy of its own performance domain.
+ */
+struct energy_env {
+	/* Energy of all the performance domains with @p enqueued nowhere */
+	unsigned long energy;
+	/* Energy of each performance domain, indexed by its first CPU */
+	unsigned long pd_energy[NR_CPUS];
+	/* Per CPU contributions as reported by energy_cpu_util() */
+	unsigned long sum_util[NR_CPUS];
+	unsigned long max_util[NR_CPUS];
+};
+
+static DEFINE_PER_CPU(struct energy_env, energy_env);
+
+static void
+energy_env_init(struct energy_env *eenv, struct task_struct *p,
+		struct perf_domain *pd)
+{
+	unsigned long max_util, sum_util, cpu_cap, energy;
+	int cpu;
+
+	eenv->energy = 0;
+
+	for (; pd; pd = pd->next) {
+		struct cpumask *pd_mask = perf_domain_span(pd);
+
+		cpu_cap = arch_scale_cpu_capacity(NULL, cpumask_first(pd_mask));
+		max_util = sum_util = 0;
+
+		for_each_cpu_and(cpu, pd_mask, cpu_online_mask) {
+			energy_cpu_util(cpu, p, -1, cpu_cap,
+					&eenv->sum_util[cpu],
+					&eenv->max_util[cpu]);
+			sum_util += eenv->sum_util[cpu];
+			max_util = max(max_util, eenv->max_util[cpu]);
 		}
 
-		energy += em_pd_energy(pd->em_pd, max_util, sum_util);
+		energy = em_pd_energy(pd->em_pd, max_util, sum_util);
+		eenv->pd_energy[cpumask_first(pd_mask)] = energy;
+		eenv->energy += energy;
 	}
+}
 
-	return energy;
+/*
+ * compute_energy_cached(): Same as compute_energy(), using the utilization
+ * and energy values cached by energy_env_init() for all the CPUs but
+ * @dst_cpu.
+ */
+static long
+compute_energy_cached(struct energy_env *eenv, struct task_struct *p,
+		      int dst_cpu, struct perf_domain *pd)
+{
+	unsigned long max_util = 0, sum_util = 0, cpu_cap;
+	unsigned long dst_sum, dst_max;
+	struct cpumask *pd_mask;
+	int cpu;
+
+	for (; pd; pd = pd->next) {
+		if (cpumask_test_cpu(dst_cpu, perf_domain_span(pd)))
+			break;
+	}
+
+	/* @dst_cpu is not accounted, neither is @p */
+	if (!pd || !cpu_online(dst_cpu))
+		return eenv->energy;
+
+	pd_mask = perf_domain_span(pd);
+	cpu_cap = arch_scale_cpu_capacity(NULL, cpumask_first(pd_mask));
+	energy_cpu_util(dst_cpu, p, dst_cpu, cpu_cap, &dst_sum, &dst_max);
+
+	for_each_cpu_and(cpu, pd_mask, cpu_online_mask) {
+		if (cpu == dst_cpu) {
+			sum_util += dst_sum;
+			max_util = max(max_util, dst_max);
+		} else {
+			sum_util += eenv->sum_util[cpu];
+			max_util = max(max_util, eenv->max_util[cpu]);
+		}
+	}
+
+	return eenv->energy - eenv->pd_energy[cpumask_first(pd_mask)] +
+	       em_pd_energy(pd->em_pd, max_util, sum_util);
 }
 
 static void select_cpu_candidates(struct sched_domain *sd, cpumask_t *cpus,
@@ -7875,6 +7982,7 @@ static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu,
 	unsigned long cur_energy;
 	struct perf_domain *pd;
 	struct sched_domain *sd;
+	struct energy_env *eenv;
 	cpumask_t *candidates;
 	bool is_rtg, curr_is_rtg;
 	struct find_best_target_env fbt_env;
@@ -7992,16 +8100,26 @@ static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu,
 		goto unlock;
 	}
 
-	if (cpumask_test_cpu(prev_cpu, &p->cpus_allowed))
-		prev_energy = best_energy = compute_energy(p, prev_cpu, pd);
-	else
+	eenv = this_cpu_ptr(&energy_env);
+	if (sched_feat(ENERGY_CACHE))
+		energy_env_init(eenv, p, pd);
+
+	if (!cpumask_test_cpu(prev_cpu, &p->cpus_allowed))
 		prev_energy = best_energy = ULONG_MAX;
+	else if (sched_feat(ENERGY_CACHE))
+		prev_energy = best_energy =
+			compute_energy_cached(eenv, p, prev_cpu, pd);
+	else
+		prev_energy = best_energy = compute_energy(p, prev_cpu, pd);
 
 	/* Select the best candidate energy-wise. */
 	for_each_cpu(cpu, candidates) {
 		if (cpu == prev_cpu)
 			continue;
-		cur_energy = compute_energy(p, cpu, pd);
+		if (sched_feat(ENERGY_CACHE))
+			cur_energy = compute_energy_cached(eenv, p, cpu, pd);
+		else
+			cur_energy = compute_energy(p, cpu, pd);
 		trace_sched_compute_energy(p, cpu, cur_energy, prev_energy,
 					   best_energy, best_energy_cpu);
 		if (cur_energy < best_energy) {
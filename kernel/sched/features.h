@@ -130,3 +130,11 @@
  * If disabled, boosts will only bias tasks to higher-capacity CPUs.
  */
 #define SCHED_FEAT_SCHEDTUNE_BOOST_UTIL 0
+
+/*
+ * Cache the per CPU utilization and per performance domain energy with the
+ * waking task enqueued nowhere, so that find_energy_efficient_cpu() only
+ * re-estimates the performance domain of each candidate CPU.
+ * Latency of both variants is reported by the sched_task_util trace event.
+ */
+#define SCHED_FEAT_ENERGY_CACHE 1
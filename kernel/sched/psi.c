@@ -665,6 +665,27 @@ bool psi_is_trigger_active(void)
 	return trigger_active;
 }
 
+/*
+ * Time, in ns, some tasks were stalled on memory system-wide. The per-CPU
+ * times are folded in first, as psi_show() does, so that callers sampling
+ * more often than PSI_FREQ see the current total.
+ */
+u64 psi_mem_stall_total(void)
+{
+	struct psi_group *group = &psi_system;
+	u64 total;
+
+	if (static_branch_likely(&psi_disabled))
+		return 0;
+
+	mutex_lock(&group->avgs_lock);
+	collect_percpu_times(group, PSI_AVGS, NULL);
+	total = group->total[PSI_AVGS][PSI_MEM_SOME];
+	mutex_unlock(&group->avgs_lock);
+
+	return total;
+}
+
 /*
  * Schedule polling if it's not already scheduled. It's safe to call even from
  * hotpath because even though kthread_queue_delayed_work takes worker->lock
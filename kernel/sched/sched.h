@@ -2757,6 +2757,8 @@ struct related_thread_group {
 	u64 last_update;
 	u64 downmigrate_ts;
 	u64 start_ts;
+	/* When an automatic group was formed */
+	u64 auto_coloc_ts;
 };
 
 extern struct sched_cluster *sched_cluster[NR_CPUS];
@@ -3004,6 +3006,7 @@ static inline unsigned int power_cost(int cpu, u64 demand)
 }
 
 void note_task_waking(struct task_struct *p, u64 wallclock);
+void walt_note_wakeup(struct task_struct *waker, struct task_struct *wakee);
 
 static inline bool task_placement_boost_enabled(struct task_struct *p)
 {
@@ -11,6 +11,13 @@
 #include <linux/hrtimer.h>
 #include <linux/sched.h>
 #include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/sched_nr_hist.h>
 
 #include "sched.h"
 #include "walt.h"
@@ -21,6 +28,8 @@ static DEFINE_PER_CPU(u64, last_time);
 static DEFINE_PER_CPU(u64, nr_big_prod_sum);
 static DEFINE_PER_CPU(u64, nr);
 static DEFINE_PER_CPU(u64, nr_max);
+static DEFINE_PER_CPU(u64 [SCHED_NR_HIST_BUCKETS], nr_hist);
+static DEFINE_PER_CPU(u64 [SCHED_NR_HIST_BUCKETS], nr_big_hist);
 
 static DEFINE_PER_CPU(spinlock_t, nr_lock) = __SPIN_LOCK_UNLOCKED(nr_lock);
 static s64 last_get_time;
@@ -132,6 +141,16 @@ void sched_update_hyst_times(void)
 	}
 }
 
+static inline void nr_hist_account(int cpu, unsigned long nr_running, u64 diff)
+{
+	unsigned int nr_big = walt_big_tasks(cpu);
+
+	per_cpu(nr_hist, cpu)[min_t(unsigned long, nr_running,
+				    SCHED_NR_HIST_BUCKETS - 1)] += diff;
+	per_cpu(nr_big_hist, cpu)[min_t(unsigned int, nr_big,
+					SCHED_NR_HIST_BUCKETS - 1)] += diff;
+}
+
 #define BUSY_NR_RUN		3
 #define BUSY_LOAD_FACTOR	10
 static inline void update_busy_hyst_end_time(int cpu, bool dequeue,
@@ -186,6 +205,7 @@ void sched_update_nr_prod(int cpu, long delta, bool inc)
 
 	per_cpu(nr_prod_sum, cpu) += nr_running * diff;
 	per_cpu(nr_big_prod_sum, cpu) += walt_big_tasks(cpu) * diff;
+	nr_hist_account(cpu, nr_running, diff);
 	spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
 }
 EXPORT_SYMBOL(sched_update_nr_prod);
@@ -226,3 +246,247 @@ u64 sched_lpm_disallowed_time(int cpu)
 
 	return 0;
 }
+
+/*
+ * Runnable tasks histograms
+ *
+ * sched_update_nr_prod() accounts, per CPU, the time spent with each number
+ * of runnable and big tasks. While /dev/sched_nr_hist is open, the per CPU
+ * histograms are folded per cluster every sysctl_sched_nr_hist_window_ms
+ * and published in a ring which user space maps read-only.
+ */
+unsigned int sysctl_sched_nr_hist_window_ms = 20;
+
+#define NR_HIST_RING_RECORDS	64
+#define NR_HIST_RING_SIZE	PAGE_ALIGN(sizeof(struct sched_nr_hist_ring) + \
+			NR_HIST_RING_RECORDS * sizeof(struct sched_nr_hist_record))
+
+static struct sched_nr_hist_ring *nr_hist_ring;
+static DEFINE_MUTEX(nr_hist_mutex);
+static unsigned int nr_hist_users;
+static u64 nr_hist_window_start;
+/* number of records published, the ring head is its low 32 bits */
+static unsigned long nr_hist_seq;
+static DECLARE_WAIT_QUEUE_HEAD(nr_hist_waitq);
+
+/* Per open file state */
+struct nr_hist_reader {
+	/* nr_hist_seq at the last read() */
+	unsigned long seen;
+};
+
+static void nr_hist_publish(struct work_struct *work);
+static DECLARE_DELAYED_WORK(nr_hist_work, nr_hist_publish);
+
+/*
+ * Fold the time elapsed since the last update in the per CPU sums.
+ * NOTE: must be called with the CPU's nr_lock held.
+ */
+static void nr_hist_fold(int cpu)
+{
+	u64 curr_time = sched_clock();
+	u64 diff = curr_time - per_cpu(last_time, cpu);
+
+	per_cpu(last_time, cpu) = curr_time;
+	per_cpu(nr_prod_sum, cpu) += per_cpu(nr, cpu) * diff;
+	per_cpu(nr_big_prod_sum, cpu) += walt_big_tasks(cpu) * diff;
+	nr_hist_account(cpu, per_cpu(nr, cpu), diff);
+}
+
+static void nr_hist_reset(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
+		nr_hist_fold(cpu);
+		memset(per_cpu(nr_hist, cpu), 0, sizeof(per_cpu(nr_hist, cpu)));
+		memset(per_cpu(nr_big_hist, cpu), 0,
+		       sizeof(per_cpu(nr_big_hist, cpu)));
+		spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+	}
+
+	nr_hist_window_start = sched_clock();
+}
+
+static void nr_hist_publish(struct work_struct *work)
+{
+	struct sched_nr_hist_record *rec;
+	struct sched_nr_hist_cluster *hc;
+	struct sched_cluster *cluster;
+	unsigned long flags;
+	int cpu, i;
+
+	rec = &nr_hist_ring->records[nr_hist_seq % NR_HIST_RING_RECORDS];
+
+	WRITE_ONCE(rec->seq, rec->seq + 1);
+	smp_wmb();
+
+	memset(rec->clusters, 0, sizeof(rec->clusters));
+	rec->nr_clusters = 0;
+
+	rcu_read_lock();
+	for_each_sched_cluster(cluster) {
+		if (rec->nr_clusters == SCHED_NR_HIST_MAX_CLUSTERS)
+			break;
+
+		hc = &rec->clusters[rec->nr_clusters++];
+		hc->first_cpu = cpumask_first(&cluster->cpus);
+		hc->nr_cpus = cpumask_weight(&cluster->cpus);
+
+		for_each_cpu(cpu, &cluster->cpus) {
+			spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
+			nr_hist_fold(cpu);
+			for (i = 0; i < SCHED_NR_HIST_BUCKETS; i++) {
+				hc->nr_running_ns[i] += per_cpu(nr_hist, cpu)[i];
+				hc->nr_big_ns[i] += per_cpu(nr_big_hist, cpu)[i];
+			}
+			memset(per_cpu(nr_hist, cpu), 0,
+			       sizeof(per_cpu(nr_hist, cpu)));
+			memset(per_cpu(nr_big_hist, cpu), 0,
+			       sizeof(per_cpu(nr_big_hist, cpu)));
+			spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+		}
+	}
+	rcu_read_unlock();
+
+	rec->start_ns = nr_hist_window_start;
+	rec->end_ns = nr_hist_window_start = sched_clock();
+
+	smp_wmb();
+	WRITE_ONCE(rec->seq, rec->seq + 1);
+	smp_store_release(&nr_hist_ring->head, (u32)(nr_hist_seq + 1));
+	smp_store_release(&nr_hist_seq, nr_hist_seq + 1);
+
+	wake_up_interruptible(&nr_hist_waitq);
+
+	schedule_delayed_work(&nr_hist_work,
+			      msecs_to_jiffies(sysctl_sched_nr_hist_window_ms));
+}
+
+static int nr_hist_open(struct inode *inode, struct file *file)
+{
+	struct nr_hist_reader *reader;
+	int ret = 0;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	mutex_lock(&nr_hist_mutex);
+	if (!nr_hist_ring) {
+		nr_hist_ring = vmalloc_user(NR_HIST_RING_SIZE);
+		if (!nr_hist_ring) {
+			kfree(reader);
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		nr_hist_ring->version = SCHED_NR_HIST_VERSION;
+		nr_hist_ring->nr_records = NR_HIST_RING_RECORDS;
+	}
+
+	if (!nr_hist_users++) {
+		nr_hist_reset();
+		schedule_delayed_work(&nr_hist_work,
+			msecs_to_jiffies(sysctl_sched_nr_hist_window_ms));
+	}
+
+	reader->seen = READ_ONCE(nr_hist_seq);
+	file->private_data = reader;
+unlock:
+	mutex_unlock(&nr_hist_mutex);
+	return ret;
+}
+
+static int nr_hist_release(struct inode *inode, struct file *file)
+{
+	mutex_lock(&nr_hist_mutex);
+	if (!--nr_hist_users)
+		cancel_delayed_work_sync(&nr_hist_work);
+	mutex_unlock(&nr_hist_mutex);
+
+	kfree(file->private_data);
+	return 0;
+}
+
+static int nr_hist_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_vmalloc_range(vma, nr_hist_ring, vma->vm_pgoff);
+}
+
+static bool nr_hist_pending(struct nr_hist_reader *reader)
+{
+	return READ_ONCE(nr_hist_seq) != READ_ONCE(reader->seen);
+}
+
+/* Wait for records newer than the last read, and return the ring head */
+static ssize_t nr_hist_read(struct file *file, char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct nr_hist_reader *reader = file->private_data;
+	unsigned long seq;
+	u32 head;
+	int ret;
+
+	if (count < sizeof(head))
+		return -EINVAL;
+
+	if (file->f_flags & O_NONBLOCK) {
+		if (!nr_hist_pending(reader))
+			return -EAGAIN;
+	} else {
+		ret = wait_event_interruptible(nr_hist_waitq,
+					       nr_hist_pending(reader));
+		if (ret)
+			return ret;
+	}
+
+	seq = smp_load_acquire(&nr_hist_seq);
+	WRITE_ONCE(reader->seen, seq);
+
+	head = seq;
+	if (copy_to_user(buf, &head, sizeof(head)))
+		return -EFAULT;
+
+	return sizeof(head);
+}
+
+static __poll_t nr_hist_poll(struct file *file, poll_table *wait)
+{
+	struct nr_hist_reader *reader = file->private_data;
+
+	poll_wait(file, &nr_hist_waitq, wait);
+
+	if (!nr_hist_pending(reader))
+		return 0;
+
+	return EPOLLIN | EPOLLRDNORM;
+}
+
+static const struct file_operations nr_hist_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nr_hist_open,
+	.release	= nr_hist_release,
+	.read		= nr_hist_read,
+	.mmap		= nr_hist_mmap,
+	.poll		= nr_hist_poll,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice nr_hist_miscdev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "sched_nr_hist",
+	.fops	= &nr_hist_fops,
+};
+
+static int __init nr_hist_init(void)
+{
+	return misc_register(&nr_hist_miscdev);
+}
+late_initcall(nr_hist_init);
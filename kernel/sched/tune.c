@@ -1,7 +1,9 @@
 #include <linux/binfmts.h>
+#include <linux/bitmap.h>
 #include <linux/cgroup.h>
 #include <linux/err.h>
 #include <linux/kernel.h>
+#include <linux/mutex.h>
 #include <linux/percpu.h>
 #include <linux/printk.h>
 #include <linux/rcupdate.h>
@@ -35,6 +37,16 @@ extern struct reciprocal_value schedtune_spc_rdiv;
  * invalid on each CPU. The CPU boost value (boost_max) is aggregated by
  * considering only valid boost_groups with a non null tasks counter.
  *
+ * .:: Boost max tracking
+ *
+ * Each CPU keeps its boost groups ranked by decreasing boost value, together
+ * with an "active" bitmap indexed by rank. A bit is set when a task of the
+ * corresponding group is enqueued and it is lazily cleared once the group has
+ * no RUNNABLE tasks and its boost hold has expired. The CPU boost value is
+ * thus given by the first active rank which is still in effect, and the
+ * enqueue/dequeue cost does not depend on the number of boost groups.
+ * Ranks are only reshuffled by the slow path, when a boost value changes.
+ *
  * .:: Locking strategy
  *
  * The fast path uses a spin lock for each CPU boost_group which protects the
@@ -183,6 +195,12 @@ struct boost_groups {
 	/* Maximum boost value for all RUNNABLE tasks on a CPU */
 	int boost_max;
 	u64 boost_ts;
+	/* Ranks (by decreasing boost) of groups which may affect this CPU */
+	DECLARE_BITMAP(active, BOOSTGROUPS_COUNT);
+	/* Boost group index for each rank */
+	u8 rank_idx[BOOSTGROUPS_COUNT];
+	/* Rank for each boost group index */
+	u8 idx_rank[BOOSTGROUPS_COUNT];
 	struct {
 		/* True when this boost group maps an actual cgroup */
 		bool valid;
@@ -200,6 +218,9 @@ struct boost_groups {
 /* Boost groups affecting each CPU in the system */
 DEFINE_PER_CPU(struct boost_groups, cpu_boost_groups);
 
+/* Serializes boost groups ranking updates */
+static DEFINE_MUTEX(schedtune_rank_mutex);
+
 static inline void init_sched_boost(struct schedtune *st)
 {
 	st->sched_boost_no_override = false;
@@ -283,37 +304,55 @@ schedtune_boost_group_active(int idx, struct boost_groups* bg, u64 now)
 	return !schedtune_boost_timeout(now, bg->group[idx].ts);
 }
 
+static inline void
+schedtune_boost_group_mark(struct boost_groups *bg, int idx)
+{
+	__set_bit(bg->idx_rank[idx], bg->active);
+}
+
 static void
 schedtune_cpu_update(int cpu, u64 now)
 {
 	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
 	int boost_max;
 	u64 boost_ts;
-	int idx;
+	int rank, i;
+	int idx = 0;
 
-	/* The root boost group is always active */
-	boost_max = bg->group[0].boost;
-	boost_ts = now;
-	for (idx = 1; idx < BOOSTGROUPS_COUNT; ++idx) {
+	/*
+	 * Walk the active ranks, from the highest boost down, until we find a
+	 * boost group which is still in effect. Boost groups found without
+	 * RUNNABLE tasks and with an expired hold are dropped from the active
+	 * set, thus each of them is visited at most once per activation.
+	 * The root boost group is always active, which bounds the walk.
+	 */
+	for_each_set_bit(rank, bg->active, BOOSTGROUPS_COUNT) {
+		i = bg->rank_idx[rank];
 
-		/* Ignore non boostgroups not mapping a cgroup */
-		if (!bg->group[idx].valid)
-			continue;
+		/* The root boost group is always active */
+		if (!i)
+			break;
 
 		/*
 		 * A boost group affects a CPU only if it has
 		 * RUNNABLE tasks on that CPU or it has hold
 		 * in effect from a previous task.
 		 */
-		if (!schedtune_boost_group_active(idx, bg, now))
-			continue;
+		if (bg->group[i].valid &&
+		    schedtune_boost_group_active(i, bg, now)) {
+			idx = i;
+			break;
+		}
 
-		/* This boost group is active */
-		if (boost_max > bg->group[idx].boost)
-			continue;
+		__clear_bit(rank, bg->active);
+	}
 
+	if (idx) {
 		boost_max = bg->group[idx].boost;
-		boost_ts =  bg->group[idx].ts;
+		boost_ts = bg->group[idx].ts;
+	} else {
+		boost_max = bg->group[0].boost;
+		boost_ts = now;
 	}
 
 	/* Ensures boost_max is non-negative when all cgroup boost values
@@ -324,15 +363,72 @@ schedtune_cpu_update(int cpu, u64 now)
 	bg->boost_ts = boost_ts;
 }
 
+/*
+ * Compute the ranking of the allocated boost groups by decreasing boost value.
+ * On equal boost values the higher boost group index is ranked first, which
+ * matches the boost group whose hold timestamp has always been reported.
+ * NOTE: must be called with schedtune_rank_mutex held.
+ */
+static void
+schedtune_boostgroup_rank(u8 *rank_idx, u8 *idx_rank)
+{
+	int boost[BOOSTGROUPS_COUNT];
+	int idx, rank, i;
+
+	for (idx = 0; idx < BOOSTGROUPS_COUNT; ++idx)
+		boost[idx] = allocated_group[idx] ?
+			allocated_group[idx]->boost : INT_MIN;
+
+	/* Insertion sort, we only have a handful of boost groups */
+	for (idx = 0; idx < BOOSTGROUPS_COUNT; ++idx) {
+		for (i = idx; i > 0; --i) {
+			if (boost[rank_idx[i - 1]] > boost[idx])
+				break;
+			rank_idx[i] = rank_idx[i - 1];
+		}
+		rank_idx[i] = idx;
+	}
+
+	for (rank = 0; rank < BOOSTGROUPS_COUNT; ++rank)
+		idx_rank[rank_idx[rank]] = rank;
+}
+
+/*
+ * Apply a new boost groups ranking to the specified CPU, preserving the set
+ * of active boost groups.
+ * NOTE: must be called with the CPU's boost group lock held.
+ */
+static void
+schedtune_cpu_rerank(struct boost_groups *bg,
+		     const u8 *rank_idx, const u8 *idx_rank)
+{
+	DECLARE_BITMAP(active, BOOSTGROUPS_COUNT);
+	int rank;
+
+	bitmap_zero(active, BOOSTGROUPS_COUNT);
+	for_each_set_bit(rank, bg->active, BOOSTGROUPS_COUNT)
+		__set_bit(idx_rank[bg->rank_idx[rank]], active);
+
+	bitmap_copy(bg->active, active, BOOSTGROUPS_COUNT);
+	memcpy(bg->rank_idx, rank_idx, sizeof(bg->rank_idx));
+	memcpy(bg->idx_rank, idx_rank, sizeof(bg->idx_rank));
+}
+
 static int
 schedtune_boostgroup_update(int idx, int boost)
 {
+	u8 rank_idx[BOOSTGROUPS_COUNT];
+	u8 idx_rank[BOOSTGROUPS_COUNT];
 	struct boost_groups *bg;
+	unsigned long irq_flags;
 	int cur_boost_max;
-	int old_boost;
 	int cpu;
 	u64 now;
 
+	mutex_lock(&schedtune_rank_mutex);
+
+	schedtune_boostgroup_rank(rank_idx, idx_rank);
+
 	/* Update per CPU boost groups */
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
@@ -340,38 +436,27 @@ schedtune_boostgroup_update(int idx, int boost)
 		/* CGroups are never associated to non active cgroups */
 		BUG_ON(!bg->group[idx].valid);
 
-		/*
-		 * Keep track of current boost values to compute the per CPU
-		 * maximum only when it has been affected by the new value of
-		 * the updated boost group
-		 */
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
+
 		cur_boost_max = bg->boost_max;
-		old_boost = bg->group[idx].boost;
 
 		/* Update the boost value of this boost group */
 		bg->group[idx].boost = boost;
+		schedtune_cpu_rerank(bg, rank_idx, idx_rank);
 
-		/* Check if this update increase current max */
 		now = sched_clock_cpu(cpu);
-		if (boost > cur_boost_max &&
-			schedtune_boost_group_active(idx, bg, now)) {
-			bg->boost_max = boost;
-			bg->boost_ts = bg->group[idx].ts;
-
-			trace_sched_tune_boostgroup_update(cpu, 1, bg->boost_max);
-			continue;
-		}
+		schedtune_cpu_update(cpu, now);
 
-		/* Check if this update has decreased current max */
-		if (cur_boost_max == old_boost && old_boost > boost) {
-			schedtune_cpu_update(cpu, now);
-			trace_sched_tune_boostgroup_update(cpu, -1, bg->boost_max);
-			continue;
-		}
+		trace_sched_tune_boostgroup_update(cpu,
+			(bg->boost_max > cur_boost_max) -
+			(bg->boost_max < cur_boost_max),
+			bg->boost_max);
 
-		trace_sched_tune_boostgroup_update(cpu, 0, bg->boost_max);
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
 	}
 
+	mutex_unlock(&schedtune_rank_mutex);
+
 	return 0;
 }
 
@@ -403,6 +488,8 @@ schedtune_tasks_update(struct task_struct *p, int cpu, int idx, int task_count)
 		if (schedtune_update_timestamp(p))
 			bg->group[idx].ts = now;
 
+		schedtune_boost_group_mark(bg, idx);
+
 		/* Boost group activation or deactivation on that RQ */
 		if (bg->group[idx].tasks == 1)
 			schedtune_cpu_update(cpu, now);
@@ -521,6 +608,7 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu)
 int schedtune_cpu_boost_with(int cpu, struct task_struct *p)
 {
 	struct boost_groups *bg;
+	unsigned long irq_flags;
 	u64 now;
 	int task_boost = p ? schedtune_task_boost(p) : -100;
 
@@ -528,8 +616,11 @@ int schedtune_cpu_boost_with(int cpu, struct task_struct *p)
 	now = sched_clock_cpu(cpu);
 
 	/* Check to see if we have a hold in effect */
-	if (schedtune_boost_timeout(now, bg->boost_ts))
+	if (schedtune_boost_timeout(now, bg->boost_ts)) {
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
 		schedtune_cpu_update(cpu, now);
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
+	}
 
 	return max(bg->boost_max, task_boost);
 }
@@ -710,6 +801,7 @@ static void schedtune_attach(struct cgroup_taskset *tset)
 		/* Update boost hold start for this group */
 		now = sched_clock_cpu(cpu);
 		bg->group[dst_idx].ts = now;
+		schedtune_boost_group_mark(bg, dst_idx);
 
 		/* Force boost group re-evaluation at next boost check */
 		bg->boost_ts = now - SCHEDTUNE_BOOST_HOLD_NS;
@@ -805,20 +897,32 @@ static struct cftype files[] = {
 static void
 schedtune_boostgroup_init(struct schedtune *st, int idx)
 {
+	u8 rank_idx[BOOSTGROUPS_COUNT];
+	u8 idx_rank[BOOSTGROUPS_COUNT];
 	struct boost_groups *bg;
+	unsigned long irq_flags;
 	int cpu;
 
+	mutex_lock(&schedtune_rank_mutex);
+
+	/* Keep track of allocated boost groups */
+	allocated_group[idx] = st;
+	st->idx = idx;
+
+	schedtune_boostgroup_rank(rank_idx, idx_rank);
+
 	/* Initialize per CPUs boost group support */
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
 		bg->group[idx].boost = 0;
 		bg->group[idx].valid = true;
 		bg->group[idx].ts = 0;
+		schedtune_cpu_rerank(bg, rank_idx, idx_rank);
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
 	}
 
-	/* Keep track of allocated boost groups */
-	allocated_group[idx] = st;
-	st->idx = idx;
+	mutex_unlock(&schedtune_rank_mutex);
 }
 
 #ifdef CONFIG_STUNE_ASSIST
@@ -907,17 +1011,25 @@ static void
 schedtune_boostgroup_release(struct schedtune *st)
 {
 	struct boost_groups *bg;
+	unsigned long irq_flags;
 	int cpu;
 
+	mutex_lock(&schedtune_rank_mutex);
+
 	/* Reset per CPUs boost group support */
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
 		bg->group[st->idx].valid = false;
 		bg->group[st->idx].boost = 0;
+		__clear_bit(bg->idx_rank[st->idx], bg->active);
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
 	}
 
 	/* Keep track of allocated boost groups */
 	allocated_group[st->idx] = NULL;
+
+	mutex_unlock(&schedtune_rank_mutex);
 }
 
 static void
@@ -945,12 +1057,19 @@ schedtune_init_cgroups(void)
 {
 	struct boost_groups *bg;
 	int cpu;
+	int idx;
 
 	/* Initialize the per CPU boost groups */
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		memset(bg, 0, sizeof(struct boost_groups));
 		bg->group[0].valid = true;
+		for (idx = 0; idx < BOOSTGROUPS_COUNT; ++idx) {
+			bg->rank_idx[idx] = idx;
+			bg->idx_rank[idx] = idx;
+		}
+		/* The root boost group is always active */
+		schedtune_boost_group_mark(bg, 0);
 		raw_spin_lock_init(&bg->lock);
 	}
 
@@ -5,9 +5,11 @@
 
 #include <linux/syscore_ops.h>
 #include <linux/cpufreq.h>
+#include <linux/debugfs.h>
 #include <linux/list_sort.h>
 #include <linux/jiffies.h>
 #include <linux/sched/stat.h>
+#include <linux/seq_file.h>
 #include <trace/events/sched.h>
 #include "sched.h"
 #include "walt.h"
@@ -2142,6 +2144,10 @@ void init_new_task_load(struct task_struct *p)
 	INIT_LIST_HEAD(&p->grp_list);
 	memset(&p->ravg, 0, sizeof(struct ravg));
 	p->cpu_cycles = 0;
+	p->coloc_wakee = NULL;
+	p->coloc_reported = NULL;
+	p->coloc_wake_ts = 0;
+	p->coloc_wakeups = 0;
 
 	if (init_load_pct) {
 		init_load_windows = div64_u64((u64)init_load_pct *
@@ -2934,6 +2940,11 @@ void add_new_task_to_grp(struct task_struct *new)
 	write_unlock_irqrestore(&related_thread_group_lock, flags);
 }
 
+static inline bool auto_coloc_group(struct related_thread_group *grp)
+{
+	return grp && grp->id >= AUTO_COLOC_ID_START;
+}
+
 static int __sched_set_group_id(struct task_struct *p, unsigned int group_id)
 {
 	int rc = 0;
@@ -2946,6 +2957,11 @@ static int __sched_set_group_id(struct task_struct *p, unsigned int group_id)
 	raw_spin_lock_irqsave(&p->pi_lock, flags);
 	write_lock(&related_thread_group_lock);
 
+	/* An automatic group gives way to an explicitly requested one */
+	if (p->grp && auto_coloc_group(p->grp) && group_id &&
+	    group_id < AUTO_COLOC_ID_START)
+		remove_task_from_group(p);
+
 	/* Switching from one group to another directly is not permitted */
 	if ((current != p && p->flags & PF_EXITING) ||
 			(!p->grp && !group_id) ||
@@ -2971,8 +2987,9 @@ static int __sched_set_group_id(struct task_struct *p, unsigned int group_id)
 
 int sched_set_group_id(struct task_struct *p, unsigned int group_id)
 {
-	/* DEFAULT_CGROUP_COLOC_ID is a reserved id */
-	if (group_id == DEFAULT_CGROUP_COLOC_ID)
+	/* DEFAULT_CGROUP_COLOC_ID and automatic group ids are reserved */
+	if (group_id == DEFAULT_CGROUP_COLOC_ID ||
+	    group_id >= AUTO_COLOC_ID_START)
 		return -EINVAL;
 
 	return __sched_set_group_id(p, group_id);
@@ -3026,6 +3043,330 @@ int sync_cgroup_colocation(struct task_struct *p, bool insert)
 }
 #endif
 
+/*
+ * Automatic colocation
+ *
+ * Threads of a process which keep waking each other up, such as a UI thread
+ * and its render thread, form a pipeline whose demand should be aggregated
+ * even when user space did not put them in a colocated cgroup. Each task
+ * remembers the last task it woke up, and the wake-ups between two tasks
+ * which alternately wake each other are counted. Once a pair reaches
+ * sysctl_sched_auto_coloc_wakeups wake-ups within AUTO_COLOC_WINDOW_NS, it
+ * is reported through debugfs (sysctl_sched_auto_coloc == 1) and moved to
+ * one of the automatic related thread groups (sysctl_sched_auto_coloc == 2).
+ * Automatic groups are dissolved AUTO_COLOC_EXPIRE_MS after they were formed,
+ * whatever their tasks do in the meantime, and pairs which still wake each
+ * other up are then simply detected again. A task asked to join another group
+ * by user space or its cgroup leaves its automatic group first. Without
+ * grouping (sysctl_sched_auto_coloc == 1) each pair is reported only once.
+ */
+unsigned int __read_mostly sysctl_sched_auto_coloc;
+unsigned int __read_mostly sysctl_sched_auto_coloc_wakeups = 32;
+
+#define AUTO_COLOC_WINDOW_NS	NSEC_PER_SEC
+#define AUTO_COLOC_EXPIRE_MS	10000
+#define AUTO_COLOC_NR_PAIRS	8
+
+struct auto_coloc_pair {
+	struct task_struct *waker;
+	struct task_struct *wakee;
+};
+
+struct auto_coloc_report {
+	pid_t waker_pid;
+	pid_t wakee_pid;
+	char waker_comm[TASK_COMM_LEN];
+	char wakee_comm[TASK_COMM_LEN];
+	unsigned int grp_id;
+	u64 ts;
+};
+
+/* Pairs detected from the wake-up path, waiting for auto_coloc_work */
+static DEFINE_RAW_SPINLOCK(auto_coloc_lock);
+static struct auto_coloc_pair auto_coloc_pending[AUTO_COLOC_NR_PAIRS];
+static unsigned int auto_coloc_nr_pending;
+
+/* Serializes automatic groups updates and protects the reports */
+static DEFINE_MUTEX(auto_coloc_mutex);
+static struct auto_coloc_report auto_coloc_reports[AUTO_COLOC_NR_PAIRS];
+static unsigned int auto_coloc_nr_reports;
+
+static void auto_coloc_workfn(struct work_struct *work);
+static DECLARE_WORK(auto_coloc_work, auto_coloc_workfn);
+static void auto_coloc_expire_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(auto_coloc_expire_work, auto_coloc_expire_workfn);
+
+static void auto_coloc_irq_workfn(struct irq_work *irq_work)
+{
+	schedule_work(&auto_coloc_work);
+}
+static DEFINE_IRQ_WORK(auto_coloc_irq_work, auto_coloc_irq_workfn);
+
+/*
+ * Called from the wake-up path, with the wakee's pi_lock held.
+ */
+void walt_note_wakeup(struct task_struct *waker, struct task_struct *wakee)
+{
+	struct related_thread_group *waker_grp, *wakee_grp;
+	unsigned long flags;
+	u64 now;
+
+	if (!sysctl_sched_auto_coloc || !in_task() || waker == wakee ||
+	    waker->tgid != wakee->tgid || (waker->flags & PF_KTHREAD))
+		return;
+
+	if (waker->coloc_wakee != wakee) {
+		waker->coloc_wakee = wakee;
+		waker->coloc_wakeups = 0;
+		return;
+	}
+
+	/* Only account tasks which are waking each other up */
+	if (wakee->coloc_wakee != waker)
+		return;
+
+	if (sysctl_sched_auto_coloc == 1 &&
+	    (waker->coloc_reported == wakee || wakee->coloc_reported == waker))
+		return;
+
+	now = sched_ktime_clock();
+
+	/* Related thread groups are never freed */
+	waker_grp = rcu_access_pointer(waker->grp);
+	wakee_grp = rcu_access_pointer(wakee->grp);
+	if (waker_grp || wakee_grp) {
+		if (waker_grp == wakee_grp)
+			return;
+
+		/* Only automatic groups can be joined */
+		if ((waker_grp && wakee_grp) ||
+		    !auto_coloc_group(waker_grp ?: wakee_grp))
+			return;
+	}
+
+	if (now - waker->coloc_wake_ts > AUTO_COLOC_WINDOW_NS) {
+		waker->coloc_wake_ts = now;
+		waker->coloc_wakeups = 0;
+	}
+
+	if (++waker->coloc_wakeups < sysctl_sched_auto_coloc_wakeups)
+		return;
+
+	waker->coloc_wake_ts = now;
+	waker->coloc_wakeups = 0;
+	waker->coloc_reported = wakee;
+
+	raw_spin_lock_irqsave(&auto_coloc_lock, flags);
+	if (auto_coloc_nr_pending < AUTO_COLOC_NR_PAIRS) {
+		get_task_struct(waker);
+		get_task_struct(wakee);
+		auto_coloc_pending[auto_coloc_nr_pending].waker = waker;
+		auto_coloc_pending[auto_coloc_nr_pending].wakee = wakee;
+		auto_coloc_nr_pending++;
+		irq_work_queue(&auto_coloc_irq_work);
+	}
+	raw_spin_unlock_irqrestore(&auto_coloc_lock, flags);
+}
+
+/*
+ * Move both tasks to the automatic group of either of them, or to a free
+ * automatic group. Returns the id of the group or 0 if none was available.
+ * NOTE: must be called with auto_coloc_mutex held.
+ */
+static unsigned int
+auto_coloc_join(struct task_struct *waker, struct task_struct *wakee)
+{
+	struct related_thread_group *grp;
+	unsigned int grp_id;
+	unsigned long flags;
+
+	grp_id = sched_get_group_id(waker) ?: sched_get_group_id(wakee);
+	if (grp_id && grp_id < AUTO_COLOC_ID_START)
+		return 0;
+
+	if (!grp_id) {
+		read_lock_irqsave(&related_thread_group_lock, flags);
+		for (grp_id = AUTO_COLOC_ID_START;
+		     grp_id < MAX_NUM_CGROUP_COLOC_ID; grp_id++) {
+			grp = lookup_related_thread_group(grp_id);
+			if (list_empty(&grp->list))
+				break;
+		}
+		read_unlock_irqrestore(&related_thread_group_lock, flags);
+
+		if (grp_id == MAX_NUM_CGROUP_COLOC_ID)
+			return 0;
+
+		/* Joining an existing group does not extend its life */
+		WRITE_ONCE(grp->auto_coloc_ts, sched_ktime_clock());
+	}
+
+	if (!sched_get_group_id(waker))
+		__sched_set_group_id(waker, grp_id);
+	if (!sched_get_group_id(wakee))
+		__sched_set_group_id(wakee, grp_id);
+
+	return grp_id;
+}
+
+static void auto_coloc_workfn(struct work_struct *work)
+{
+	struct auto_coloc_pair pairs[AUTO_COLOC_NR_PAIRS];
+	struct auto_coloc_report *report;
+	unsigned int nr_pairs, grp_id, i;
+	bool grouped = false;
+
+	raw_spin_lock_irq(&auto_coloc_lock);
+	nr_pairs = auto_coloc_nr_pending;
+	memcpy(pairs, auto_coloc_pending, nr_pairs * sizeof(pairs[0]));
+	auto_coloc_nr_pending = 0;
+	raw_spin_unlock_irq(&auto_coloc_lock);
+
+	mutex_lock(&auto_coloc_mutex);
+	for (i = 0; i < nr_pairs; i++) {
+		grp_id = 0;
+		if (sysctl_sched_auto_coloc == 2)
+			grp_id = auto_coloc_join(pairs[i].waker, pairs[i].wakee);
+		grouped |= !!grp_id;
+
+		report = &auto_coloc_reports[auto_coloc_nr_reports++ %
+					     AUTO_COLOC_NR_PAIRS];
+		report->waker_pid = task_pid_nr(pairs[i].waker);
+		report->wakee_pid = task_pid_nr(pairs[i].wakee);
+		get_task_comm(report->waker_comm, pairs[i].waker);
+		get_task_comm(report->wakee_comm, pairs[i].wakee);
+		report->grp_id = grp_id;
+		report->ts = sched_ktime_clock();
+
+		put_task_struct(pairs[i].waker);
+		put_task_struct(pairs[i].wakee);
+	}
+	mutex_unlock(&auto_coloc_mutex);
+
+	if (grouped)
+		schedule_delayed_work(&auto_coloc_expire_work,
+				      msecs_to_jiffies(AUTO_COLOC_EXPIRE_MS));
+}
+
+/*
+ * Remove all the tasks of an automatic group. Exiting tasks remove
+ * themselves from their group, in that case give up and retry later.
+ * Returns true if the group is empty.
+ */
+static bool auto_coloc_dissolve(struct related_thread_group *grp)
+{
+	struct task_struct *p, *prev = NULL;
+	unsigned long flags;
+
+	for (;;) {
+		raw_spin_lock_irqsave(&grp->lock, flags);
+		p = list_first_entry_or_null(&grp->tasks, struct task_struct,
+					     grp_list);
+		if (p && p != prev)
+			get_task_struct(p);
+		raw_spin_unlock_irqrestore(&grp->lock, flags);
+
+		if (!p)
+			return true;
+		if (p == prev)
+			return false;
+
+		__sched_set_group_id(p, 0);
+		put_task_struct(p);
+		prev = p;
+	}
+}
+
+static void auto_coloc_expire_workfn(struct work_struct *work)
+{
+	struct related_thread_group *grp;
+	unsigned int grp_id;
+	bool active = false;
+	u64 now;
+
+	mutex_lock(&auto_coloc_mutex);
+	now = sched_ktime_clock();
+	for (grp_id = AUTO_COLOC_ID_START; grp_id < MAX_NUM_CGROUP_COLOC_ID;
+	     grp_id++) {
+		grp = lookup_related_thread_group(grp_id);
+
+		if (sysctl_sched_auto_coloc == 2 &&
+		    now - READ_ONCE(grp->auto_coloc_ts) <
+		    AUTO_COLOC_EXPIRE_MS * NSEC_PER_MSEC) {
+			active |= !list_empty(&grp->list);
+			continue;
+		}
+
+		active |= !auto_coloc_dissolve(grp);
+	}
+	mutex_unlock(&auto_coloc_mutex);
+
+	if (active)
+		schedule_delayed_work(&auto_coloc_expire_work,
+				      msecs_to_jiffies(AUTO_COLOC_EXPIRE_MS));
+}
+
+static int auto_coloc_show(struct seq_file *m, void *v)
+{
+	struct related_thread_group *grp;
+	struct auto_coloc_report *report;
+	struct task_struct *p;
+	unsigned long flags;
+	unsigned int grp_id, i, nr;
+
+	mutex_lock(&auto_coloc_mutex);
+
+	for (grp_id = AUTO_COLOC_ID_START; grp_id < MAX_NUM_CGROUP_COLOC_ID;
+	     grp_id++) {
+		grp = lookup_related_thread_group(grp_id);
+
+		raw_spin_lock_irqsave(&grp->lock, flags);
+		if (!list_empty(&grp->tasks)) {
+			seq_printf(m, "group %u skip_min=%d:", grp_id,
+				   grp->skip_min);
+			list_for_each_entry(p, &grp->tasks, grp_list)
+				seq_printf(m, " %d(%s)", task_pid_nr(p),
+					   p->comm);
+			seq_putc(m, '\n');
+		}
+		raw_spin_unlock_irqrestore(&grp->lock, flags);
+	}
+
+	nr = min_t(unsigned int, auto_coloc_nr_reports, AUTO_COLOC_NR_PAIRS);
+	for (i = 0; i < nr; i++) {
+		report = &auto_coloc_reports[(auto_coloc_nr_reports - nr + i) %
+					     AUTO_COLOC_NR_PAIRS];
+		seq_printf(m, "pair %d(%s) <-> %d(%s) group=%u ts=%llu\n",
+			   report->waker_pid, report->waker_comm,
+			   report->wakee_pid, report->wakee_comm,
+			   report->grp_id, report->ts);
+	}
+
+	mutex_unlock(&auto_coloc_mutex);
+
+	return 0;
+}
+
+static int auto_coloc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, auto_coloc_show, NULL);
+}
+
+static const struct file_operations auto_coloc_fops = {
+	.open		= auto_coloc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init auto_coloc_init(void)
+{
+	debugfs_create_file("sched_auto_coloc", 0400, NULL, NULL,
+			    &auto_coloc_fops);
+	return 0;
+}
+late_initcall(auto_coloc_init);
+
 static bool is_cluster_hosting_top_app(struct sched_cluster *cluster)
 {
 	struct related_thread_group *grp;
@@ -326,6 +326,8 @@ static inline bool is_suh_max(void)
 }
 
 #define DEFAULT_CGROUP_COLOC_ID 1
+/* Group ids reserved to automatically detected colocation groups */
+#define AUTO_COLOC_ID_START	(MAX_NUM_CGROUP_COLOC_ID - 4)
 static inline bool walt_should_kick_upmigrate(struct task_struct *p, int cpu)
 {
 	struct related_thread_group *rtg = p->grp;
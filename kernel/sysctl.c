@@ -497,6 +497,24 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_douintvec_minmax,
 	},
+	{
+		.procname	= "sched_auto_coloc",
+		.data		= &sysctl_sched_auto_coloc,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &two,
+	},
+	{
+		.procname	= "sched_auto_coloc_wakeups",
+		.data		= &sysctl_sched_auto_coloc_wakeups,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &one,
+		.extra2		= &one_thousand,
+	},
 	{
 		.procname	= "sched_task_unfilter_period",
 		.data		= &sysctl_sched_task_unfilter_period,
@@ -551,6 +569,15 @@ static struct ctl_table kern_table[] = {
 		.extra1		= &zero,
 		.extra2		= &one_hundred_thousand,
 	},
+	{
+		.procname	= "sched_nr_hist_window_ms",
+		.data		= &sysctl_sched_nr_hist_window_ms,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &one,
+		.extra2		= &one_thousand,
+	},
 	{
 		.procname	= "sched_ravg_window_nr_ticks",
 		.data		= &sysctl_sched_ravg_window_nr_ticks,
@@ -1794,6 +1821,16 @@ static struct ctl_table vm_table[] = {
 		.extra1         = &zero,
 		.extra2         = &one,
 	},
+#ifdef CONFIG_PROCESS_RECLAIM
+	{
+		.procname	= "process_reclaim_rate",
+		.data		= &sysctl_process_reclaim_rate,
+		.maxlen		= sizeof(sysctl_process_reclaim_rate),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+	},
+#endif
 #ifdef CONFIG_HUGETLB_PAGE
 	{
 		.procname	= "nr_hugepages",
@@ -1868,6 +1905,24 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &min_extfrag_threshold,
 		.extra2		= &max_extfrag_threshold,
 	},
+	{
+		.procname	= "compaction_proactiveness",
+		.data		= &sysctl_compaction_proactiveness,
+		.maxlen		= sizeof(sysctl_compaction_proactiveness),
+		.mode		= 0644,
+		.proc_handler	= compaction_proactiveness_sysctl_handler,
+		.extra1		= &zero,
+		.extra2		= &one_hundred,
+	},
+	{
+		.procname	= "compaction_proactive_budget_ms",
+		.data		= &sysctl_compaction_proactive_budget_ms,
+		.maxlen		= sizeof(sysctl_compaction_proactive_budget_ms),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &one,
+		.extra2		= &one_thousand,
+	},
 	{
 		.procname	= "compact_unevictable_allowed",
 		.data		= &sysctl_compact_unevictable_allowed,
@@ -1904,6 +1959,15 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &one,
 		.extra2		= &max_kswapd_threads,
 	},
+	{
+		.procname	= "kswapd_threads_max",
+		.data		= &kswapd_threads_max,
+		.maxlen		= sizeof(kswapd_threads_max),
+		.mode		= 0644,
+		.proc_handler	= kswapd_threads_max_sysctl_handler,
+		.extra1		= &zero,
+		.extra2		= &max_kswapd_threads,
+	},
 	{
 		.procname	= "watermark_scale_factor",
 		.data		= &watermark_scale_factor,
@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Throughput benchmark for the blk-crypto crypto API fallback.
+ *
+ * Writes and then reads back the start of a block device, by default the
+ * first null_blk device, through bios carrying an AES-256-XTS encryption
+ * context. null_blk has no inline encryption hardware, so all the crypto is
+ * done by blk-crypto-fallback and the device itself costs next to nothing.
+ * The module reports the write and read throughput in MB/s.
+ *
+ * With verify=1, it also checks between the two runs that the data read back
+ * is the data that was written. That needs a device which keeps its data,
+ * which null_blk only does when created memory backed through configfs:
+ *
+ *	mkdir /sys/kernel/config/nullb/nullb0
+ *	cd /sys/kernel/config/nullb/nullb0
+ *	echo 1024 > size; echo 1 > memory_backed; echo 1 > power
+ *
+ * with null_blk loaded with nr_devices=0. Without memory_backed, reads
+ * return zeroes and the check fails.
+ *
+ * The parallel chunk size of the fallback can be changed between runs
+ * through /sys/module/blk_crypto_fallback/parameters/parallel_chunk_kb.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/bio.h>
+#include <linux/blk-crypto.h>
+#include <linux/blkdev.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/wait_bit.h>
+
+/* AES-256-XTS takes two 256-bit keys */
+#define TEST_KEY_SIZE	64
+
+static char *path = "/dev/nullb0";
+module_param(path, charp, 0);
+MODULE_PARM_DESC(path, "Block device to run on, overwritten (default: /dev/nullb0)");
+
+static unsigned int total_mb = 256;
+module_param(total_mb, uint, 0);
+MODULE_PARM_DESC(total_mb, "MiB written and then read back (default: 256)");
+
+static unsigned int bio_kb = 512;
+module_param(bio_kb, uint, 0);
+MODULE_PARM_DESC(bio_kb, "Size of each bio in KiB (default: 512)");
+
+static unsigned int qd = 8;
+module_param(qd, uint, 0);
+MODULE_PARM_DESC(qd, "Number of bios in flight (default: 8)");
+
+static unsigned int data_unit_size = 4096;
+module_param(data_unit_size, uint, 0);
+MODULE_PARM_DESC(data_unit_size, "Encryption data unit size in bytes (default: 4096)");
+
+static bool verify;
+module_param(verify, bool, 0);
+MODULE_PARM_DESC(verify, "Check the data read back, needs a memory backed device (default: 0)");
+
+struct bench {
+	struct block_device *bdev;
+	struct blk_crypto_key key;
+	/* qd slots of bio pages, plus one to read back into */
+	struct page **pages;
+	unsigned int nr_pages;		/* per bio */
+	atomic_t inflight;
+	blk_status_t status;
+};
+
+static void bench_endio(struct bio *bio)
+{
+	struct bench *b = bio->bi_private;
+
+	if (bio->bi_status)
+		b->status = bio->bi_status;
+	bio_put(bio);
+
+	/*
+	 * bench_run() may free b as soon as inflight drops to 0. wake_up_var()
+	 * only uses the address as a key, so it is safe after the decrement.
+	 */
+	atomic_dec(&b->inflight);
+	smp_mb__after_atomic();
+	wake_up_var(&b->inflight);
+}
+
+static struct bio *bench_alloc_bio(struct bench *b, unsigned int op,
+				   unsigned int slot, sector_t sector)
+{
+	u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE] = { };
+	struct bio *bio;
+	unsigned int i;
+
+	bio = bio_alloc(GFP_KERNEL, b->nr_pages);
+	if (!bio)
+		return NULL;
+
+	bio_set_dev(bio, b->bdev);
+	bio->bi_iter.bi_sector = sector;
+	bio->bi_opf = op;
+	for (i = 0; i < b->nr_pages; i++)
+		bio_add_page(bio, b->pages[slot * b->nr_pages + i], PAGE_SIZE, 0);
+
+	dun[0] = ((u64)sector << SECTOR_SHIFT) / data_unit_size;
+	bio_crypt_set_ctx(bio, &b->key, dun, GFP_KERNEL);
+	return bio;
+}
+
+static int bench_submit(struct bench *b, unsigned int op, unsigned int slot,
+			sector_t sector)
+{
+	struct bio *bio;
+
+	bio = bench_alloc_bio(b, op, slot, sector);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_private = b;
+	bio->bi_end_io = bench_endio;
+	atomic_inc(&b->inflight);
+	submit_bio(bio);
+	return 0;
+}
+
+static int bench_run(struct bench *b, unsigned int op, const char *name)
+{
+	sector_t capacity = get_capacity(b->bdev->bd_disk);
+	sector_t bio_sectors = (sector_t)bio_kb << 1;
+	u64 nr_bios = div_u64((u64)total_mb << 10, bio_kb);
+	sector_t sector = 0;
+	unsigned int slot = 0;
+	ktime_t start;
+	u64 i, ns;
+	int err = 0;
+
+	atomic_set(&b->inflight, 0);
+	b->status = BLK_STS_OK;
+
+	start = ktime_get();
+	for (i = 0; i < nr_bios; i++) {
+		wait_var_event(&b->inflight, atomic_read(&b->inflight) < qd);
+
+		if (sector + bio_sectors > capacity)
+			sector = 0;
+		err = bench_submit(b, op, slot, sector);
+		if (err)
+			break;
+		sector += bio_sectors;
+		if (++slot == qd)
+			slot = 0;
+	}
+	wait_var_event(&b->inflight, !atomic_read(&b->inflight));
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (!err && b->status)
+		err = blk_status_to_errno(b->status);
+	if (err) {
+		pr_err("%s failed: %d\n", name, err);
+		return err;
+	}
+
+	pr_info("%s: %llu MB/s\n", name,
+		div64_u64((u64)total_mb * NSEC_PER_SEC, ns ?: 1));
+	return 0;
+}
+
+/*
+ * Reads back every bio sized block written by the write run and compares it
+ * with the slot that wrote it last. bench_run() wraps around to sector 0 at
+ * the end of the device, so block p was last written by the last bio i with
+ * i % nr_blocks == p, from slot i % qd.
+ */
+static int bench_verify(struct bench *b)
+{
+	sector_t bio_sectors = (sector_t)bio_kb << 1;
+	u64 nr_blocks = div64_u64(get_capacity(b->bdev->bd_disk), bio_sectors);
+	u64 nr_bios = div_u64((u64)total_mb << 10, bio_kb);
+	u64 p, last;
+	unsigned int i, slot;
+	struct bio *bio;
+	int err;
+
+	for (p = 0; p < min(nr_blocks, nr_bios); p++) {
+		bio = bench_alloc_bio(b, REQ_OP_READ, qd, p * bio_sectors);
+		if (!bio)
+			return -ENOMEM;
+		err = submit_bio_wait(bio);
+		bio_put(bio);
+		if (err) {
+			pr_err("verify read failed: %d\n", err);
+			return err;
+		}
+
+		last = p + div64_u64(nr_bios - 1 - p, nr_blocks) * nr_blocks;
+		slot = do_div(last, qd);
+		for (i = 0; i < b->nr_pages; i++) {
+			if (memcmp(page_address(b->pages[qd * b->nr_pages + i]),
+				   page_address(b->pages[slot * b->nr_pages + i]),
+				   PAGE_SIZE)) {
+				pr_err("data mismatch at sector %llu\n",
+				       (unsigned long long)(p * bio_sectors +
+				       ((sector_t)i << (PAGE_SHIFT - 9))));
+				return -EILSEQ;
+			}
+		}
+	}
+
+	pr_info("verify: %llu MiB read back\n",
+		div_u64(min(nr_blocks, nr_bios) * bio_kb, 1024));
+	return 0;
+}
+
+static int __init test_blk_crypto_init(void)
+{
+	u8 raw_key[TEST_KEY_SIZE];
+	struct bench *b;
+	unsigned int i;
+	int err;
+
+	if (!bio_kb || !qd || !total_mb ||
+	    bio_kb > (BIO_MAX_PAGES << (PAGE_SHIFT - 10)) ||
+	    !IS_ALIGNED(bio_kb << 10, PAGE_SIZE) ||
+	    !is_power_of_2(data_unit_size) || data_unit_size < SECTOR_SIZE ||
+	    !IS_ALIGNED(bio_kb << 10, data_unit_size))
+		return -EINVAL;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+	b->nr_pages = (bio_kb << 10) >> PAGE_SHIFT;
+
+	b->pages = kcalloc((qd + 1) * b->nr_pages, sizeof(*b->pages),
+			   GFP_KERNEL);
+	if (!b->pages) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+	for (i = 0; i < (qd + 1) * b->nr_pages; i++) {
+		b->pages[i] = alloc_page(GFP_KERNEL);
+		if (!b->pages[i]) {
+			err = -ENOMEM;
+			goto out_free_pages;
+		}
+		get_random_bytes(page_address(b->pages[i]), PAGE_SIZE);
+	}
+
+	b->bdev = blkdev_get_by_path(path, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				     b);
+	if (IS_ERR(b->bdev)) {
+		err = PTR_ERR(b->bdev);
+		pr_err("cannot open %s: %d\n", path, err);
+		goto out_free_pages;
+	}
+
+	get_random_bytes(raw_key, sizeof(raw_key));
+	err = blk_crypto_init_key(&b->key, raw_key, sizeof(raw_key), false,
+				  BLK_ENCRYPTION_MODE_AES_256_XTS, sizeof(u64),
+				  data_unit_size);
+	if (err)
+		goto out_put;
+
+	err = blk_crypto_start_using_mode(BLK_ENCRYPTION_MODE_AES_256_XTS,
+					  sizeof(u64), data_unit_size, false,
+					  bdev_get_queue(b->bdev));
+	if (err) {
+		pr_err("cannot use AES-256-XTS on %s: %d\n", path, err);
+		goto out_put;
+	}
+
+	pr_info("%s: %u MiB, bio %u KiB, qd %u, data unit %u, %u online CPUs\n",
+		path, total_mb, bio_kb, qd, data_unit_size, num_online_cpus());
+
+	err = bench_run(b, REQ_OP_WRITE, "write");
+	if (!err && verify)
+		err = bench_verify(b);
+	if (!err)
+		err = bench_run(b, REQ_OP_READ, "read");
+
+	blk_crypto_evict_key(bdev_get_queue(b->bdev), &b->key);
+out_put:
+	memzero_explicit(raw_key, sizeof(raw_key));
+	memzero_explicit(&b->key, sizeof(b->key));
+	blkdev_put(b->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_free_pages:
+	for (i = 0; i < (qd + 1) * b->nr_pages; i++)
+		if (b->pages[i])
+			__free_page(b->pages[i]);
+	kfree(b->pages);
+out_free:
+	kfree(b);
+	return err;
+}
+
+static void __exit test_blk_crypto_exit(void)
+{
+}
+
+module_init(test_blk_crypto_init);
+module_exit(test_blk_crypto_exit);
+
+MODULE_LICENSE("GPL v2");
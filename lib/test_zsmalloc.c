@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Multi-threaded stress test and benchmark for zsmalloc.
+ *
+ * Each thread repeatedly allocates a set of objects of random sizes, in
+ * batches when "batch" is above 1, fills them with a pattern derived from
+ * the handle, checks the pattern back and frees them. The module reports
+ * the average cost of an allocation and of a free, and fails to load if any
+ * object was corrupted.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/zsmalloc.h>
+
+static int nr_threads;
+module_param(nr_threads, int, 0);
+MODULE_PARM_DESC(nr_threads, "Number of threads to spawn (default: number of online CPUs)");
+
+static int nr_objs = 4096;
+module_param(nr_objs, int, 0);
+MODULE_PARM_DESC(nr_objs, "Number of live objects per thread (default: 4096)");
+
+static int runs = 16;
+module_param(runs, int, 0);
+MODULE_PARM_DESC(runs, "Number of allocate/verify/free runs per thread (default: 16)");
+
+static int min_size = 512;
+module_param(min_size, int, 0);
+MODULE_PARM_DESC(min_size, "Minimum object size (default: 512)");
+
+static int max_size = 3072;
+module_param(max_size, int, 0);
+MODULE_PARM_DESC(max_size, "Maximum object size (default: 3072)");
+
+static int batch = 1;
+module_param(batch, int, 0);
+MODULE_PARM_DESC(batch, "Objects per zs_malloc_bulk()/zs_free_bulk() call, 1 to use zs_malloc()/zs_free() (default: 1)");
+
+struct thread_data {
+	int id;
+	struct task_struct *task;
+	unsigned long *handles;
+	unsigned short *sizes;
+	u64 alloc_ns;
+	u64 free_ns;
+	unsigned long nr_alloc;
+	unsigned long nr_corrupt;
+	int err;
+};
+
+static struct zs_pool *pool;
+static atomic_t startup_count;
+static DECLARE_COMPLETION(startup);
+static DECLARE_COMPLETION(done);
+static atomic_t done_count;
+
+static u8 pattern(unsigned long handle, int i)
+{
+	return (u8)(handle >> 3) ^ (u8)i;
+}
+
+static void fill_objs(struct thread_data *tdata, int start, int nr)
+{
+	int i, j;
+
+	for (i = start; i < start + nr; i++) {
+		u8 *buf = zs_map_object(pool, tdata->handles[i], ZS_MM_WO);
+
+		for (j = 0; j < tdata->sizes[i]; j++)
+			buf[j] = pattern(tdata->handles[i], j);
+		zs_unmap_object(pool, tdata->handles[i]);
+	}
+}
+
+static void check_objs(struct thread_data *tdata)
+{
+	int i, j;
+
+	for (i = 0; i < nr_objs; i++) {
+		u8 *buf = zs_map_object(pool, tdata->handles[i], ZS_MM_RO);
+
+		for (j = 0; j < tdata->sizes[i]; j++) {
+			if (buf[j] != pattern(tdata->handles[i], j)) {
+				tdata->nr_corrupt++;
+				break;
+			}
+		}
+		zs_unmap_object(pool, tdata->handles[i]);
+	}
+}
+
+static int alloc_objs(struct thread_data *tdata)
+{
+	int i, j, nr, size;
+	ktime_t start;
+
+	for (i = 0; i < nr_objs; i += nr) {
+		nr = min(batch, nr_objs - i);
+		size = min_size + prandom_u32_max(max_size - min_size + 1);
+
+		start = ktime_get();
+		if (nr == 1) {
+			tdata->handles[i] = zs_malloc(pool, size, GFP_KERNEL);
+			nr = !!tdata->handles[i];
+		} else {
+			nr = zs_malloc_bulk(pool, size, GFP_KERNEL,
+					    tdata->handles + i, nr);
+		}
+		tdata->alloc_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		if (!nr) {
+			/* free what was allocated so far */
+			zs_free_bulk(pool, tdata->handles, i);
+			return -ENOMEM;
+		}
+
+		for (j = i; j < i + nr; j++)
+			tdata->sizes[j] = size;
+		fill_objs(tdata, i, nr);
+	}
+
+	tdata->nr_alloc += nr_objs;
+
+	return 0;
+}
+
+static void free_objs(struct thread_data *tdata)
+{
+	int i, nr;
+	ktime_t start;
+
+	for (i = 0; i < nr_objs; i += nr) {
+		nr = min(batch, nr_objs - i);
+
+		start = ktime_get();
+		if (nr == 1)
+			zs_free(pool, tdata->handles[i]);
+		else
+			zs_free_bulk(pool, tdata->handles + i, nr);
+		tdata->free_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+}
+
+static int threadfunc(void *data)
+{
+	struct thread_data *tdata = data;
+	int run;
+
+	if (atomic_dec_and_test(&startup_count))
+		complete(&startup);
+	wait_for_completion(&startup);
+
+	for (run = 0; run < runs; run++) {
+		tdata->err = alloc_objs(tdata);
+		if (tdata->err)
+			break;
+
+		check_objs(tdata);
+		free_objs(tdata);
+		cond_resched();
+	}
+
+	if (atomic_dec_and_test(&done_count))
+		complete(&done);
+
+	while (!kthread_should_stop())
+		schedule_timeout_interruptible(HZ);
+
+	return 0;
+}
+
+static int __init test_zsmalloc_init(void)
+{
+	struct thread_data *tdata;
+	u64 alloc_ns = 0, free_ns = 0;
+	unsigned long nr_alloc = 0, nr_corrupt = 0;
+	int i, started = 0, err = 0;
+
+	if (nr_threads <= 0)
+		nr_threads = num_online_cpus();
+	if (nr_objs <= 0 || runs <= 0 || batch <= 0 || min_size <= 0 ||
+	    max_size < min_size || max_size > U16_MAX)
+		return -EINVAL;
+
+	pool = zs_create_pool("test_zsmalloc");
+	if (!pool)
+		return -ENOMEM;
+
+	tdata = vzalloc(array_size(nr_threads, sizeof(*tdata)));
+	if (!tdata) {
+		err = -ENOMEM;
+		goto out_pool;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		tdata[i].id = i;
+		tdata[i].handles = vmalloc(array_size(nr_objs,
+					sizeof(*tdata[i].handles)));
+		tdata[i].sizes = vmalloc(array_size(nr_objs,
+					sizeof(*tdata[i].sizes)));
+		if (!tdata[i].handles || !tdata[i].sizes) {
+			err = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	pr_info("%d threads, %d objects of %d-%d bytes, %d runs, batch %d\n",
+		nr_threads, nr_objs, min_size, max_size, runs, batch);
+
+	atomic_set(&startup_count, nr_threads);
+	atomic_set(&done_count, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		tdata[i].task = kthread_run(threadfunc, &tdata[i],
+					    "zsmalloc_test/%d", i);
+		if (IS_ERR(tdata[i].task)) {
+			pr_err("kthread_run failed for thread %d\n", i);
+			err = PTR_ERR(tdata[i].task);
+			tdata[i].task = NULL;
+			break;
+		}
+		started++;
+	}
+
+	/* let the threads which did start run to completion */
+	for (i = started; i < nr_threads; i++) {
+		if (atomic_dec_and_test(&startup_count))
+			complete(&startup);
+		if (atomic_dec_and_test(&done_count))
+			complete(&done);
+	}
+	wait_for_completion(&done);
+
+	for (i = 0; i < started; i++) {
+		kthread_stop(tdata[i].task);
+
+		if (tdata[i].err && !err)
+			err = tdata[i].err;
+		alloc_ns += tdata[i].alloc_ns;
+		free_ns += tdata[i].free_ns;
+		nr_alloc += tdata[i].nr_alloc;
+		nr_corrupt += tdata[i].nr_corrupt;
+	}
+
+	pr_info("%lu objects, alloc %llu ns/obj, free %llu ns/obj, pool %lu pages after runs\n",
+		nr_alloc, nr_alloc ? div64_u64(alloc_ns, nr_alloc) : 0,
+		nr_alloc ? div64_u64(free_ns, nr_alloc) : 0,
+		zs_get_total_pages(pool));
+
+	if (nr_corrupt) {
+		pr_err("%lu corrupted objects\n", nr_corrupt);
+		err = -EINVAL;
+	}
+
+out_free:
+	for (i = 0; i < nr_threads; i++) {
+		vfree(tdata[i].handles);
+		vfree(tdata[i].sizes);
+	}
+	vfree(tdata);
+out_pool:
+	zs_destroy_pool(pool);
+
+	return err;
+}
+
+static void __exit test_zsmalloc_exit(void)
+{
+}
+
+module_init(test_zsmalloc_init);
+module_exit(test_zsmalloc_exit);
+
+MODULE_LICENSE("GPL v2");
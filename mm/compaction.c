@@ -1592,6 +1592,63 @@ typedef enum {
  */
 int sysctl_compact_unevictable_allowed __read_mostly = 1;
 
+/*
+ * Tunable for proactive compaction. It determines how aggressively
+ * kcompactd keeps the external fragmentation of the zones low, 0 disables
+ * it.
+ */
+int sysctl_compaction_proactiveness __read_mostly;
+/* Time budget of a proactive compaction pass, in ms */
+int sysctl_compaction_proactive_budget_ms __read_mostly = 50;
+
+/* Period at which kcompactd checks if proactive compaction is needed */
+#define PROACTIVE_COMPACT_INTERVAL_MSEC	500
+
+/*
+ * The fragmentation score of a zone is its external fragmentation wrt
+ * COMPACTION_PROACTIVE_ORDER, in the range [0, 100].
+ */
+unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	return extfrag_for_order(zone, COMPACTION_PROACTIVE_ORDER);
+}
+
+/*
+ * Proactive compaction starts on a zone whose score is above the high
+ * watermark and stops once it is at or below the low one.
+ */
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low;
+
+	wmark_low = max(100U - READ_ONCE(sysctl_compaction_proactiveness), 5U);
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+/*
+ * The kswapd threads may be stopped at any time by the kswapd scaler, which
+ * waits for an RCU grace period after clearing their slot.
+ */
+static bool kswapd_is_running(pg_data_t *pgdat)
+{
+	bool running = false;
+	int hid;
+
+	rcu_read_lock();
+	for (hid = 0; hid < MAX_KSWAPD_THREADS; hid++) {
+		struct task_struct *tsk = READ_ONCE(pgdat->kswapd[hid]);
+
+		/* a slot holds an error while its thread fails to start */
+		if (!IS_ERR_OR_NULL(tsk) && tsk->state == TASK_RUNNING) {
+			running = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return running;
+}
+
 static inline void
 update_fast_start_pfn(struct compact_control *cc, unsigned long pfn)
 {
@@ -1873,6 +1930,22 @@ static enum compact_result __compact_finished(struct compact_control *cc)
 			return COMPACT_PARTIAL_SKIPPED;
 	}
 
+	if (cc->proactive_compaction) {
+		/* Leave the CPU and the free pages to reclaim */
+		if (kswapd_is_running(cc->zone->zone_pgdat) ||
+		    time_after(jiffies, cc->deadline))
+			return COMPACT_PARTIAL_SKIPPED;
+
+		if (fragmentation_score_zone(cc->zone) <=
+		    fragmentation_score_wmark(true))
+			return COMPACT_SUCCESS;
+
+		if (cc->contended)
+			return COMPACT_CONTENDED;
+
+		return COMPACT_CONTINUE;
+	}
+
 	if (is_via_compact_memory(cc->order))
 		return COMPACT_CONTINUE;
 
@@ -2436,6 +2509,80 @@ static void compact_node(int nid)
 	}
 }
 
+static bool proactive_compact_zone_suitable(struct zone *zone)
+{
+	unsigned long watermark;
+
+	if (!populated_zone(zone))
+		return false;
+
+	/* Compaction needs free pages to migrate to */
+	watermark = low_wmark_pages(zone) +
+		    compact_gap(COMPACTION_PROACTIVE_ORDER);
+	if (zone_page_state(zone, NR_FREE_PAGES) < watermark)
+		return false;
+
+	return fragmentation_score_zone(zone) > fragmentation_score_wmark(false);
+}
+
+/*
+ * Compact the zones of a node above their fragmentation score target for
+ * at most sysctl_compaction_proactive_budget_ms. The scanners resume from
+ * their cached positions, so a zone too big for one pass is compacted
+ * incrementally over the next ones. Returns false if no zone improved.
+ */
+static bool proactive_compact_node(pg_data_t *pgdat)
+{
+	unsigned long deadline = jiffies +
+		msecs_to_jiffies(READ_ONCE(sysctl_compaction_proactive_budget_ms));
+	bool compacted = false, progress = false;
+	int zoneid;
+
+	if (kswapd_is_running(pgdat))
+		return true;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.order = -1,
+			.mode = MIGRATE_SYNC_LIGHT,
+			.gfp_mask = GFP_KERNEL,
+			.proactive_compaction = true,
+			.deadline = deadline,
+			.zone = zone,
+		};
+		unsigned int score;
+
+		if (!proactive_compact_zone_suitable(zone))
+			continue;
+
+		if (kthread_should_stop())
+			break;
+
+		count_compact_event(KCOMPACTD_PROACTIVE);
+		score = fragmentation_score_zone(zone);
+		compact_zone(&cc, NULL);
+		compacted = true;
+		if (fragmentation_score_zone(zone) < score)
+			progress = true;
+
+		count_compact_events(KCOMPACTD_MIGRATE_SCANNED,
+				     cc.total_migrate_scanned);
+		count_compact_events(KCOMPACTD_FREE_SCANNED,
+				     cc.total_free_scanned);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (time_after(jiffies, deadline)) {
+			count_compact_event(KCOMPACTD_PROACTIVE_EXPIRED);
+			break;
+		}
+	}
+
+	return !compacted || progress;
+}
+
 /* Compact all nodes in the system */
 static void compact_nodes(void)
 {
@@ -2472,6 +2619,32 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * Wakes kcompactd up so that it applies the new proactiveness right away
+ * rather than at the end of its current sleep.
+ */
+int compaction_proactiveness_sysctl_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int rc, nid;
+
+	rc = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (rc || !write)
+		return rc;
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		if (!pgdat->kcompactd)
+			continue;
+
+		WRITE_ONCE(pgdat->proactive_compact_trigger, true);
+		wake_up_interruptible(&pgdat->kcompactd_wait);
+	}
+
+	return 0;
+}
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 static ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
@@ -2503,7 +2676,8 @@ void compaction_unregister_node(struct node *node)
 
 static inline bool kcompactd_work_requested(pg_data_t *pgdat)
 {
-	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop() ||
+		READ_ONCE(pgdat->proactive_compact_trigger);
 }
 
 static bool kcompactd_node_suitable(pg_data_t *pgdat)
@@ -2638,6 +2812,7 @@ static int kcompactd(void *p)
 {
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
+	unsigned int proactive_defer = 0;
 
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
 
@@ -2651,14 +2826,39 @@ static int kcompactd(void *p)
 
 	while (!kthread_should_stop()) {
 		unsigned long pflags;
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+
+		if (READ_ONCE(sysctl_compaction_proactiveness))
+			timeout = msecs_to_jiffies(PROACTIVE_COMPACT_INTERVAL_MSEC);
 
 		trace_mm_compaction_kcompactd_sleep(pgdat->node_id);
-		wait_event_freezable(pgdat->kcompactd_wait,
-				kcompactd_work_requested(pgdat));
+		if (READ_ONCE(pgdat->proactive_compact_trigger)) {
+			/* the proactiveness changed, start over */
+			WRITE_ONCE(pgdat->proactive_compact_trigger, false);
+			proactive_defer = 0;
+		} else if (wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout)) {
+			if (READ_ONCE(pgdat->proactive_compact_trigger))
+				continue;
+
+			psi_memstall_enter(&pflags);
+			kcompactd_do_work(pgdat);
+			psi_memstall_leave(&pflags);
+			continue;
+		}
+
+		/* kcompactd wait timeout */
+		if (!READ_ONCE(sysctl_compaction_proactiveness))
+			continue;
+
+		if (proactive_defer) {
+			proactive_defer--;
+			continue;
+		}
 
-		psi_memstall_enter(&pflags);
-		kcompactd_do_work(pgdat);
-		psi_memstall_leave(&pflags);
+		/* Back off if compaction does not lower the score */
+		if (!proactive_compact_node(pgdat))
+			proactive_defer = 1 << COMPACT_MAX_DEFER_SHIFT;
 	}
 
 	return 0;
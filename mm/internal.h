@@ -226,6 +226,8 @@ struct compact_control {
 	bool whole_zone;		/* Whole zone should/has been scanned */
 	bool contended;			/* Signal lock or sched contention */
 	bool rescan;			/* Rescanning the same pageblock */
+	bool proactive_compaction;	/* kcompactd proactive compaction */
+	unsigned long deadline;		/* jiffies proactive compaction stops at */
 };
 
 /*
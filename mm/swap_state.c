@@ -60,6 +60,32 @@ static bool enable_vma_readahead __read_mostly = true;
 #define GET_SWAP_RA_VAL(vma)					\
 	(atomic_long_read(&(vma)->swap_readahead_info) ? : 4)
 
+/*
+ * vma->swap_readahead_pattern packs the hit ratio of the readahead done in
+ * the VMA, as a moving average out of SWAP_RA_SCORE_MAX, with the number of
+ * pages read ahead at the last fault and the hits on them since then.
+ */
+#define SWAP_RA_SCORE_BITS	9
+#define SWAP_RA_SCORE_MAX	(1 << (SWAP_RA_SCORE_BITS - 1))
+/* Below this score, only sequential faults read ahead */
+#define SWAP_RA_SCORE_RANDOM	(SWAP_RA_SCORE_MAX / 8)
+#define SWAP_RA_COUNT_BITS	8
+#define SWAP_RA_COUNT_MAX	((1 << SWAP_RA_COUNT_BITS) - 1)
+
+#define SWAP_RA_PAT_SCORE(v)	((v) & ((1 << SWAP_RA_SCORE_BITS) - 1))
+#define SWAP_RA_PAT_ISSUED(v)	(((v) >> SWAP_RA_SCORE_BITS) & SWAP_RA_COUNT_MAX)
+#define SWAP_RA_PAT_HITS(v)						\
+	(((v) >> (SWAP_RA_SCORE_BITS + SWAP_RA_COUNT_BITS)) & SWAP_RA_COUNT_MAX)
+
+#define SWAP_RA_PAT_VAL(score, issued, hits)				\
+	((score) | ((issued) << SWAP_RA_SCORE_BITS) |			\
+	 ((hits) << (SWAP_RA_SCORE_BITS + SWAP_RA_COUNT_BITS)))
+
+/* New VMAs start in the middle, the score is never 0 otherwise */
+#define GET_SWAP_RA_PAT(vma)					\
+	(atomic_read(&(vma)->swap_readahead_pattern) ? :	\
+	 SWAP_RA_PAT_VAL(SWAP_RA_SCORE_MAX / 2, 0, 0))
+
 #define INC_CACHE_INFO(x)	do { swap_cache_info.x++; } while (0)
 #define ADD_CACHE_INFO(x, nr)	do { swap_cache_info.x += (nr); } while (0)
 
@@ -385,6 +411,65 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	release_pages(pagep, nr);
 }
 
+/*
+ * Called when a page read ahead in @vma is faulted in. Like
+ * swap_readahead_info, the pattern is updated without atomicity: a lost
+ * update only makes the estimate less accurate.
+ */
+static void swap_ra_hit(struct vm_area_struct *vma)
+{
+	int val = GET_SWAP_RA_PAT(vma);
+
+	if (SWAP_RA_PAT_HITS(val) < SWAP_RA_COUNT_MAX)
+		atomic_set(&vma->swap_readahead_pattern,
+			   val + SWAP_RA_PAT_VAL(0, 0, 1));
+	if (vma->vm_mm)
+		atomic_long_inc(&vma->vm_mm->swap_ra.hits);
+}
+
+/*
+ * Folds the hits on the pages read ahead at the previous fault in @vma into
+ * its score, and returns the readahead window to use instead of @win: 1 if
+ * the VMA is accessed randomly, unless this fault is @adjacent to the
+ * previous one, and half of it while less than half of the readahead hits.
+ */
+static unsigned int swap_ra_learn(struct vm_area_struct *vma, bool adjacent,
+				  unsigned int win)
+{
+	int val = GET_SWAP_RA_PAT(vma);
+	unsigned int score = SWAP_RA_PAT_SCORE(val);
+	unsigned int issued = SWAP_RA_PAT_ISSUED(val);
+	unsigned int hits = min_t(unsigned int, SWAP_RA_PAT_HITS(val), issued);
+
+	if (issued)
+		score = (score * 3 + hits * SWAP_RA_SCORE_MAX / issued) / 4;
+	else if (adjacent)
+		/* sequential faults while readahead was off, try it again */
+		score = min_t(unsigned int, score + SWAP_RA_SCORE_MAX / 8,
+			      SWAP_RA_SCORE_MAX);
+	score = max(score, 1U);
+	atomic_set(&vma->swap_readahead_pattern, SWAP_RA_PAT_VAL(score, 0, 0));
+
+	if (score < SWAP_RA_SCORE_RANDOM && !adjacent)
+		return 1;
+	if (score < SWAP_RA_SCORE_MAX / 2)
+		return max(win / 2, 1U);
+	return win;
+}
+
+/* Records the number of pages read ahead by a fault in @vma */
+static void swap_ra_issued(struct vm_area_struct *vma, unsigned int nr)
+{
+	int val = GET_SWAP_RA_PAT(vma);
+
+	atomic_set(&vma->swap_readahead_pattern,
+		   SWAP_RA_PAT_VAL(SWAP_RA_PAT_SCORE(val),
+				   min_t(unsigned int, nr,
+					 SWAP_RA_COUNT_MAX), 0));
+	if (vma->vm_mm)
+		atomic_long_add(nr, &vma->vm_mm->swap_ra.pages);
+}
+
 static inline bool swap_use_vma_readahead(void)
 {
 	return READ_ONCE(enable_vma_readahead) && !atomic_read(&nr_rotate_swap);
@@ -434,6 +519,8 @@ struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
 			count_vm_event(SWAP_RA_HIT);
 			if (!vma || !vma_ra)
 				atomic_inc(&swapin_readahead_hits);
+			if (vma)
+				swap_ra_hit(vma);
 		}
 	}
 
@@ -653,8 +740,20 @@ struct page *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	bool do_poll = true, page_allocated;
 	struct vm_area_struct *vma = vmf->vma;
 	unsigned long addr = vmf->address;
+	unsigned int nr_ra = 0;
 
 	mask = swapin_nr_pages(offset) - 1;
+	/* shmem passes a pseudo VMA, without history */
+	if (mask && vma->vm_mm) {
+		unsigned long ra_val = GET_SWAP_RA_VAL(vma);
+		long delta = PFN_DOWN(addr) - PFN_DOWN(SWAP_RA_ADDR(ra_val));
+
+		/* swap_readahead_info only keeps the address of the fault */
+		atomic_long_set(&vma->swap_readahead_info,
+				SWAP_RA_VAL(addr, 0, 0));
+		mask = swap_ra_learn(vma, delta == 1 || delta == -1,
+				     mask + 1) - 1;
+	}
 	if (!mask)
 		goto skip;
 
@@ -684,12 +783,15 @@ struct page *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			if (offset != entry_offset) {
 				SetPageReadahead(page);
 				count_vm_event(SWAP_RA);
+				nr_ra++;
 			}
 		}
 		put_page(page);
 	}
 	blk_finish_plug(&plug);
 
+	if (vma->vm_mm)
+		swap_ra_issued(vma, nr_ra);
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 skip:
 	return read_swap_cache_async(entry, gfp_mask, vma, addr, do_poll);
@@ -776,8 +878,9 @@ static void swap_ra_info(struct vm_fault *vmf,
 	pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
 	prev_win = SWAP_RA_WIN(ra_val);
 	hits = SWAP_RA_HITS(ra_val);
-	ra_info->win = win = __swapin_nr_pages(pfn, fpfn, hits,
-					       max_win, prev_win);
+	win = __swapin_nr_pages(pfn, fpfn, hits, max_win, prev_win);
+	ra_info->win = win = swap_ra_learn(vma, fpfn == pfn + 1 ||
+					   pfn == fpfn + 1, win);
 	atomic_long_set(&vma->swap_readahead_info,
 			SWAP_RA_VAL(faddr, win, 0));
 
@@ -818,7 +921,7 @@ static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 	struct page *page;
 	pte_t *pte, pentry;
 	swp_entry_t entry;
-	unsigned int i;
+	unsigned int i, nr_ra = 0;
 	bool page_allocated;
 	struct vma_swap_readahead ra_info = {0,};
 
@@ -846,11 +949,13 @@ static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 			if (i != ra_info.offset) {
 				SetPageReadahead(page);
 				count_vm_event(SWAP_RA);
+				nr_ra++;
 			}
 		}
 		put_page(page);
 	}
 	blk_finish_plug(&plug);
+	swap_ra_issued(vma, nr_ra);
 	lru_add_drain();
 skip:
 	return read_swap_cache_async(fentry, gfp_mask, vma, vmf->address,
@@ -872,6 +977,9 @@ static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 				struct vm_fault *vmf)
 {
+	if (vmf->vma->vm_mm)
+		atomic_long_inc(&vmf->vma->vm_mm->swap_ra.faults);
+
 	return swap_use_vma_readahead() ?
 			swap_vma_readahead(entry, gfp_mask, vmf) :
 			swap_cluster_readahead(entry, gfp_mask, vmf);
@@ -16,6 +16,7 @@
 
 #include <linux/mm.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/cputime.h>
 #include <linux/module.h>
 #include <linux/gfp.h>
 #include <linux/kernel_stat.h>
@@ -112,6 +113,8 @@ struct scan_control {
 	unsigned int memcgs_need_aging:1;
 	unsigned int memcgs_need_swapping:1;
 	unsigned int memcgs_avoid_swapping:1;
+	/* reclaiming from lru_gen_proactive, accounted as background reclaim */
+	unsigned int proactive:1;
 #endif
 
 	/* Allocation order */
@@ -4104,6 +4107,42 @@ void lru_gen_look_around(struct page_vma_mapped_walk *pvmw)
 	mem_cgroup_unlock_pages();
 }
 
+/**
+ * lru_gen_page_age - locate a mapped page in the multi-gen LRU
+ * @page: the head page
+ * @idle: where to store the minimum time, in jiffies, the page has been idle
+ *
+ * Returns how many generations the page is older than the youngest one of its
+ * lruvec, or -1 if the page is not on the multi-gen LRU. A page is at least as
+ * idle as the generation it would have been promoted to if it had been found
+ * accessed, i.e., the next younger one.
+ */
+int lru_gen_page_age(struct page *page, unsigned long *idle)
+{
+	int gen, age;
+	struct lruvec *lruvec;
+	unsigned long max_seq;
+
+	VM_BUG_ON_PAGE(PageTail(page), page);
+
+	gen = page_lru_gen(page);
+	if (gen < 0 || !PageLRU(page))
+		return -1;
+
+	rcu_read_lock();
+	lruvec = mem_cgroup_page_lruvec(page, page_pgdat(page));
+	max_seq = READ_ONCE(lruvec->lrugen.max_seq);
+	age = (lru_gen_from_seq(max_seq) - gen + MAX_NR_GENS) % MAX_NR_GENS;
+	*idle = 0;
+	if (age) {
+		gen = (gen + 1) % MAX_NR_GENS;
+		*idle = jiffies - READ_ONCE(lruvec->lrugen.timestamps[gen]);
+	}
+	rcu_read_unlock();
+
+	return age;
+}
+
 /******************************************************************************
  *                          the eviction
  ******************************************************************************/
@@ -4247,7 +4286,7 @@ static int scan_pages(struct lruvec *lruvec, struct scan_control *sc,
 			break;
 	}
 
-	item = current_is_kswapd() ? PGSCAN_KSWAPD : PGSCAN_DIRECT;
+	item = current_is_kswapd() || sc->proactive ? PGSCAN_KSWAPD : PGSCAN_DIRECT;
 	if (global_reclaim(sc)) {
 		__count_vm_events(item, isolated);
 		__count_vm_events(PGREFILL, sorted);
@@ -4407,7 +4446,7 @@ static int evict_pages(struct lruvec *lruvec, struct scan_control *sc, int swapp
 	if (walk && walk->batched)
 		reset_batch_size(lruvec, walk);
 
-	item = current_is_kswapd() ? PGSTEAL_KSWAPD : PGSTEAL_DIRECT;
+	item = current_is_kswapd() || sc->proactive ? PGSTEAL_KSWAPD : PGSTEAL_DIRECT;
 	if (global_reclaim(sc))
 		__count_vm_events(item, reclaimed);
 	__count_memcg_events(memcg, item, reclaimed);
@@ -4680,10 +4719,311 @@ static void lru_gen_change_state(bool enable)
 	cgroup_unlock();
 }
 
+/******************************************************************************
+ *                          proactive reclaim
+ ******************************************************************************/
+
+/*
+ * lru_gen_proactive ages memcgs which haven't been aged for proactive_cold_ms
+ * and evicts their generations older than that until each node has
+ * proactive_headroom_kb free memory above its high watermarks. It runs at the
+ * lowest priority and consumes at most proactive_budget_ms of CPU time per
+ * second, so that allocations after an idle period find memory ready instead
+ * of paying for the aging and the eviction in direct reclaim.
+ */
+static unsigned long lru_gen_proactive_headroom __read_mostly;
+static unsigned int lru_gen_proactive_budget __read_mostly = 10;
+static unsigned long lru_gen_proactive_cold __read_mostly = 10 * HZ;
+
+static unsigned long lru_gen_proactive_aged;
+static unsigned long lru_gen_proactive_reclaimed;
+static unsigned long lru_gen_proactive_throttled;
+
+static DECLARE_WAIT_QUEUE_HEAD(lru_gen_proactive_wait);
+
+struct proactive_budget {
+	unsigned long period;
+	u64 runtime;
+};
+
+static void proactive_budget_reset(struct proactive_budget *budget)
+{
+	budget->period = jiffies;
+	budget->runtime = task_sched_runtime(current);
+}
+
+/* returns true if the thread should stop */
+static bool proactive_throttle(struct proactive_budget *budget)
+{
+	u64 limit = (u64)READ_ONCE(lru_gen_proactive_budget) * NSEC_PER_MSEC;
+	unsigned long end = budget->period + HZ;
+
+	cond_resched();
+
+	if (time_after_eq(jiffies, end)) {
+		proactive_budget_reset(budget);
+	} else if (task_sched_runtime(current) - budget->runtime >= limit) {
+		lru_gen_proactive_throttled++;
+		schedule_timeout_idle(end - jiffies);
+		proactive_budget_reset(budget);
+	}
+
+	return kthread_should_stop();
+}
+
+static bool proactive_node_short(struct pglist_data *pgdat, unsigned long headroom)
+{
+	int i;
+	unsigned long free = 0;
+	unsigned long wmark = 0;
+
+	for (i = 0; i < MAX_NR_ZONES; i++) {
+		struct zone *zone = pgdat->node_zones + i;
+
+		if (!managed_zone(zone))
+			continue;
+
+		free += zone_page_state(zone, NR_FREE_PAGES);
+		wmark += high_wmark_pages(zone);
+	}
+
+	return free < wmark + headroom;
+}
+
+static bool proactive_age_lruvec(struct lruvec *lruvec, struct scan_control *sc,
+				 unsigned long cold)
+{
+	bool need_aging;
+	int swappiness = get_swappiness(lruvec, sc);
+	int gen;
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	DEFINE_MAX_SEQ(lruvec);
+	DEFINE_MIN_SEQ(lruvec);
+
+	gen = lru_gen_from_seq(max_seq);
+	if (time_is_after_jiffies(READ_ONCE(lruvec->lrugen.timestamps[gen]) + cold))
+		return false;
+
+	if (mem_cgroup_protected(NULL, memcg) != MEMCG_PROT_NONE)
+		return false;
+
+	if (!get_nr_evictable(lruvec, max_seq, min_seq, swappiness, &need_aging) ||
+	    !need_aging)
+		return false;
+
+	return try_to_inc_max_seq(lruvec, max_seq, sc, swappiness, false);
+}
+
+static int proactive_evict_lruvec(struct lruvec *lruvec, struct scan_control *sc,
+				  unsigned long cold)
+{
+	int swappiness = get_swappiness(lruvec, sc);
+	int gen;
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	DEFINE_MAX_SEQ(lruvec);
+	DEFINE_MIN_SEQ(lruvec);
+
+	if (min_seq[!swappiness] + MIN_NR_GENS > max_seq)
+		return 0;
+
+	gen = lru_gen_from_seq(min_seq[!swappiness]);
+	if (time_is_after_jiffies(READ_ONCE(lruvec->lrugen.timestamps[gen]) + cold))
+		return 0;
+
+	if (mem_cgroup_protected(NULL, memcg) != MEMCG_PROT_NONE)
+		return 0;
+
+	return evict_pages(lruvec, sc, swappiness, NULL);
+}
+
+/* returns true if the thread should stop */
+static bool proactive_reclaim_node(struct pglist_data *pgdat,
+				   struct proactive_budget *budget)
+{
+	bool progress;
+	struct mem_cgroup *memcg;
+	unsigned long cold = READ_ONCE(lru_gen_proactive_cold);
+	unsigned long headroom = READ_ONCE(lru_gen_proactive_headroom);
+	struct scan_control sc = {
+		.nr_to_reclaim = SWAP_CLUSTER_MAX,
+		.gfp_mask = GFP_KERNEL,
+		.reclaim_idx = MAX_NR_ZONES - 1,
+		.priority = DEF_PRIORITY,
+		.may_writepage = true,
+		.may_unmap = true,
+		.may_swap = true,
+		.proactive = true,
+	};
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		if (proactive_age_lruvec(mem_cgroup_lruvec(pgdat, memcg), &sc, cold))
+			lru_gen_proactive_aged++;
+
+		if (proactive_throttle(budget)) {
+			mem_cgroup_iter_break(NULL, memcg);
+			return true;
+		}
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+
+	do {
+		progress = false;
+
+		memcg = mem_cgroup_iter(NULL, NULL, NULL);
+		do {
+			if (!proactive_node_short(pgdat, headroom)) {
+				mem_cgroup_iter_break(NULL, memcg);
+				return false;
+			}
+
+			sc.nr_reclaimed = 0;
+			if (proactive_evict_lruvec(mem_cgroup_lruvec(pgdat, memcg), &sc, cold))
+				progress = true;
+			lru_gen_proactive_reclaimed += sc.nr_reclaimed;
+
+			if (proactive_throttle(budget)) {
+				mem_cgroup_iter_break(NULL, memcg);
+				return true;
+			}
+		} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+	} while (progress);
+
+	return false;
+}
+
+static int lru_gen_proactive(void *unused)
+{
+	int nid;
+	unsigned int flags;
+	struct proactive_budget budget;
+	struct reclaim_state rs = {};
+
+	set_user_nice(current, MAX_NICE);
+	set_freezable();
+
+	rs.mm_walk = kzalloc(sizeof(*rs.mm_walk), GFP_KERNEL);
+	if (!rs.mm_walk)
+		return -ENOMEM;
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(lru_gen_proactive_wait,
+				     kthread_should_stop() ||
+				     READ_ONCE(lru_gen_proactive_headroom));
+		if (kthread_should_stop())
+			break;
+
+		proactive_budget_reset(&budget);
+
+		current->reclaim_state = &rs;
+		flags = memalloc_noreclaim_save();
+		lru_add_drain();
+
+		for_each_node_state(nid, N_MEMORY) {
+			if (!get_cap(LRU_GEN_CORE) ||
+			    proactive_reclaim_node(NODE_DATA(nid), &budget))
+				break;
+		}
+
+		memalloc_noreclaim_restore(flags);
+		current->reclaim_state = NULL;
+
+		/* one pass per period at most */
+		if (time_before(jiffies, budget.period + HZ))
+			schedule_timeout_idle(budget.period + HZ - jiffies);
+	}
+
+	kfree(rs.mm_walk);
+
+	return 0;
+}
+
 /******************************************************************************
  *                          sysfs interface
  ******************************************************************************/
 
+static ssize_t show_proactive_headroom(struct kobject *kobj, struct kobj_attribute *attr,
+				       char *buf)
+{
+	return sprintf(buf, "%lu\n", READ_ONCE(lru_gen_proactive_headroom) << (PAGE_SHIFT - 10));
+}
+
+static ssize_t store_proactive_headroom(struct kobject *kobj, struct kobj_attribute *attr,
+					const char *buf, size_t len)
+{
+	unsigned long kbytes;
+
+	if (kstrtoul(buf, 0, &kbytes))
+		return -EINVAL;
+
+	WRITE_ONCE(lru_gen_proactive_headroom, kbytes >> (PAGE_SHIFT - 10));
+	wake_up_interruptible(&lru_gen_proactive_wait);
+
+	return len;
+}
+
+static struct kobj_attribute lru_gen_proactive_headroom_attr = __ATTR(
+	proactive_headroom_kb, 0644, show_proactive_headroom, store_proactive_headroom
+);
+
+static ssize_t show_proactive_budget(struct kobject *kobj, struct kobj_attribute *attr,
+				     char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(lru_gen_proactive_budget));
+}
+
+static ssize_t store_proactive_budget(struct kobject *kobj, struct kobj_attribute *attr,
+				      const char *buf, size_t len)
+{
+	unsigned int msecs;
+
+	if (kstrtouint(buf, 0, &msecs) || !msecs || msecs > MSEC_PER_SEC)
+		return -EINVAL;
+
+	WRITE_ONCE(lru_gen_proactive_budget, msecs);
+
+	return len;
+}
+
+static struct kobj_attribute lru_gen_proactive_budget_attr = __ATTR(
+	proactive_budget_ms, 0644, show_proactive_budget, store_proactive_budget
+);
+
+static ssize_t show_proactive_cold(struct kobject *kobj, struct kobj_attribute *attr,
+				   char *buf)
+{
+	return sprintf(buf, "%u\n", jiffies_to_msecs(READ_ONCE(lru_gen_proactive_cold)));
+}
+
+static ssize_t store_proactive_cold(struct kobject *kobj, struct kobj_attribute *attr,
+				    const char *buf, size_t len)
+{
+	unsigned int msecs;
+
+	if (kstrtouint(buf, 0, &msecs))
+		return -EINVAL;
+
+	WRITE_ONCE(lru_gen_proactive_cold, msecs_to_jiffies(msecs));
+
+	return len;
+}
+
+static struct kobj_attribute lru_gen_proactive_cold_attr = __ATTR(
+	proactive_cold_ms, 0644, show_proactive_cold, store_proactive_cold
+);
+
+static ssize_t show_proactive_stat(struct kobject *kobj, struct kobj_attribute *attr,
+				   char *buf)
+{
+	return sprintf(buf, "aged %lu\nreclaimed %lu\nthrottled %lu\n",
+		       READ_ONCE(lru_gen_proactive_aged),
+		       READ_ONCE(lru_gen_proactive_reclaimed),
+		       READ_ONCE(lru_gen_proactive_throttled));
+}
+
+static struct kobj_attribute lru_gen_proactive_stat_attr = __ATTR(
+	proactive_stat, 0444, show_proactive_stat, NULL
+);
+
 static ssize_t show_min_ttl(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
 {
 	return sprintf(buf, "%u\n", jiffies_to_msecs(READ_ONCE(lru_gen_min_ttl)));
@@ -4766,6 +5106,10 @@ static struct attribute *lru_gen_attrs[] = {
 	&lru_gen_min_ttl_unsatisfied_attr.attr,
 	&lru_gen_min_ttl_attr.attr,
 	&lru_gen_enabled_attr.attr,
+	&lru_gen_proactive_headroom_attr.attr,
+	&lru_gen_proactive_budget_attr.attr,
+	&lru_gen_proactive_cold_attr.attr,
+	&lru_gen_proactive_stat_attr.attr,
 	NULL
 };
 
@@ -5178,6 +5522,9 @@ static int __init init_lru_gen(void)
 	debugfs_create_file("lru_gen", 0644, NULL, NULL, &lru_gen_rw_fops);
 	debugfs_create_file("lru_gen_full", 0444, NULL, NULL, &lru_gen_ro_fops);
 
+	if (IS_ERR(kthread_run(lru_gen_proactive, NULL, "lru_gen_proactive")))
+		pr_err("lru_gen: failed to start the proactive reclaim thread\n");
+
 	return 0;
 };
 late_initcall(init_lru_gen);
@@ -6572,6 +6919,38 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int alloc_order, int reclaim_o
 	finish_wait(&pgdat->kswapd_wait, &wait);
 }
 
+/*
+ * Extra kswapd threads, up to kswapd_threads_max per node, are started on
+ * the little cluster when reclaim falls behind, and put on standby once it
+ * has caught up. They follow the kswapd_threads_current static threads in
+ * pgdat->kswapd[].
+ */
+int kswapd_threads_max;
+
+struct kswapd_scale {
+	/* extra threads reclaiming, the other started ones are on standby */
+	int nr_active;
+	/* consecutive periods without backlog */
+	int nr_idle;
+};
+
+static struct kswapd_scale kswapd_scale[MAX_NUMNODES];
+static DECLARE_WAIT_QUEUE_HEAD(kswapd_standby_wait);
+
+static bool kswapd_standby(pg_data_t *pgdat)
+{
+	int base = READ_ONCE(kswapd_threads_current);
+	int hid;
+
+	for (hid = base; hid < MAX_KSWAPD_THREADS; hid++) {
+		if (pgdat->kswapd[hid] == current)
+			return hid >= base +
+			       READ_ONCE(kswapd_scale[pgdat->node_id].nr_active);
+	}
+
+	return false;
+}
+
 /*
  * The background pageout daemon, started as a kernel thread
  * from the init process.
@@ -6597,7 +6976,8 @@ static int kswapd(void *p)
 	};
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
 
-	if (!cpumask_empty(cpumask))
+	/* the extra threads keep the cluster they were bound to */
+	if (!(tsk->flags & PF_NO_SETAFFINITY) && !cpumask_empty(cpumask))
 		set_cpus_allowed_ptr(tsk, cpumask);
 	current->reclaim_state = &reclaim_state;
 
@@ -6621,6 +7001,15 @@ static int kswapd(void *p)
 	for ( ; ; ) {
 		bool ret;
 
+		if (kswapd_standby(pgdat)) {
+			wait_event_freezable(kswapd_standby_wait,
+					     !kswapd_standby(pgdat) ||
+					     kthread_should_stop());
+			if (kthread_should_stop())
+				break;
+			continue;
+		}
+
 		alloc_order = reclaim_order = READ_ONCE(pgdat->kswapd_order);
 		classzone_idx = kswapd_classzone_idx(pgdat, classzone_idx);
 
@@ -6784,6 +7173,32 @@ static int kswapd_cpu_online(unsigned int cpu)
 	return 0;
 }
 
+/*
+ * Stops a kswapd thread of @pgdat. kswapd_is_running() looks at the threads
+ * under RCU only, so the slot is cleared and readers waited for before the
+ * thread is stopped and possibly freed.
+ */
+static void kswapd_stop_thread(pg_data_t *pgdat, int hid)
+{
+	struct task_struct *tsk = pgdat->kswapd[hid];
+
+	if (!tsk)
+		return;
+
+	WRITE_ONCE(pgdat->kswapd[hid], NULL);
+	synchronize_rcu();
+	kthread_stop(tsk);
+}
+
+/* Stops the extra threads of @pgdat from index @from */
+static void kswapd_scale_stop(pg_data_t *pgdat, int from)
+{
+	int hid;
+
+	for (hid = from; hid < MAX_KSWAPD_THREADS; hid++)
+		kswapd_stop_thread(pgdat, hid);
+}
+
 static void update_kswapd_threads_node(int nid)
 {
 	pg_data_t *pgdat;
@@ -6792,15 +7207,14 @@ static void update_kswapd_threads_node(int nid)
 	int nr_threads = kswapd_threads_current;
 
 	pgdat = NODE_DATA(nid);
+	/* the extra threads are indexed after the static ones */
+	kswapd_scale_stop(pgdat, nr_threads);
+	kswapd_scale[nid].nr_active = 0;
 	last_idx = nr_threads - 1;
 	if (kswapd_threads < nr_threads) {
 		drop = nr_threads - kswapd_threads;
-		for (hid = last_idx; hid > (last_idx - drop); hid--) {
-			if (pgdat->kswapd[hid]) {
-				kthread_stop(pgdat->kswapd[hid]);
-				pgdat->kswapd[hid] = NULL;
-			}
-		}
+		for (hid = last_idx; hid > (last_idx - drop); hid--)
+			kswapd_stop_thread(pgdat, hid);
 	} else {
 		increase = kswapd_threads - nr_threads;
 		start_idx = last_idx + 1;
@@ -6842,6 +7256,136 @@ void update_kswapd_threads(void)
 	mem_hotplug_done();
 }
 
+/* period of the evaluation of the reclaim backlog */
+#define KSWAPD_SCALE_PERIOD	(HZ / 2)
+/* memory stall time per period, in ns, telling that reclaim is behind */
+#define KSWAPD_SCALE_STALL_NS	(10 * NSEC_PER_MSEC)
+/* periods without backlog before putting a thread on standby */
+#define KSWAPD_SCALE_IDLE	4
+
+static void kswapd_scale_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(kswapd_scale_work, kswapd_scale_fn);
+
+/* Pages missing for the zones of @pgdat to reach their high watermark */
+static unsigned long pgdat_wmark_backlog(pg_data_t *pgdat)
+{
+	unsigned long backlog = 0;
+	int i;
+
+	for (i = 0; i < MAX_NR_ZONES; i++) {
+		struct zone *zone = pgdat->node_zones + i;
+		unsigned long free, high;
+
+		if (!managed_zone(zone))
+			continue;
+
+		free = zone_page_state(zone, NR_FREE_PAGES);
+		high = high_wmark_pages(zone);
+		if (free < high)
+			backlog += high - free;
+	}
+
+	return backlog;
+}
+
+/* Number of direct reclaims of all the zones types */
+static unsigned long allocstall_events(void)
+{
+	unsigned long sum = 0;
+#ifdef CONFIG_VM_EVENT_COUNTERS
+	int cpu, zid;
+
+	for_each_online_cpu(cpu) {
+		struct vm_event_state *this = &per_cpu(vm_event_states, cpu);
+
+		for (zid = 0; zid <= ZONE_MOVABLE; zid++)
+			sum += this->event[ALLOCSTALL_NORMAL - ZONE_NORMAL + zid];
+	}
+#endif
+	return sum;
+}
+
+static void kswapd_scale_node(pg_data_t *pgdat, int nr_max, bool stalling)
+{
+	struct kswapd_scale *ks = &kswapd_scale[pgdat->node_id];
+	unsigned long backlog = pgdat_wmark_backlog(pgdat);
+	int base = kswapd_threads_current;
+	int nr = ks->nr_active;
+	int hid;
+
+	if (backlog && stalling &&
+	    pgdat->kswapd_failures < MAX_RECLAIM_RETRIES) {
+		nr++;
+		ks->nr_idle = 0;
+	} else if (!backlog && ++ks->nr_idle >= KSWAPD_SCALE_IDLE) {
+		nr--;
+		ks->nr_idle = 0;
+	}
+	nr = clamp(nr, 0, nr_max);
+
+	/* threads are started the first time they are needed */
+	for (hid = base; hid < base + nr; hid++) {
+		struct task_struct *tsk;
+
+		if (pgdat->kswapd[hid])
+			continue;
+
+		tsk = kthread_run_perf_critical(cpu_lp_mask, kswapd, pgdat,
+						"kswapd%d:%d", pgdat->node_id,
+						hid);
+		if (IS_ERR(tsk)) {
+			pr_err("Failed to start kswapd%d on node %d\n",
+			       hid, pgdat->node_id);
+			nr = hid - base;
+			break;
+		}
+		pgdat->kswapd[hid] = tsk;
+	}
+	kswapd_scale_stop(pgdat, base + nr_max);
+
+	if (nr != ks->nr_active) {
+		WRITE_ONCE(ks->nr_active, nr);
+		wake_up_all(&kswapd_standby_wait);
+	}
+}
+
+/*
+ * Adds an extra kswapd thread to the nodes below their high watermark while
+ * tasks are stalled in direct reclaim or on memory according to PSI, and
+ * puts one back on standby after KSWAPD_SCALE_IDLE periods without backlog.
+ */
+static void kswapd_scale_fn(struct work_struct *work)
+{
+	static unsigned long last_stalls;
+	static u64 last_psi;
+	unsigned long stalls = allocstall_events();
+	u64 psi = psi_mem_stall_total();
+	bool stalling;
+	int nr_max, nid;
+
+	stalling = stalls != last_stalls ||
+		   psi - last_psi > KSWAPD_SCALE_STALL_NS;
+	last_stalls = stalls;
+	last_psi = psi;
+
+	get_online_mems();
+	nr_max = max(READ_ONCE(kswapd_threads_max) - kswapd_threads_current,
+		     0);
+	for_each_node_state(nid, N_MEMORY)
+		kswapd_scale_node(NODE_DATA(nid), nr_max, stalling);
+	put_online_mems();
+
+	if (nr_max)
+		queue_delayed_work(system_unbound_wq, &kswapd_scale_work,
+				   KSWAPD_SCALE_PERIOD);
+}
+
+/* Called when kswapd_threads_max changes */
+void kswapd_scale_update(void)
+{
+	mod_delayed_work(system_unbound_wq, &kswapd_scale_work, 0);
+}
+
 
 /*
  * This kswapd start function will be called by init and node-hot-add.
@@ -6879,17 +7423,12 @@ int kswapd_run(int nid)
  */
 void kswapd_stop(int nid)
 {
-	struct task_struct *kswapd;
 	int hid;
-	int nr_threads = kswapd_threads_current;
 
-	for (hid = 0; hid < nr_threads; hid++) {
-		kswapd = NODE_DATA(nid)->kswapd[hid];
-		if (kswapd) {
-			kthread_stop(kswapd);
-			NODE_DATA(nid)->kswapd[hid] = NULL;
-		}
-	}
+	/* the static and the extra threads */
+	for (hid = 0; hid < MAX_KSWAPD_THREADS; hid++)
+		kswapd_stop_thread(NODE_DATA(nid), hid);
+	kswapd_scale[nid].nr_active = 0;
 }
 
 static int __init kswapd_init(void)
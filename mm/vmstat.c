@@ -1081,6 +1081,24 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+/*
+ * Calculates external fragmentation within a zone wrt the given order.
+ * It is defined as the percentage of pages found in blocks of size
+ * less than 1 << order. It returns values in range [0, 100].
+ */
+unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	if (info.free_pages == 0)
+		return 0;
+
+	return div_u64((info.free_pages -
+			(info.free_blocks_suitable << order)) * 100,
+			info.free_pages);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_SYSFS) || defined(CONFIG_NUMA)
@@ -1241,6 +1259,8 @@ const char * const vmstat_text[] = {
 	"compact_daemon_wake",
 	"compact_daemon_migrate_scanned",
 	"compact_daemon_free_scanned",
+	"compact_daemon_proactive",
+	"compact_daemon_proactive_expired",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -2132,6 +2152,46 @@ static const struct file_operations extfrag_file_ops = {
 	.release	= seq_release,
 };
 
+static void fragmentation_score_show_print(struct seq_file *m,
+					pg_data_t *pgdat, struct zone *zone)
+{
+	seq_printf(m, "Node %d, zone %8s %u\n", pgdat->node_id, zone->name,
+		   fragmentation_score_zone(zone));
+}
+
+/*
+ * Display the external fragmentation score proactive compaction keeps
+ * each zone below, see vm.compaction_proactiveness
+ */
+static int fragmentation_score_show(struct seq_file *m, void *arg)
+{
+	pg_data_t *pgdat = (pg_data_t *)arg;
+
+	walk_zones_in_node(m, pgdat, true, false,
+			   fragmentation_score_show_print);
+
+	return 0;
+}
+
+static const struct seq_operations fragmentation_score_op = {
+	.start	= frag_start,
+	.next	= frag_next,
+	.stop	= frag_stop,
+	.show	= fragmentation_score_show,
+};
+
+static int fragmentation_score_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &fragmentation_score_op);
+}
+
+static const struct file_operations fragmentation_score_file_ops = {
+	.open		= fragmentation_score_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
 static int __init extfrag_debug_init(void)
 {
 	struct dentry *extfrag_debug_root;
@@ -2148,6 +2208,10 @@ static int __init extfrag_debug_init(void)
 			extfrag_debug_root, NULL, &extfrag_file_ops))
 		goto fail;
 
+	if (!debugfs_create_file("fragmentation_score", 0444,
+			extfrag_debug_root, NULL, &fragmentation_score_file_ops))
+		goto fail;
+
 	return 0;
 fail:
 	debugfs_remove_recursive(extfrag_debug_root);
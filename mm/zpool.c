@@ -278,6 +278,59 @@ void zpool_free(struct zpool *zpool, unsigned long handle)
 	zpool->driver->free(zpool->pool, handle);
 }
 
+/**
+ * zpool_malloc_bulk() - Allocate memory in batch
+ * @zpool:	The zpool to allocate from.
+ * @size:	The amount of memory to allocate for each handle.
+ * @gfp:	The GFP flags to use when allocating memory.
+ * @handles:	Array of @nr handles to set
+ * @nr:	The number of allocations
+ *
+ * This is zpool_malloc() for @nr allocations of the same size, which
+ * implementations may serve at a lower cost than separate calls.
+ *
+ * Implementations must guarantee this to be thread-safe.
+ *
+ * Returns: the number of handles set, which is less than @nr only on error.
+ */
+int zpool_malloc_bulk(struct zpool *zpool, size_t size, gfp_t gfp,
+			unsigned long *handles, int nr)
+{
+	int i;
+
+	if (zpool->driver->malloc_bulk)
+		return zpool->driver->malloc_bulk(zpool->pool, size, gfp,
+						  handles, nr);
+
+	for (i = 0; i < nr; i++) {
+		if (zpool->driver->malloc(zpool->pool, size, gfp, &handles[i]))
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * zpool_free_bulk() - Free previously allocated memory in batch
+ * @zpool:	The zpool that allocated the memory.
+ * @handles:	The handles to the memory to free.
+ * @nr:	The number of handles
+ *
+ * This is zpool_free() for @nr handles, with the same requirements.
+ */
+void zpool_free_bulk(struct zpool *zpool, unsigned long *handles, int nr)
+{
+	int i;
+
+	if (zpool->driver->free_bulk) {
+		zpool->driver->free_bulk(zpool->pool, handles, nr);
+		return;
+	}
+
+	for (i = 0; i < nr; i++)
+		zpool->driver->free(zpool->pool, handles[i]);
+}
+
 /**
  * zpool_shrink() - Shrink the pool size
  * @zpool:	The zpool to shrink.
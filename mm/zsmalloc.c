@@ -33,6 +33,7 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <linux/magic.h>
 #include <linux/bitops.h>
 #include <linux/errno.h>
@@ -56,6 +57,8 @@
 #include <linux/wait.h>
 #include <linux/pagemap.h>
 #include <linux/fs.h>
+#include <linux/moduleparam.h>
+#include <linux/workqueue.h>
 
 #define ZSPAGE_MAGIC	0x58
 
@@ -196,6 +199,44 @@ static struct vfsmount *zsmalloc_mnt;
 static const int fullness_threshold_frac = 4;
 static size_t huge_class_size;
 
+/*
+ * Background compaction: once the objects a class has room for but doesn't
+ * use reach bg_compact_ratio percent of its capacity, the class is compacted
+ * by a work item, which frees at most bg_compact_pages pages per run and
+ * runs at most once every bg_compact_interval_ms. A ratio of 0 disables it.
+ */
+static unsigned int bg_compact_ratio = 25;
+module_param(bg_compact_ratio, uint, 0644);
+MODULE_PARM_DESC(bg_compact_ratio, "Fragmentation percentage of a class which triggers background compaction, 0 to disable");
+
+static unsigned int bg_compact_interval_ms = 1000;
+module_param(bg_compact_interval_ms, uint, 0644);
+MODULE_PARM_DESC(bg_compact_interval_ms, "Minimum interval between background compaction runs");
+
+static unsigned int bg_compact_pages = 32;
+module_param(bg_compact_pages, uint, 0644);
+MODULE_PARM_DESC(bg_compact_pages, "Maximum number of pages freed per background compaction run");
+
+/*
+ * Each size class has per CPU magazines of allocated objects. zs_free()
+ * stashes the freed object in the magazine of the local CPU and zs_malloc()
+ * hands it out again without taking the class lock, while an empty magazine
+ * is refilled in batches under a single class lock. Objects in magazines are
+ * allocated as far as compaction and migration are concerned, which is why
+ * the magazines are drained before the class is compacted, but they are not
+ * counted as used when estimating what compaction can free. The magazines of
+ * a CPU going offline are drained. A magazine holds at most ZS_MAG_BYTES
+ * worth of objects, and at most ZS_MAG_SIZE of them.
+ */
+#define ZS_MAG_SIZE	16
+#define ZS_MAG_BYTES	(2 * PAGE_SIZE)
+
+struct zs_magazine {
+	spinlock_t lock;
+	int nr;
+	unsigned long handles[ZS_MAG_SIZE];
+};
+
 struct size_class {
 	spinlock_t lock;
 	struct list_head fullness_list[NR_ZS_FULLNESS];
@@ -210,6 +251,14 @@ struct size_class {
 
 	unsigned int index;
 	struct zs_size_stat stats;
+
+	struct zs_magazine __percpu *mags;
+	int mag_capacity;
+	/* Objects stashed in the magazines */
+	atomic_long_t mag_objs;
+	/* Compaction statistics */
+	unsigned long compact_pages;
+	u64 compact_ns;
 };
 
 /* huge object: pages_per_zspage == 1 && maxobj_per_zspage == 1 */
@@ -259,8 +308,14 @@ struct zs_pool {
 
 	struct zs_pool_stats stats;
 
+	/* Drains the magazines of CPUs going offline */
+	struct hlist_node mag_node;
+
 	/* Compact classes */
 	struct shrinker shrinker;
+	/* Background compaction, next class to look at */
+	struct delayed_work compact_work;
+	int compact_class;
 
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
@@ -306,6 +361,7 @@ static int zs_register_migration(struct zs_pool *pool);
 static void zs_unregister_migration(struct zs_pool *pool);
 static void migrate_lock_init(struct zspage *zspage);
 static void migrate_read_lock(struct zspage *zspage);
+static bool migrate_read_trylock(struct zspage *zspage);
 static void migrate_read_unlock(struct zspage *zspage);
 static void kick_deferred_free(struct zs_pool *pool);
 static void init_deferred_free(struct zs_pool *pool);
@@ -317,6 +373,7 @@ static int zs_register_migration(struct zs_pool *pool) { return 0; }
 static void zs_unregister_migration(struct zs_pool *pool) {}
 static void migrate_lock_init(struct zspage *zspage) {}
 static void migrate_read_lock(struct zspage *zspage) {}
+static bool migrate_read_trylock(struct zspage *zspage) { return true; }
 static void migrate_read_unlock(struct zspage *zspage) {}
 static void kick_deferred_free(struct zs_pool *pool) {}
 static void init_deferred_free(struct zs_pool *pool) {}
@@ -411,6 +468,17 @@ static void zs_zpool_free(void *pool, unsigned long handle)
 	zs_free(pool, handle);
 }
 
+static int zs_zpool_malloc_bulk(void *pool, size_t size, gfp_t gfp,
+			unsigned long *handles, int nr)
+{
+	return zs_malloc_bulk(pool, size, gfp, handles, nr);
+}
+
+static void zs_zpool_free_bulk(void *pool, unsigned long *handles, int nr)
+{
+	zs_free_bulk(pool, handles, nr);
+}
+
 static void *zs_zpool_map(void *pool, unsigned long handle,
 			enum zpool_mapmode mm)
 {
@@ -448,6 +516,8 @@ static struct zpool_driver zs_zpool_driver = {
 	.destroy =	zs_zpool_destroy,
 	.malloc =	zs_zpool_malloc,
 	.free =		zs_zpool_free,
+	.malloc_bulk =	zs_zpool_malloc_bulk,
+	.free_bulk =	zs_zpool_free_bulk,
 	.map =		zs_zpool_map,
 	.unmap =	zs_zpool_unmap,
 	.total_size =	zs_zpool_total_size,
@@ -590,6 +660,7 @@ static void __exit zs_stat_exit(void)
 }
 
 static unsigned long zs_can_compact(struct size_class *class);
+static unsigned long zs_objs_used(struct size_class *class);
 
 static int zs_stats_size_show(struct seq_file *s, void *v)
 {
@@ -599,14 +670,18 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 	int objs_per_zspage;
 	unsigned long class_almost_full, class_almost_empty;
 	unsigned long obj_allocated, obj_used, pages_used, freeable;
+	unsigned long compact_pages;
+	u64 compact_ns;
 	unsigned long total_class_almost_full = 0, total_class_almost_empty = 0;
 	unsigned long total_objs = 0, total_used_objs = 0, total_pages = 0;
-	unsigned long total_freeable = 0;
+	unsigned long total_freeable = 0, total_compact_pages = 0;
+	u64 total_compact_ns = 0;
 
-	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s\n",
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s %9s %10s\n",
 			"class", "size", "almost_full", "almost_empty",
 			"obj_allocated", "obj_used", "pages_used",
-			"pages_per_zspage", "freeable");
+			"pages_per_zspage", "freeable", "compacted",
+			"compact_us");
 
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		class = pool->size_class[i];
@@ -618,8 +693,10 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		class_almost_full = zs_stat_get(class, CLASS_ALMOST_FULL);
 		class_almost_empty = zs_stat_get(class, CLASS_ALMOST_EMPTY);
 		obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
-		obj_used = zs_stat_get(class, OBJ_USED);
+		obj_used = zs_objs_used(class);
 		freeable = zs_can_compact(class);
+		compact_pages = class->compact_pages;
+		compact_ns = class->compact_ns;
 		spin_unlock(&class->lock);
 
 		objs_per_zspage = class->objs_per_zspage;
@@ -627,10 +704,11 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 				class->pages_per_zspage;
 
 		seq_printf(s, " %5u %5u %11lu %12lu %13lu"
-				" %10lu %10lu %16d %8lu\n",
+				" %10lu %10lu %16d %8lu %9lu %10llu\n",
 			i, class->size, class_almost_full, class_almost_empty,
 			obj_allocated, obj_used, pages_used,
-			class->pages_per_zspage, freeable);
+			class->pages_per_zspage, freeable, compact_pages,
+			div_u64(compact_ns, NSEC_PER_USEC));
 
 		total_class_almost_full += class_almost_full;
 		total_class_almost_empty += class_almost_empty;
@@ -638,13 +716,17 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		total_used_objs += obj_used;
 		total_pages += pages_used;
 		total_freeable += freeable;
+		total_compact_pages += compact_pages;
+		total_compact_ns += compact_ns;
 	}
 
 	seq_puts(s, "\n");
-	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu\n",
+	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu %9lu %10llu\n",
 			"Total", "", total_class_almost_full,
 			total_class_almost_empty, total_objs,
-			total_used_objs, total_pages, "", total_freeable);
+			total_used_objs, total_pages, "", total_freeable,
+			total_compact_pages,
+			div_u64(total_compact_ns, NSEC_PER_USEC));
 
 	return 0;
 }
@@ -1464,6 +1546,160 @@ static unsigned long obj_malloc(struct size_class *class,
 }
 
 
+static void zs_free_class(struct zs_pool *pool, struct size_class *class,
+			  unsigned long *handles, int nr);
+
+/* Objects in use, those stashed in magazines are free as far as users go */
+static unsigned long zs_objs_used(struct size_class *class)
+{
+	unsigned long obj_used = zs_stat_get(class, OBJ_USED);
+	unsigned long mag_objs = atomic_long_read(&class->mag_objs);
+
+	return obj_used > mag_objs ? obj_used - mag_objs : 0;
+}
+
+/*
+ * Whether the unused objects of a class reach @ratio percent of its capacity
+ * and add up to at least one zspage.
+ */
+static bool zs_class_fragmented(struct size_class *class, unsigned int ratio)
+{
+	unsigned long obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
+	unsigned long obj_used = zs_objs_used(class);
+
+	if (!ratio || obj_allocated < obj_used + class->objs_per_zspage)
+		return false;
+
+	return (obj_allocated - obj_used) * 100 >= obj_allocated * ratio;
+}
+
+static void zs_bg_compact_kick(struct zs_pool *pool)
+{
+	queue_delayed_work(system_unbound_wq, &pool->compact_work,
+			   msecs_to_jiffies(READ_ONCE(bg_compact_interval_ms)));
+}
+
+static unsigned long zs_mag_pop(struct size_class *class)
+{
+	struct zs_magazine *mag = raw_cpu_ptr(class->mags);
+	unsigned long handle = 0;
+
+	spin_lock(&mag->lock);
+	if (mag->nr) {
+		handle = mag->handles[--mag->nr];
+		atomic_long_dec(&class->mag_objs);
+	}
+	spin_unlock(&mag->lock);
+
+	return handle;
+}
+
+/* Returns how many of @nr handles were stashed in the local magazine */
+static int zs_mag_push(struct size_class *class, unsigned long *handles,
+			int nr)
+{
+	struct zs_magazine *mag = raw_cpu_ptr(class->mags);
+	int i;
+
+	spin_lock(&mag->lock);
+	for (i = 0; i < nr && mag->nr < class->mag_capacity; i++)
+		mag->handles[mag->nr++] = handles[i];
+	atomic_long_add(i, &class->mag_objs);
+	spin_unlock(&mag->lock);
+
+	return i;
+}
+
+static int zs_mag_take(struct size_class *class, struct zs_magazine *mag,
+			unsigned long *handles, int nr)
+{
+	spin_lock(&mag->lock);
+	nr = min_t(int, nr, mag->nr);
+	mag->nr -= nr;
+	memcpy(handles, mag->handles + mag->nr, nr * sizeof(*handles));
+	atomic_long_sub(nr, &class->mag_objs);
+	spin_unlock(&mag->lock);
+
+	return nr;
+}
+
+static struct size_class *handle_to_class(struct zs_pool *pool,
+					unsigned long handle)
+{
+	struct zspage *zspage;
+	struct page *page;
+	unsigned int obj_idx;
+	int class_idx;
+	enum fullness_group fullness;
+
+	/* class_idx is constant as long as the object is allocated */
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &page, &obj_idx);
+	zspage = get_zspage(page);
+	get_zspage_mapping(zspage, &class_idx, &fullness);
+	unpin_tag(handle);
+
+	return pool->size_class[class_idx];
+}
+
+/*
+ * Allocate up to @nr objects of @class. With @fill, only the first object is
+ * allowed to need a new zspage, others are taken from the zspages the class
+ * already has. Returns the number of objects allocated.
+ */
+static int zs_malloc_class(struct zs_pool *pool, struct size_class *class,
+			gfp_t gfp, unsigned long *handles, int nr, bool fill)
+{
+	unsigned long obj;
+	struct zspage *zspage;
+	enum fullness_group newfg;
+	int i, allocated = 0;
+
+	for (i = 0; i < nr; i++) {
+		handles[i] = cache_alloc_handle(pool, gfp);
+		if (!handles[i])
+			break;
+	}
+	nr = i;
+
+	while (allocated < nr) {
+		spin_lock(&class->lock);
+		while (allocated < nr && (zspage = find_get_zspage(class))) {
+			obj = obj_malloc(class, zspage, handles[allocated]);
+			/* Now move the zspage to another fullness group, if required */
+			fix_fullness_group(class, zspage);
+			record_obj(handles[allocated++], obj);
+		}
+		spin_unlock(&class->lock);
+
+		if (allocated == nr || (fill && allocated))
+			break;
+
+		zspage = alloc_zspage(pool, class, gfp);
+		if (!zspage)
+			break;
+
+		spin_lock(&class->lock);
+		obj = obj_malloc(class, zspage, handles[allocated]);
+		newfg = get_fullness_group(class, zspage);
+		insert_zspage(class, zspage, newfg);
+		set_zspage_mapping(zspage, class->index, newfg);
+		record_obj(handles[allocated++], obj);
+		atomic_long_add(class->pages_per_zspage,
+					&pool->pages_allocated);
+		zs_stat_inc(class, OBJ_ALLOCATED, class->objs_per_zspage);
+
+		/* We completely set up zspage so mark them as movable */
+		SetZsPageMovable(pool, zspage);
+		spin_unlock(&class->lock);
+	}
+
+	for (i = allocated; i < nr; i++)
+		cache_free_handle(pool, handles[i]);
+
+	return allocated;
+}
+
 /**
  * zs_malloc - Allocate block of given size from pool.
  * @pool: pool to allocate from
@@ -1476,59 +1712,79 @@ static unsigned long obj_malloc(struct size_class *class,
  */
 unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 {
-	unsigned long handle, obj;
+	unsigned long handles[ZS_MAG_SIZE / 2 + 1];
+	unsigned long handle;
 	struct size_class *class;
-	enum fullness_group newfg;
-	struct zspage *zspage;
+	int nr;
 
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
-	handle = cache_alloc_handle(pool, gfp);
-	if (!handle)
-		return 0;
-
 	/* extra space in chunk to keep the handle */
 	size += ZS_HANDLE_SIZE;
 	class = pool->size_class[get_size_class_index(size)];
 
-	spin_lock(&class->lock);
-	zspage = find_get_zspage(class);
-	if (likely(zspage)) {
-		obj = obj_malloc(class, zspage, handle);
-		/* Now move the zspage to another fullness group, if required */
-		fix_fullness_group(class, zspage);
-		record_obj(handle, obj);
-		spin_unlock(&class->lock);
-
+	handle = zs_mag_pop(class);
+	if (handle)
 		return handle;
+
+	/* Refill the magazine from the zspages we lock anyway */
+	nr = zs_malloc_class(pool, class, gfp, handles,
+			     class->mag_capacity / 2 + 1, true);
+	if (!nr)
+		return 0;
+
+	if (nr > 1) {
+		int pushed = zs_mag_push(class, handles + 1, nr - 1);
+
+		if (pushed < nr - 1)
+			zs_free_class(pool, class, handles + 1 + pushed,
+				      nr - 1 - pushed);
 	}
 
-	spin_unlock(&class->lock);
+	return handles[0];
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
 
-	zspage = alloc_zspage(pool, class, gfp);
-	if (!zspage) {
-		cache_free_handle(pool, handle);
+/**
+ * zs_malloc_bulk - Allocate blocks of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of blocks to allocate
+ * @gfp: gfp flags when allocating objects
+ * @handles: array receiving the handles of the allocated objects
+ * @nr: number of objects to allocate
+ *
+ * Takes the class lock once for all the objects which fit in the zspages
+ * the class already has. Returns the number of objects allocated, which
+ * is less than @nr only if memory ran out.
+ */
+int zs_malloc_bulk(struct zs_pool *pool, size_t size, gfp_t gfp,
+		   unsigned long *handles, int nr)
+{
+	struct size_class *class;
+	int allocated = 0;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
+
+	size += ZS_HANDLE_SIZE;
+	class = pool->size_class[get_size_class_index(size)];
+
+	while (allocated < nr) {
+		handles[allocated] = zs_mag_pop(class);
+		if (!handles[allocated])
+			break;
+		allocated++;
 	}
 
-	spin_lock(&class->lock);
-	obj = obj_malloc(class, zspage, handle);
-	newfg = get_fullness_group(class, zspage);
-	insert_zspage(class, zspage, newfg);
-	set_zspage_mapping(zspage, class->index, newfg);
-	record_obj(handle, obj);
-	atomic_long_add(class->pages_per_zspage,
-				&pool->pages_allocated);
-	zs_stat_inc(class, OBJ_ALLOCATED, class->objs_per_zspage);
-
-	/* We completely set up zspage so mark them as movable */
-	SetZsPageMovable(pool, zspage);
-	spin_unlock(&class->lock);
+	if (allocated < nr)
+		allocated += zs_malloc_class(pool, class, gfp,
+					     handles + allocated,
+					     nr - allocated, false);
 
-	return handle;
+	return allocated;
 }
-EXPORT_SYMBOL_GPL(zs_malloc);
+EXPORT_SYMBOL_GPL(zs_malloc_bulk);
 
 static void obj_free(struct size_class *class, unsigned long obj)
 {
@@ -1555,7 +1811,31 @@ static void obj_free(struct size_class *class, unsigned long obj)
 	zs_stat_dec(class, OBJ_USED, 1);
 }
 
-void zs_free(struct zs_pool *pool, unsigned long handle)
+/*
+ * Give a pinned object back to its zspage and drop the migrate lock.
+ * NOTE: must be called with the class lock held.
+ */
+static void __zs_free_object(struct zs_pool *pool, struct size_class *class,
+			     struct zspage *zspage, unsigned long obj)
+{
+	enum fullness_group fullness;
+	bool isolated;
+
+	obj_free(class, obj);
+	fullness = fix_fullness_group(class, zspage);
+	if (fullness != ZS_EMPTY) {
+		migrate_read_unlock(zspage);
+		return;
+	}
+
+	isolated = is_zspage_isolated(zspage);
+	migrate_read_unlock(zspage);
+	/* If zspage is isolated, zs_page_putback will free the zspage */
+	if (likely(!isolated))
+		free_zspage(pool, class, zspage);
+}
+
+static void zs_free_object(struct zs_pool *pool, unsigned long handle)
 {
 	struct zspage *zspage;
 	struct page *f_page;
@@ -1564,10 +1844,6 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	int class_idx;
 	struct size_class *class;
 	enum fullness_group fullness;
-	bool isolated;
-
-	if (unlikely(!handle))
-		return;
 
 	pin_tag(handle);
 	obj = handle_to_obj(handle);
@@ -1580,26 +1856,164 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	class = pool->size_class[class_idx];
 
 	spin_lock(&class->lock);
-	obj_free(class, obj);
-	fullness = fix_fullness_group(class, zspage);
-	if (fullness != ZS_EMPTY) {
-		migrate_read_unlock(zspage);
-		goto out;
-	}
+	__zs_free_object(pool, class, zspage, obj);
+	spin_unlock(&class->lock);
+	unpin_tag(handle);
+}
 
-	isolated = is_zspage_isolated(zspage);
-	migrate_read_unlock(zspage);
-	/* If zspage is isolated, zs_page_putback will free the zspage */
-	if (likely(!isolated))
-		free_zspage(pool, class, zspage);
-out:
+/*
+ * Give an object back to its zspage unless the zspage is being migrated,
+ * as the migrate lock cannot be waited for under the class lock.
+ * NOTE: must be called with the class lock held.
+ */
+static bool zs_free_object_locked(struct zs_pool *pool,
+				  struct size_class *class, unsigned long handle)
+{
+	struct zspage *zspage;
+	struct page *f_page;
+	unsigned long obj;
+	unsigned int f_objidx;
 
-	spin_unlock(&class->lock);
+	pin_tag(handle);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &f_page, &f_objidx);
+	zspage = get_zspage(f_page);
+
+	if (!migrate_read_trylock(zspage)) {
+		unpin_tag(handle);
+		return false;
+	}
+
+	__zs_free_object(pool, class, zspage, obj);
 	unpin_tag(handle);
-	cache_free_handle(pool, handle);
+
+	return true;
+}
+
+/*
+ * Give @nr objects of @class back to their zspages under a single class
+ * lock, unless they are being migrated, and free their handles.
+ */
+static void zs_free_class(struct zs_pool *pool, struct size_class *class,
+			  unsigned long *handles, int nr)
+{
+	int i = 0;
+
+	while (i < nr) {
+		spin_lock(&class->lock);
+		while (i < nr && zs_free_object_locked(pool, class, handles[i]))
+			i++;
+		spin_unlock(&class->lock);
+
+		if (i < nr)
+			zs_free_object(pool, handles[i++]);
+	}
+
+	for (i = 0; i < nr; i++)
+		cache_free_handle(pool, handles[i]);
+
+	if (zs_class_fragmented(class, READ_ONCE(bg_compact_ratio)))
+		zs_bg_compact_kick(pool);
+}
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned long handles[ZS_MAG_SIZE / 2 + 1];
+	struct size_class *class;
+	int nr;
+
+	if (unlikely(!handle))
+		return;
+
+	class = handle_to_class(pool, handle);
+	if (zs_mag_push(class, &handle, 1))
+		return;
+
+	/* The magazine is full, flush half of it along with this object */
+	nr = zs_mag_take(class, raw_cpu_ptr(class->mags), handles,
+			 class->mag_capacity / 2);
+	handles[nr++] = handle;
+	zs_free_class(pool, class, handles, nr);
 }
 EXPORT_SYMBOL_GPL(zs_free);
 
+/**
+ * zs_free_bulk - Free blocks allocated from pool.
+ * @pool: pool the objects were allocated from
+ * @handles: handles of the objects to free
+ * @nr: number of objects
+ *
+ * Objects of the same size class are best passed next to each other, as
+ * they are then given back to their zspages under a single class lock.
+ */
+void zs_free_bulk(struct zs_pool *pool, unsigned long *handles, int nr)
+{
+	struct size_class *class;
+	int i = 0, j, pushed;
+
+	while (i < nr) {
+		if (unlikely(!handles[i])) {
+			i++;
+			continue;
+		}
+
+		class = handle_to_class(pool, handles[i]);
+		for (j = i + 1; j < nr && handles[j]; j++) {
+			if (handle_to_class(pool, handles[j]) != class)
+				break;
+		}
+
+		pushed = zs_mag_push(class, handles + i, j - i);
+		if (i + pushed < j)
+			zs_free_class(pool, class, handles + i + pushed,
+				      j - i - pushed);
+		i = j;
+	}
+}
+EXPORT_SYMBOL_GPL(zs_free_bulk);
+
+/* Give the objects stashed in the magazine of @cpu back to the class */
+static void zs_mag_drain_cpu(struct zs_pool *pool, struct size_class *class,
+			     int cpu)
+{
+	unsigned long handles[ZS_MAG_SIZE];
+	int nr;
+
+	nr = zs_mag_take(class, per_cpu_ptr(class->mags, cpu), handles,
+			 ZS_MAG_SIZE);
+	if (nr)
+		zs_free_class(pool, class, handles, nr);
+}
+
+/* Give the objects stashed in the magazines of @class back to the class */
+static void zs_mag_drain(struct zs_pool *pool, struct size_class *class)
+{
+	int cpu;
+
+	if (!class->mags)
+		return;
+
+	for_each_possible_cpu(cpu)
+		zs_mag_drain_cpu(pool, class, cpu);
+}
+
+static enum cpuhp_state zs_mag_hp_state;
+
+static int zs_mag_cpu_dead(unsigned int cpu, struct hlist_node *node)
+{
+	struct zs_pool *pool = hlist_entry(node, struct zs_pool, mag_node);
+	struct size_class *class;
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		class = pool->size_class[i];
+		if (class->index == i)
+			zs_mag_drain_cpu(pool, class, cpu);
+	}
+
+	return 0;
+}
+
 static void zs_object_copy(struct size_class *class, unsigned long dst,
 				unsigned long src)
 {
@@ -1890,6 +2304,11 @@ static void migrate_read_lock(struct zspage *zspage)
 	read_lock(&zspage->lock);
 }
 
+static bool migrate_read_trylock(struct zspage *zspage)
+{
+	return read_trylock(&zspage->lock);
+}
+
 static void migrate_read_unlock(struct zspage *zspage)
 {
 	read_unlock(&zspage->lock);
@@ -2304,7 +2723,7 @@ static unsigned long zs_can_compact(struct size_class *class)
 {
 	unsigned long obj_wasted;
 	unsigned long obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
-	unsigned long obj_used = zs_stat_get(class, OBJ_USED);
+	unsigned long obj_used = zs_objs_used(class);
 
 	if (obj_allocated <= obj_used)
 		return 0;
@@ -2316,7 +2735,8 @@ static unsigned long zs_can_compact(struct size_class *class)
 }
 
 static unsigned long __zs_compact(struct zs_pool *pool,
-				  struct size_class *class)
+				  struct size_class *class,
+				  unsigned long max_pages)
 {
 	struct zs_compact_control cc;
 	struct zspage *src_zspage;
@@ -2353,6 +2773,9 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 			free_zspage(pool, class, src_zspage);
 			pages_freed += class->pages_per_zspage;
 		}
+		src_zspage = NULL;
+		if (pages_freed >= max_pages)
+			break;
 		spin_unlock(&class->lock);
 		cond_resched();
 		spin_lock(&class->lock);
@@ -2366,6 +2789,24 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 	return pages_freed;
 }
 
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				      struct size_class *class,
+				      unsigned long max_pages)
+{
+	unsigned long pages_freed;
+	u64 start = local_clock();
+
+	zs_mag_drain(pool, class);
+	pages_freed = __zs_compact(pool, class, max_pages);
+
+	spin_lock(&class->lock);
+	class->compact_pages += pages_freed;
+	class->compact_ns += local_clock() - start;
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
 unsigned long zs_compact(struct zs_pool *pool)
 {
 	int i;
@@ -2378,7 +2819,7 @@ unsigned long zs_compact(struct zs_pool *pool)
 			continue;
 		if (class->index != i)
 			continue;
-		pages_freed += __zs_compact(pool, class);
+		pages_freed += zs_compact_class(pool, class, ULONG_MAX);
 	}
 	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
 
@@ -2386,6 +2827,36 @@ unsigned long zs_compact(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_compact);
 
+static void zs_bg_compact(struct work_struct *work)
+{
+	struct zs_pool *pool = container_of(to_delayed_work(work),
+					    struct zs_pool, compact_work);
+	unsigned int ratio = READ_ONCE(bg_compact_ratio);
+	unsigned long budget = READ_ONCE(bg_compact_pages);
+	unsigned long pages_freed = 0;
+	struct size_class *class;
+	int i, n;
+
+	for (n = 0; n < ZS_SIZE_CLASSES; n++) {
+		i = pool->compact_class;
+		class = pool->size_class[i];
+
+		if (class->index == i && zs_class_fragmented(class, ratio)) {
+			/* Leave the remaining classes to the next run */
+			if (pages_freed >= budget) {
+				zs_bg_compact_kick(pool);
+				break;
+			}
+			pages_freed += zs_compact_class(pool, class,
+							budget - pages_freed);
+		}
+
+		pool->compact_class = i ? i - 1 : ZS_SIZE_CLASSES - 1;
+	}
+
+	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
+}
+
 void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
 {
 	memcpy(stats, &pool->stats, sizeof(struct zs_pool_stats));
@@ -2458,7 +2929,7 @@ static int zs_register_shrinker(struct zs_pool *pool)
  */
 struct zs_pool *zs_create_pool(const char *name)
 {
-	int i;
+	int i, cpu;
 	struct zs_pool *pool;
 	struct size_class *prev_class = NULL;
 
@@ -2467,6 +2938,8 @@ struct zs_pool *zs_create_pool(const char *name)
 		return NULL;
 
 	init_deferred_free(pool);
+	INIT_DELAYED_WORK(&pool->compact_work, zs_bg_compact);
+	pool->compact_class = ZS_SIZE_CLASSES - 1;
 
 	pool->name = kstrdup(name, GFP_KERNEL);
 	if (!pool->name)
@@ -2543,6 +3016,14 @@ struct zs_pool *zs_create_pool(const char *name)
 		class->objs_per_zspage = objs_per_zspage;
 		spin_lock_init(&class->lock);
 		pool->size_class[i] = class;
+
+		class->mags = alloc_percpu(struct zs_magazine);
+		if (!class->mags)
+			goto err;
+		for_each_possible_cpu(cpu)
+			spin_lock_init(&per_cpu_ptr(class->mags, cpu)->lock);
+		class->mag_capacity = clamp_t(int, ZS_MAG_BYTES / size, 1,
+					      ZS_MAG_SIZE);
 		for (fullness = ZS_EMPTY; fullness < NR_ZS_FULLNESS;
 							fullness++)
 			INIT_LIST_HEAD(&class->fullness_list[fullness]);
@@ -2550,6 +3031,9 @@ struct zs_pool *zs_create_pool(const char *name)
 		prev_class = class;
 	}
 
+	if (cpuhp_state_add_instance_nocalls(zs_mag_hp_state, &pool->mag_node))
+		goto err;
+
 	/* debug only, don't abort if it fails */
 	zs_pool_stat_create(pool, name);
 
@@ -2577,6 +3061,19 @@ void zs_destroy_pool(struct zs_pool *pool)
 	int i;
 
 	zs_unregister_shrinker(pool);
+	if (!hlist_unhashed(&pool->mag_node))
+		cpuhp_state_remove_instance_nocalls(zs_mag_hp_state,
+						    &pool->mag_node);
+
+	/* Objects left in magazines may keep zspages alive */
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		if (class && class->index == i)
+			zs_mag_drain(pool, class);
+	}
+	cancel_delayed_work_sync(&pool->compact_work);
+
 	zs_unregister_migration(pool);
 	zs_pool_stat_destroy(pool);
 
@@ -2590,6 +3087,8 @@ void zs_destroy_pool(struct zs_pool *pool)
 		if (class->index != i)
 			continue;
 
+		free_percpu(class->mags);
+
 		for (fg = ZS_EMPTY; fg < NR_ZS_FULLNESS; fg++) {
 			if (!list_empty(&class->fullness_list[fg])) {
 				pr_info("Freeing non-empty class with size %db, fullness group %d\n",
@@ -2618,6 +3117,12 @@ static int __init zs_init(void)
 	if (ret)
 		goto hp_setup_fail;
 
+	ret = cpuhp_setup_state_multi(CPUHP_BP_PREPARE_DYN, "mm/zsmalloc:mags",
+				      NULL, zs_mag_cpu_dead);
+	if (ret < 0)
+		goto mag_hp_setup_fail;
+	zs_mag_hp_state = ret;
+
 #ifdef CONFIG_ZPOOL
 	zpool_register_driver(&zs_zpool_driver);
 #endif
@@ -2626,6 +3131,8 @@ static int __init zs_init(void)
 
 	return 0;
 
+mag_hp_setup_fail:
+	cpuhp_remove_state(CPUHP_MM_ZS_PREPARE);
 hp_setup_fail:
 	zsmalloc_unmount();
 out:
@@ -2638,6 +3145,7 @@ static void __exit zs_exit(void)
 	zpool_unregister_driver(&zs_zpool_driver);
 #endif
 	zsmalloc_unmount();
+	cpuhp_remove_multi_state(zs_mag_hp_state);
 	cpuhp_remove_state(CPUHP_MM_ZS_PREPARE);
 
 	zs_stat_exit();
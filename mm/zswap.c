@@ -30,11 +30,13 @@
 #include <linux/types.h>
 #include <linux/atomic.h>
 #include <linux/frontswap.h>
-#include <linux/rbtree.h>
+#include <linux/radix-tree.h>
+#include <linux/rcupdate.h>
 #include <linux/swap.h>
 #include <linux/crypto.h>
 #include <linux/mempool.h>
 #include <linux/zpool.h>
+#include <linux/workqueue.h>
 
 #include <linux/mm_types.h>
 #include <linux/page-flags.h>
@@ -73,6 +75,12 @@ static u64 zswap_reject_alloc_fail;
 static u64 zswap_reject_kmemcache_fail;
 /* Duplicate store was encountered (rare) */
 static u64 zswap_duplicate_entry;
+/* Pages recompressed with the cold compressor */
+static u64 zswap_recompressed_pages;
+/* Bytes saved by recompressing pages with the cold compressor */
+static u64 zswap_recompress_saved_bytes;
+/* Recompression didn't make the page smaller */
+static u64 zswap_recompress_poor;
 
 /*********************************
 * tunables
@@ -103,6 +111,24 @@ static struct kernel_param_ops zswap_compressor_param_ops = {
 module_param_cb(compressor, &zswap_compressor_param_ops,
 		&zswap_compressor, 0644);
 
+/*
+ * Crypto compressor pages which stayed in zswap for cold_age_ms are
+ * recompressed with, unset by default
+ */
+static char *zswap_cold_compressor = ZSWAP_PARAM_UNSET;
+static int zswap_cold_compressor_param_set(const char *,
+					   const struct kernel_param *);
+static struct kernel_param_ops zswap_cold_compressor_param_ops = {
+	.set =		zswap_cold_compressor_param_set,
+	.get =		param_get_charp,
+	.free =		param_free_charp,
+};
+module_param_cb(cold_compressor, &zswap_cold_compressor_param_ops,
+		&zswap_cold_compressor, 0644);
+
+static unsigned int zswap_cold_age_ms = 60000;
+module_param_named(cold_age_ms, zswap_cold_age_ms, uint, 0644);
+
 /* Compressed storage zpool to use */
 #define ZSWAP_ZPOOL_DEFAULT "zbud"
 static char *zswap_zpool_type = ZSWAP_ZPOOL_DEFAULT;
@@ -143,26 +169,33 @@ struct zswap_pool {
  * This structure contains the metadata for tracking a single compressed
  * page within zswap.
  *
- * rbnode - links the entry into red-black tree for the appropriate swap type
- * offset - the swap offset for the entry.  Index into the red-black tree.
+ * rcu - frees the entry after a grace period, as loads look it up under RCU
+ * offset - the swap offset for the entry.  Index into the radix tree.
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
- *            for the zswap_tree structure that contains the entry must
- *            be held while changing the refcount.  Since the lock must
- *            be held, there is no reason to also make refcount atomic.
+ *            for the zswap_tree structure that contains the entry must be
+ *            held while dropping the last reference, which removes the
+ *            entry from the tree. Loads take their reference locklessly,
+ *            only if the refcount isn't zero.
  * length - the length in bytes of the compressed page data.  Needed during
  *          decompression. For a same value filled page length is 0.
- * pool - the zswap_pool the entry's data is in
+ * pool - the zswap_pool the entry's data is in, which also tells the
+ *        compressor the data was compressed with
+ * lru - links the entry into the list of the tree's entries waiting to be
+ *       recompressed with the cold compressor
+ * stored - time, in jiffies, the entry was stored
  * handle - zpool allocation handle that stores the compressed page data
  * value - value of the same-value filled pages which have same content
  */
 struct zswap_entry {
-	struct rb_node rbnode;
+	struct rcu_head rcu;
 	pgoff_t offset;
-	int refcount;
+	atomic_t refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
+	struct list_head lru;
+	unsigned long stored;
 	union {
 		unsigned long handle;
 		unsigned long value;
@@ -175,11 +208,13 @@ struct zswap_header {
 
 /*
  * The tree lock in the zswap_tree struct protects a few things:
- * - the rbtree
- * - the refcount field of each entry in the tree
+ * - the radix tree updates, lookups may run under RCU
+ * - the release of the last reference of each entry in the tree
+ * - the lru list, oldest entry first
  */
 struct zswap_tree {
-	struct rb_root rbroot;
+	struct radix_tree_root index;
+	struct list_head lru;
 	spinlock_t lock;
 };
 
@@ -201,6 +236,14 @@ static bool zswap_init_failed;
 /* init completed, but couldn't create the initial pool */
 static bool zswap_has_pool;
 
+/* pool of the cold compressor, also on the tail of zswap_pools */
+static struct zswap_pool *zswap_cold_pool;
+/* protects zswap_cold_pool and zswap_trees against the recompression */
+static DEFINE_MUTEX(zswap_cold_mutex);
+
+static void zswap_recompress(struct work_struct *work);
+static DECLARE_DELAYED_WORK(zswap_recompress_work, zswap_recompress);
+
 /*********************************
 * helpers and fwd declarations
 **********************************/
@@ -260,69 +303,62 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 	entry = kmem_cache_alloc(zswap_entry_cache, gfp);
 	if (!entry)
 		return NULL;
-	entry->refcount = 1;
-	RB_CLEAR_NODE(&entry->rbnode);
+	atomic_set(&entry->refcount, 1);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
+static void zswap_entry_free_rcu(struct rcu_head *rcu)
+{
+	kmem_cache_free(zswap_entry_cache,
+			container_of(rcu, struct zswap_entry, rcu));
+}
+
+/* lockless lookups may still see the entry until a grace period elapsed */
 static void zswap_entry_cache_free(struct zswap_entry *entry)
 {
-	kmem_cache_free(zswap_entry_cache, entry);
+	call_rcu(&entry->rcu, zswap_entry_free_rcu);
 }
 
 /*********************************
-* rbtree functions
+* index functions
 **********************************/
-static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
+/* caller must hold the tree lock or rcu_read_lock() */
+static struct zswap_entry *zswap_index_search(struct zswap_tree *tree,
+					      pgoff_t offset)
 {
-	struct rb_node *node = root->rb_node;
-	struct zswap_entry *entry;
-
-	while (node) {
-		entry = rb_entry(node, struct zswap_entry, rbnode);
-		if (entry->offset > offset)
-			node = node->rb_left;
-		else if (entry->offset < offset)
-			node = node->rb_right;
-		else
-			return entry;
-	}
-	return NULL;
+	return radix_tree_lookup(&tree->index, offset);
 }
 
 /*
- * In the case that a entry with the same offset is found, a pointer to
- * the existing entry is stored in dupentry and the function returns -EEXIST
+ * Caller must hold the tree lock, and have preloaded the radix tree. In the
+ * case that a entry with the same offset is found, it is atomically replaced
+ * with the new entry, so lockless lookups see either one, and a pointer to
+ * the replaced entry is returned.
  */
-static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
-			struct zswap_entry **dupentry)
+static struct zswap_entry *zswap_index_insert(struct zswap_tree *tree,
+					      struct zswap_entry *entry)
 {
-	struct rb_node **link = &root->rb_node, *parent = NULL;
-	struct zswap_entry *myentry;
-
-	while (*link) {
-		parent = *link;
-		myentry = rb_entry(parent, struct zswap_entry, rbnode);
-		if (myentry->offset > entry->offset)
-			link = &(*link)->rb_left;
-		else if (myentry->offset < entry->offset)
-			link = &(*link)->rb_right;
-		else {
-			*dupentry = myentry;
-			return -EEXIST;
-		}
+	struct zswap_entry *dupentry;
+	void __rcu **slot;
+
+	dupentry = __radix_tree_lookup(&tree->index, entry->offset, NULL,
+				       &slot);
+	if (dupentry) {
+		radix_tree_replace_slot(&tree->index, slot, entry);
+		return dupentry;
 	}
-	rb_link_node(&entry->rbnode, parent, link);
-	rb_insert_color(&entry->rbnode, root);
-	return 0;
+
+	/* can't fail with -ENOMEM, nodes were preloaded */
+	WARN_ON(radix_tree_insert(&tree->index, entry->offset, entry));
+	return NULL;
 }
 
-static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
+/* caller must hold the tree lock, the entry may already be gone */
+static void zswap_index_erase(struct zswap_tree *tree,
+			      struct zswap_entry *entry)
 {
-	if (!RB_EMPTY_NODE(&entry->rbnode)) {
-		rb_erase(&entry->rbnode, root);
-		RB_CLEAR_NODE(&entry->rbnode);
-	}
+	radix_tree_delete_item(&tree->index, entry->offset, entry);
 }
 
 /*
@@ -345,7 +381,7 @@ static void zswap_free_entry(struct zswap_entry *entry)
 /* caller must hold the tree lock */
 static void zswap_entry_get(struct zswap_entry *entry)
 {
-	entry->refcount++;
+	atomic_inc(&entry->refcount);
 }
 
 /* caller must hold the tree lock
@@ -354,28 +390,66 @@ static void zswap_entry_get(struct zswap_entry *entry)
 static void zswap_entry_put(struct zswap_tree *tree,
 			struct zswap_entry *entry)
 {
-	int refcount = --entry->refcount;
+	int refcount = atomic_dec_return(&entry->refcount);
 
 	BUG_ON(refcount < 0);
 	if (refcount == 0) {
-		zswap_rb_erase(&tree->rbroot, entry);
+		zswap_index_erase(tree, entry);
+		list_del(&entry->lru);
 		zswap_free_entry(entry);
 	}
 }
 
+/* only dropping the last reference needs the tree lock */
+static void zswap_entry_put_unlocked(struct zswap_tree *tree,
+				     struct zswap_entry *entry)
+{
+	if (atomic_add_unless(&entry->refcount, -1, 1))
+		return;
+
+	spin_lock(&tree->lock);
+	zswap_entry_put(tree, entry);
+	spin_unlock(&tree->lock);
+}
+
 /* caller must hold the tree lock */
-static struct zswap_entry *zswap_entry_find_get(struct rb_root *root,
+static struct zswap_entry *zswap_entry_find_get(struct zswap_tree *tree,
 				pgoff_t offset)
 {
 	struct zswap_entry *entry;
 
-	entry = zswap_rb_search(root, offset);
+	entry = zswap_index_search(tree, offset);
 	if (entry)
 		zswap_entry_get(entry);
 
 	return entry;
 }
 
+/*
+ * Lockless lookup for the load path. Entries whose refcount is zero are
+ * being freed, or switched to new data by the recompression, so fall back
+ * to the tree lock which serializes against both.
+ */
+static struct zswap_entry *zswap_entry_find_get_rcu(struct zswap_tree *tree,
+						    pgoff_t offset)
+{
+	struct zswap_entry *entry;
+
+	rcu_read_lock();
+	entry = zswap_index_search(tree, offset);
+	if (!entry || atomic_inc_not_zero(&entry->refcount)) {
+		rcu_read_unlock();
+		return entry;
+	}
+	rcu_read_unlock();
+
+	spin_lock(&tree->lock);
+	entry = zswap_entry_find_get(tree, offset);
+	spin_unlock(&tree->lock);
+
+	return entry;
+}
+
 /*********************************
 * per-cpu code
 **********************************/
@@ -779,6 +853,60 @@ static int zswap_zpool_param_set(const char *val,
 	return __zswap_param_set(val, kp, NULL, zswap_compressor);
 }
 
+static int zswap_cold_compressor_param_set(const char *val,
+					   const struct kernel_param *kp)
+{
+	struct zswap_pool *pool = NULL, *put_pool;
+	char *s = strstrip((char *)val);
+	int ret;
+
+	if (zswap_init_failed) {
+		pr_err("can't set param, initialization failed\n");
+		return -ENODEV;
+	}
+
+	if (!zswap_init_started)
+		return param_set_charp(s, kp);
+
+	if (strcmp(s, ZSWAP_PARAM_UNSET)) {
+		if (!crypto_has_comp(s, 0, 0)) {
+			pr_err("compressor %s not available\n", s);
+			return -ENOENT;
+		}
+
+		pool = zswap_pool_create(zswap_zpool_type, s);
+		if (!pool)
+			return -EINVAL;
+	}
+
+	ret = param_set_charp(s, kp);
+	if (ret) {
+		if (pool)
+			zswap_pool_destroy(pool);
+		return ret;
+	}
+
+	mutex_lock(&zswap_cold_mutex);
+	put_pool = zswap_cold_pool;
+	zswap_cold_pool = pool;
+	if (pool) {
+		spin_lock(&zswap_pools_lock);
+		list_add_tail_rcu(&pool->list, &zswap_pools);
+		spin_unlock(&zswap_pools_lock);
+	}
+	mutex_unlock(&zswap_cold_mutex);
+
+	/* drop the ref of the former cold pool, which goes once empty */
+	if (put_pool)
+		zswap_pool_put(put_pool);
+
+	if (pool)
+		queue_delayed_work(system_unbound_wq, &zswap_recompress_work,
+				   HZ);
+
+	return 0;
+}
+
 static int zswap_enabled_param_set(const char *val,
 				   const struct kernel_param *kp)
 {
@@ -871,7 +999,7 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 
 	/* find and ref zswap entry */
 	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
+	entry = zswap_entry_find_get(tree, offset);
 	if (!entry) {
 		/* entry was invalidated */
 		spin_unlock(&tree->lock);
@@ -930,7 +1058,7 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	*     because invalidate happened during writeback
 	*  search the tree and free the entry if find entry
 	*/
-	if (entry == zswap_rb_search(&tree->rbroot, offset))
+	if (entry == zswap_index_search(tree, offset))
 		zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
 
@@ -999,6 +1127,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 {
 	struct zswap_tree *tree = zswap_trees[type];
 	struct zswap_entry *entry, *dupentry;
+	struct zswap_pool *cold;
 	struct crypto_comp *tfm;
 	int ret;
 	unsigned int hlen, dlen = PAGE_SIZE;
@@ -1102,18 +1231,33 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	entry->length = dlen;
 
 insert_entry:
+	/* allocate the index nodes before taking the tree lock */
+	if (radix_tree_preload(GFP_KERNEL)) {
+		zswap_reject_kmemcache_fail++;
+		ret = -ENOMEM;
+		goto put_entry;
+	}
+
+	cold = READ_ONCE(zswap_cold_pool);
 	/* map */
 	spin_lock(&tree->lock);
-	do {
-		ret = zswap_rb_insert(&tree->rbroot, entry, &dupentry);
-		if (ret == -EEXIST) {
-			zswap_duplicate_entry++;
-			/* remove from rbtree */
-			zswap_rb_erase(&tree->rbroot, dupentry);
-			zswap_entry_put(tree, dupentry);
-		}
-	} while (ret == -EEXIST);
+	dupentry = zswap_index_insert(tree, entry);
+	if (dupentry) {
+		zswap_duplicate_entry++;
+		/* already replaced in the index */
+		zswap_entry_put(tree, dupentry);
+	}
+	/* queue the entry for recompression once it's cold */
+	if (cold && entry->length && entry->pool != cold) {
+		entry->stored = jiffies;
+		list_add_tail(&entry->lru, &tree->lru);
+	}
 	spin_unlock(&tree->lock);
+	radix_tree_preload_end();
+
+	if (cold && !delayed_work_pending(&zswap_recompress_work))
+		queue_delayed_work(system_unbound_wq, &zswap_recompress_work,
+				   msecs_to_jiffies(zswap_cold_age_ms));
 
 	/* update stats */
 	atomic_inc(&zswap_stored_pages);
@@ -1121,8 +1265,17 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 
 	return 0;
 
+put_entry:
+	if (!entry->length) {
+		atomic_dec(&zswap_same_filled_pages);
+		goto freepage;
+	}
+	zpool_free(entry->pool->zpool, entry->handle);
+	goto put_pool;
+
 put_dstmem:
 	put_cpu_var(zswap_dstmem);
+put_pool:
 	zswap_pool_put(entry->pool);
 freepage:
 	zswap_entry_cache_free(entry);
@@ -1145,14 +1298,11 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	int ret;
 
 	/* find */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
+	entry = zswap_entry_find_get_rcu(tree, offset);
 	if (!entry) {
 		/* entry was written back */
-		spin_unlock(&tree->lock);
 		return -1;
 	}
-	spin_unlock(&tree->lock);
 
 	if (!entry->length) {
 		dst = kmap_atomic(page);
@@ -1175,9 +1325,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	BUG_ON(ret);
 
 freeentry:
-	spin_lock(&tree->lock);
-	zswap_entry_put(tree, entry);
-	spin_unlock(&tree->lock);
+	zswap_entry_put_unlocked(tree, entry);
 
 	return 0;
 }
@@ -1190,15 +1338,15 @@ static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 
 	/* find */
 	spin_lock(&tree->lock);
-	entry = zswap_rb_search(&tree->rbroot, offset);
+	entry = zswap_index_search(tree, offset);
 	if (!entry) {
 		/* entry was written back */
 		spin_unlock(&tree->lock);
 		return;
 	}
 
-	/* remove from rbtree */
-	zswap_rb_erase(&tree->rbroot, entry);
+	/* remove from the index */
+	zswap_index_erase(tree, entry);
 
 	/* drop the initial reference from entry creation */
 	zswap_entry_put(tree, entry);
@@ -1210,19 +1358,29 @@ static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 static void zswap_frontswap_invalidate_area(unsigned type)
 {
 	struct zswap_tree *tree = zswap_trees[type];
-	struct zswap_entry *entry, *n;
+	struct radix_tree_iter iter;
+	struct zswap_entry *entry;
+	void __rcu **slot;
 
 	if (!tree)
 		return;
 
+	/* the recompression may be walking the tree */
+	mutex_lock(&zswap_cold_mutex);
+
 	/* walk the tree and free everything */
 	spin_lock(&tree->lock);
-	rbtree_postorder_for_each_entry_safe(entry, n, &tree->rbroot, rbnode)
+	radix_tree_for_each_slot(slot, &tree->index, &iter, 0) {
+		entry = radix_tree_deref_slot_protected(slot, &tree->lock);
+		radix_tree_iter_delete(&tree->index, &iter, slot);
 		zswap_free_entry(entry);
-	tree->rbroot = RB_ROOT;
+	}
+	INIT_LIST_HEAD(&tree->lru);
 	spin_unlock(&tree->lock);
 	kfree(tree);
 	zswap_trees[type] = NULL;
+
+	mutex_unlock(&zswap_cold_mutex);
 }
 
 static void zswap_frontswap_init(unsigned type)
@@ -1235,11 +1393,180 @@ static void zswap_frontswap_init(unsigned type)
 		return;
 	}
 
-	tree->rbroot = RB_ROOT;
+	INIT_RADIX_TREE(&tree->index, GFP_ATOMIC);
+	INIT_LIST_HEAD(&tree->lru);
 	spin_lock_init(&tree->lock);
 	zswap_trees[type] = tree;
 }
 
+/*********************************
+* cold entries recompression
+**********************************/
+/* entries recompressed per run of the work */
+#define ZSWAP_RECOMPRESS_BATCH 256
+
+/*
+ * Recompresses an entry with the cold compressor. The caller holds a
+ * reference to the entry, taken off the lru list, which is dropped here.
+ */
+static void zswap_recompress_entry(struct zswap_tree *tree, unsigned type,
+				   struct zswap_entry *entry,
+				   struct zswap_pool *cold, u8 *buf, u8 *dst)
+{
+	struct zswap_header zhdr = {
+		.swpentry = swp_entry(type, entry->offset)
+	};
+	struct zswap_pool *pool = entry->pool;
+	unsigned long handle, old_handle = entry->handle;
+	unsigned int hlen, old_length = entry->length, dlen = PAGE_SIZE;
+	struct crypto_comp *tfm;
+	bool replaced = false;
+	u8 *src;
+	int ret;
+
+	/* decompress with the compressor the entry was stored with */
+	src = zpool_map_handle(pool->zpool, old_handle, ZPOOL_MM_RO);
+	if (zpool_evictable(pool->zpool))
+		src += sizeof(struct zswap_header);
+	tfm = *get_cpu_ptr(pool->tfm);
+	ret = crypto_comp_decompress(tfm, src, old_length, buf, &dlen);
+	put_cpu_ptr(pool->tfm);
+	zpool_unmap_handle(pool->zpool, old_handle);
+	if (WARN_ON(ret || dlen != PAGE_SIZE))
+		goto put;
+
+	dlen = PAGE_SIZE * 2;
+	tfm = *get_cpu_ptr(cold->tfm);
+	ret = crypto_comp_compress(tfm, buf, PAGE_SIZE, dst, &dlen);
+	put_cpu_ptr(cold->tfm);
+	if (ret || dlen >= old_length) {
+		zswap_recompress_poor++;
+		goto put;
+	}
+
+	hlen = zpool_evictable(cold->zpool) ? sizeof(zhdr) : 0;
+	if (zpool_malloc(cold->zpool, hlen + dlen,
+			 __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM,
+			 &handle))
+		goto put;
+	src = zpool_map_handle(cold->zpool, handle, ZPOOL_MM_RW);
+	memcpy(src, &zhdr, hlen);
+	memcpy(src + hlen, dst, dlen);
+	zpool_unmap_handle(cold->zpool, handle);
+
+	/* the entry keeps a reference to the pool its data is in */
+	if (!zswap_pool_get(cold)) {
+		zpool_free(cold->zpool, handle);
+		goto put;
+	}
+
+	spin_lock(&tree->lock);
+	/*
+	 * Only switch the entry if nobody else holds a reference, i.e. it's
+	 * neither being loaded nor written back, and it's still in the tree.
+	 * The refcount is frozen meanwhile, so lockless loads wait for the
+	 * tree lock instead of seeing half of the update.
+	 */
+	if (zswap_index_search(tree, entry->offset) == entry &&
+	    atomic_cmpxchg(&entry->refcount, 2, 0) == 2) {
+		entry->pool = cold;
+		entry->handle = handle;
+		entry->length = dlen;
+		atomic_set_release(&entry->refcount, 2);
+		replaced = true;
+	}
+	zswap_entry_put(tree, entry);
+	spin_unlock(&tree->lock);
+
+	if (replaced) {
+		zpool_free(pool->zpool, old_handle);
+		zswap_pool_put(pool);
+		zswap_recompressed_pages++;
+		zswap_recompress_saved_bytes += old_length - dlen;
+		zswap_update_total_size();
+	} else {
+		zpool_free(cold->zpool, handle);
+		zswap_pool_put(cold);
+	}
+	return;
+
+put:
+	spin_lock(&tree->lock);
+	zswap_entry_put(tree, entry);
+	spin_unlock(&tree->lock);
+}
+
+static void zswap_recompress(struct work_struct *work)
+{
+	unsigned long age = msecs_to_jiffies(zswap_cold_age_ms);
+	unsigned long delay = ULONG_MAX;
+	struct zswap_entry *entry;
+	struct zswap_pool *cold;
+	struct zswap_tree *tree;
+	u8 *buf = NULL, *dst = NULL;
+	int type, nr = 0;
+
+	mutex_lock(&zswap_cold_mutex);
+
+	cold = zswap_cold_pool;
+	if (!zswap_pool_get(cold))
+		goto unlock;
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	dst = kmalloc(PAGE_SIZE * 2, GFP_KERNEL);
+	if (!buf || !dst) {
+		delay = HZ;
+		goto free;
+	}
+
+	for (type = 0; type < MAX_SWAPFILES; type++) {
+		tree = zswap_trees[type];
+		if (!tree)
+			continue;
+
+		while (nr < ZSWAP_RECOMPRESS_BATCH) {
+			spin_lock(&tree->lock);
+			entry = list_first_entry_or_null(&tree->lru,
+					struct zswap_entry, lru);
+			if (entry && time_before(jiffies, entry->stored + age)) {
+				/* the list is sorted, the rest is younger */
+				delay = min(delay, entry->stored + age - jiffies);
+				entry = NULL;
+			}
+			if (entry) {
+				list_del_init(&entry->lru);
+				zswap_entry_get(entry);
+			}
+			spin_unlock(&tree->lock);
+
+			if (!entry)
+				break;
+
+			zswap_recompress_entry(tree, type, entry, cold,
+					       buf, dst);
+			nr++;
+			cond_resched();
+		}
+
+		if (nr >= ZSWAP_RECOMPRESS_BATCH) {
+			/* let the other users of system_unbound_wq in */
+			delay = 1;
+			break;
+		}
+	}
+
+free:
+	kfree(dst);
+	kfree(buf);
+	zswap_pool_put(cold);
+unlock:
+	mutex_unlock(&zswap_cold_mutex);
+
+	if (delay != ULONG_MAX)
+		queue_delayed_work(system_unbound_wq, &zswap_recompress_work,
+				   delay);
+}
+
 static struct frontswap_ops zswap_frontswap_ops = {
 	.store = zswap_frontswap_store,
 	.load = zswap_frontswap_load,
@@ -1279,6 +1606,12 @@ static int __init zswap_debugfs_init(void)
 			   zswap_debugfs_root, &zswap_written_back_pages);
 	debugfs_create_u64("duplicate_entry", 0444,
 			   zswap_debugfs_root, &zswap_duplicate_entry);
+	debugfs_create_u64("recompressed_pages", 0444,
+			   zswap_debugfs_root, &zswap_recompressed_pages);
+	debugfs_create_u64("recompress_saved_bytes", 0444,
+			   zswap_debugfs_root, &zswap_recompress_saved_bytes);
+	debugfs_create_u64("recompress_poor", 0444,
+			   zswap_debugfs_root, &zswap_recompress_poor);
 	debugfs_create_u64("pool_total_size", 0444,
 			   zswap_debugfs_root, &zswap_pool_total_size);
 	debugfs_create_atomic_t("stored_pages", 0444,
@@ -1342,6 +1675,24 @@ static int __init init_zswap(void)
 		zswap_enabled = false;
 	}
 
+	if (zswap_has_pool && strcmp(zswap_cold_compressor, ZSWAP_PARAM_UNSET)) {
+		if (crypto_has_comp(zswap_cold_compressor, 0, 0))
+			pool = zswap_pool_create(zswap_zpool_type,
+						 zswap_cold_compressor);
+		else
+			pool = NULL;
+		if (pool) {
+			pr_info("recompressing cold pages with %s\n",
+				pool->tfm_name);
+			/* at the tail, so it's shrunk first */
+			list_add_tail(&pool->list, &zswap_pools);
+			zswap_cold_pool = pool;
+		} else {
+			pr_err("cold compressor %s not available\n",
+			       zswap_cold_compressor);
+		}
+	}
+
 	frontswap_register_ops(&zswap_frontswap_ops);
 	if (zswap_debugfs_init())
 		pr_warn("debugfs initialization failed\n");
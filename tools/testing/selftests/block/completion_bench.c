@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Completion overhead benchmark.
+ *
+ * A number of threads keep 4 KiB O_DIRECT random reads going to a block
+ * device, either through native AIO at a given queue depth or, with -p, one
+ * at a time with RWF_HIPRI so that the kernel polls for their completion.
+ * The IOPS are reported along with the CPU time spent system wide for each
+ * I/O, taken from /proc/stat, so that it also covers the interrupt and
+ * softirq work done on the completion side.
+ *
+ * See completion_bench.sh for a run on null_blk with and without batched
+ * completions.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+
+#include <kselftest.h>
+
+#ifndef RWF_HIPRI
+#define RWF_HIPRI	0x00000001
+#endif
+
+static struct {
+	const char *dev;
+	int seconds;
+	int jobs;
+	int depth;
+	size_t bs;
+	bool poll;
+} opts = {
+	.dev = "/dev/nullb0",
+	.seconds = 10,
+	.jobs = 4,
+	.depth = 32,
+	.bs = 4096,
+};
+
+static volatile bool stop;
+static uint64_t dev_blocks;
+static uint64_t total_ios;
+static pthread_mutex_t ios_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct cpu_times {
+	unsigned long long busy;
+	unsigned long long total;
+};
+
+static int read_cpu_times(struct cpu_times *t)
+{
+	unsigned long long v[8] = { };
+	FILE *f;
+	int n;
+
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		return -1;
+	n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+		   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+	fclose(f);
+	if (n < 7)
+		return -1;
+
+	/* user nice system idle iowait irq softirq steal */
+	t->busy = v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+	t->total = t->busy + v[3] + v[4];
+	return 0;
+}
+
+static off_t random_offset(unsigned int *seed)
+{
+	return (off_t)(rand_r(seed) % dev_blocks) * opts.bs;
+}
+
+static void add_ios(uint64_t done)
+{
+	pthread_mutex_lock(&ios_lock);
+	total_ios += done;
+	pthread_mutex_unlock(&ios_lock);
+}
+
+static void *poll_thread(void *arg)
+{
+	unsigned int seed = (uintptr_t)arg;
+	uint64_t done = 0;
+	struct iovec iov;
+	int fd;
+
+	fd = open(opts.dev, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		return NULL;
+	if (posix_memalign(&iov.iov_base, 4096, opts.bs)) {
+		close(fd);
+		return NULL;
+	}
+	iov.iov_len = opts.bs;
+
+	while (!stop) {
+		if (preadv2(fd, &iov, 1, random_offset(&seed), RWF_HIPRI) !=
+		    (ssize_t)opts.bs)
+			break;
+		done++;
+	}
+	add_ios(done);
+
+	free(iov.iov_base);
+	close(fd);
+	return NULL;
+}
+
+static void *aio_thread(void *arg)
+{
+	unsigned int seed = (uintptr_t)arg;
+	struct io_event *events = NULL;
+	struct iocb *iocbs = NULL, *iocbp;
+	aio_context_t ctx = 0;
+	uint64_t done = 0;
+	long inflight = 0;
+	char *bufs = NULL;
+	int fd, i, n;
+
+	fd = open(opts.dev, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		return NULL;
+	if (syscall(SYS_io_setup, opts.depth, &ctx))
+		goto out_close;
+
+	iocbs = calloc(opts.depth, sizeof(*iocbs));
+	events = calloc(opts.depth, sizeof(*events));
+	if (!iocbs || !events ||
+	    posix_memalign((void **)&bufs, 4096, opts.depth * opts.bs))
+		goto out_free;
+
+	for (i = 0; i < opts.depth; i++) {
+		iocbs[i].aio_fildes = fd;
+		iocbs[i].aio_lio_opcode = IOCB_CMD_PREAD;
+		iocbs[i].aio_buf = (uintptr_t)(bufs + i * opts.bs);
+		iocbs[i].aio_nbytes = opts.bs;
+		iocbs[i].aio_data = i;
+	}
+
+	for (i = 0; i < opts.depth; i++) {
+		iocbs[i].aio_offset = random_offset(&seed);
+		iocbp = &iocbs[i];
+		if (syscall(SYS_io_submit, ctx, 1, &iocbp) != 1)
+			goto out_drain;
+		inflight++;
+	}
+
+	while (!stop) {
+		n = syscall(SYS_io_getevents, ctx, 1, opts.depth, events, NULL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		inflight -= n;
+		for (i = 0; i < n; i++) {
+			if (events[i].res != (long long)opts.bs)
+				goto out_drain;
+			done++;
+
+			iocbp = &iocbs[events[i].data];
+			iocbp->aio_offset = random_offset(&seed);
+			if (syscall(SYS_io_submit, ctx, 1, &iocbp) != 1)
+				goto out_drain;
+			inflight++;
+		}
+	}
+
+out_drain:
+	while (inflight > 0) {
+		n = syscall(SYS_io_getevents, ctx, 1, opts.depth, events, NULL);
+		if (n < 0 && errno != EINTR)
+			break;
+		if (n > 0)
+			inflight -= n;
+	}
+	add_ios(done);
+out_free:
+	free(bufs);
+	free(events);
+	free(iocbs);
+	syscall(SYS_io_destroy, ctx);
+out_close:
+	close(fd);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d dev] [-t seconds] [-j jobs] [-q depth] [-p]\n"
+		"  -d  block device, read only (default %s)\n"
+		"  -t  run time in seconds (default %d)\n"
+		"  -j  number of threads (default %d)\n"
+		"  -q  AIO queue depth per thread (default %d)\n"
+		"  -p  polled synchronous reads instead of AIO\n",
+		prog, opts.dev, opts.seconds, opts.jobs, opts.depth);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	struct cpu_times before, after;
+	unsigned long long busy, total;
+	struct timespec start, end;
+	pthread_t *threads;
+	uint64_t dev_size;
+	double secs, usec_per_tick;
+	int c, i, fd;
+
+	while ((c = getopt(argc, argv, "d:t:j:q:p")) != -1) {
+		switch (c) {
+		case 'd':
+			opts.dev = optarg;
+			break;
+		case 't':
+			opts.seconds = atoi(optarg);
+			break;
+		case 'j':
+			opts.jobs = atoi(optarg);
+			break;
+		case 'q':
+			opts.depth = atoi(optarg);
+			break;
+		case 'p':
+			opts.poll = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (opts.seconds < 1 || opts.jobs < 1 || opts.depth < 1)
+		usage(argv[0]);
+
+	if (geteuid())
+		ksft_exit_skip("must be run as root\n");
+
+	fd = open(opts.dev, O_RDONLY);
+	if (fd < 0)
+		ksft_exit_skip("%s: %s\n", opts.dev, strerror(errno));
+	if (ioctl(fd, BLKGETSIZE64, &dev_size))
+		ksft_exit_fail_msg("BLKGETSIZE64: %s\n", strerror(errno));
+	close(fd);
+	dev_blocks = dev_size / opts.bs;
+	if (!dev_blocks)
+		ksft_exit_skip("%s is too small\n", opts.dev);
+
+	threads = calloc(opts.jobs, sizeof(*threads));
+	if (!threads)
+		ksft_exit_fail_msg("out of memory\n");
+
+	if (read_cpu_times(&before))
+		ksft_exit_fail_msg("cannot read /proc/stat\n");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < opts.jobs; i++) {
+		if (pthread_create(&threads[i], NULL,
+				   opts.poll ? poll_thread : aio_thread,
+				   (void *)(uintptr_t)(i + 1)))
+			ksft_exit_fail_msg("pthread_create failed\n");
+	}
+	sleep(opts.seconds);
+	stop = true;
+	for (i = 0; i < opts.jobs; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (read_cpu_times(&after))
+		ksft_exit_fail_msg("cannot read /proc/stat\n");
+
+	if (!total_ios)
+		ksft_exit_fail_msg("no I/O completed on %s\n", opts.dev);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	busy = after.busy - before.busy;
+	total = after.total - before.total;
+	usec_per_tick = 1e6 / sysconf(_SC_CLK_TCK);
+
+	printf("%s: ios %llu, %.0f IOPS, cpu %.1f%%, %.2f usec cpu per I/O\n",
+	       opts.poll ? "poll" : "aio",
+	       (unsigned long long)total_ios, total_ios / secs,
+	       total ? 100.0 * busy / total : 0.0,
+	       busy * usec_per_tick / total_ios);
+
+	ksft_exit_pass();
+}
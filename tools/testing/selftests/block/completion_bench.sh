@@ -0,0 +1,37 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare IOPS and CPU time per I/O with and without batched completions, on
+# a null_blk device with one hardware queue per CPU whose requests take a
+# fixed time to complete. With batched completions, polled I/O is measured
+# as well.
+#
+# Usage: completion_bench.sh [completion_usec] [queue_depth] [extra completion_bench args]
+
+dir=$(dirname "$0")
+. "$dir"/null_blk_lib.sh
+
+completion_usec=${1:-20}
+queue_depth=${2:-128}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+
+null_blk_check
+ret=0
+
+echo "null_blk: ${completion_usec}us per request, queue depth $queue_depth"
+for batch in 0 1; do
+	null_blk_load "$completion_usec" "$queue_depth" \
+		submit_queues="$(nproc)" batch_completion=$batch
+
+	modes=""
+	[ $batch -eq 1 ] && modes="-p"
+	for mode in "" $modes; do
+		out=$("$dir"/completion_bench -d /dev/nullb0 $mode "$@") || ret=1
+		printf "batch_completion=%s %s\n" "$batch" "$(echo "$out" | head -n 1)"
+	done
+
+	null_blk_unload
+done
+
+exit $ret
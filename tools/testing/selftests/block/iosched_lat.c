@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Read tail latency under a write load, for comparing I/O schedulers.
+ *
+ * A number of writer threads keep large O_DIRECT writes going to the second
+ * half of a block device, while a single reader issues 4 KiB O_DIRECT random
+ * reads to the first half and records the latency of each. The read latency
+ * percentiles and the write bandwidth are reported at the end.
+ *
+ * The reader can be put in the realtime I/O class with -p, the way a
+ * foreground task would be. See iosched_lat.sh for a run on null_blk across
+ * the available schedulers.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include <linux/fs.h>
+
+#include <kselftest.h>
+
+#define READ_BS			4096
+#define IOPRIO_CLASS_SHIFT	13
+#define IOPRIO_CLASS_RT		1
+#define IOPRIO_WHO_PROCESS	1
+
+static struct {
+	const char *dev;
+	int seconds;
+	int writers;
+	size_t write_bs;
+	bool prio;
+} opts = {
+	.dev = "/dev/nullb0",
+	.seconds = 10,
+	.writers = 16,
+	.write_bs = 512 << 10,
+};
+
+static volatile bool stop;
+static uint64_t dev_size;
+static uint64_t write_bytes;
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *writer_thread(void *arg)
+{
+	uint64_t base = dev_size / 2, span = dev_size / 2;
+	uint64_t off = ((uintptr_t)arg * opts.write_bs * 64) % span;
+	uint64_t done = 0;
+	void *buf;
+	int fd;
+
+	fd = open(opts.dev, O_WRONLY | O_DIRECT);
+	if (fd < 0)
+		return NULL;
+	if (posix_memalign(&buf, 4096, opts.write_bs)) {
+		close(fd);
+		return NULL;
+	}
+	memset(buf, 0x5a, opts.write_bs);
+
+	while (!stop) {
+		if (off + opts.write_bs > span)
+			off = 0;
+		if (pwrite(fd, buf, opts.write_bs, base + off) !=
+		    (ssize_t)opts.write_bs)
+			break;
+		off += opts.write_bs;
+		done += opts.write_bs;
+	}
+
+	pthread_mutex_lock(&write_lock);
+	write_bytes += done;
+	pthread_mutex_unlock(&write_lock);
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *lat, size_t nr, double pct)
+{
+	size_t idx = (size_t)(nr * pct / 100.0);
+
+	return lat[idx < nr ? idx : nr - 1];
+}
+
+static int run_reader(uint64_t **lat_ret, size_t *nr_ret)
+{
+	uint64_t nr_blocks = dev_size / 2 / READ_BS;
+	uint64_t end, start, *lat = NULL, *tmp;
+	size_t nr = 0, cap = 0;
+	void *buf;
+	int fd;
+
+	*lat_ret = NULL;
+	*nr_ret = 0;
+
+	fd = open(opts.dev, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		return -1;
+	if (posix_memalign(&buf, 4096, READ_BS)) {
+		close(fd);
+		return -1;
+	}
+
+	end = now_ns() + opts.seconds * 1000000000ULL;
+	while ((start = now_ns()) < end) {
+		off_t off = (off_t)(random() % nr_blocks) * READ_BS;
+
+		if (pread(fd, buf, READ_BS, off) != READ_BS)
+			break;
+		if (nr == cap) {
+			size_t new_cap = cap ? cap * 2 : 4096;
+
+			/* keep the latencies gathered so far on failure */
+			tmp = realloc(lat, new_cap * sizeof(*lat));
+			if (!tmp)
+				break;
+			lat = tmp;
+			cap = new_cap;
+		}
+		lat[nr++] = now_ns() - start;
+	}
+
+	free(buf);
+	close(fd);
+	*lat_ret = lat;
+	*nr_ret = nr;
+	return lat ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d dev] [-t seconds] [-w writers] [-b write_kb] [-p]\n"
+		"  -d  block device, overwritten (default %s)\n"
+		"  -t  run time in seconds (default %d)\n"
+		"  -w  number of writer threads (default %d)\n"
+		"  -b  write size in KiB (default %zu)\n"
+		"  -p  put the reader in the realtime I/O class\n",
+		prog, opts.dev, opts.seconds, opts.writers,
+		opts.write_bs >> 10);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t *threads;
+	uint64_t *lat;
+	size_t nr;
+	int c, i, fd, err;
+
+	while ((c = getopt(argc, argv, "d:t:w:b:p")) != -1) {
+		switch (c) {
+		case 'd':
+			opts.dev = optarg;
+			break;
+		case 't':
+			opts.seconds = atoi(optarg);
+			break;
+		case 'w':
+			opts.writers = atoi(optarg);
+			break;
+		case 'b':
+			opts.write_bs = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'p':
+			opts.prio = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (opts.seconds < 1 || opts.writers < 0 || !opts.write_bs ||
+	    opts.write_bs % 4096)
+		usage(argv[0]);
+
+	if (geteuid())
+		ksft_exit_skip("must be run as root\n");
+
+	fd = open(opts.dev, O_RDONLY);
+	if (fd < 0)
+		ksft_exit_skip("%s: %s\n", opts.dev, strerror(errno));
+	if (ioctl(fd, BLKGETSIZE64, &dev_size))
+		ksft_exit_fail_msg("BLKGETSIZE64: %s\n", strerror(errno));
+	close(fd);
+	if (dev_size < 2 * opts.write_bs)
+		ksft_exit_skip("%s is too small\n", opts.dev);
+
+	threads = calloc(opts.writers, sizeof(*threads));
+	if (!threads)
+		ksft_exit_fail_msg("out of memory\n");
+	for (i = 0; i < opts.writers; i++) {
+		if (pthread_create(&threads[i], NULL, writer_thread,
+				   (void *)(uintptr_t)i))
+			ksft_exit_fail_msg("pthread_create failed\n");
+	}
+
+	/* Only now, so that the writers don't inherit it */
+	if (opts.prio &&
+	    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+		    IOPRIO_CLASS_RT << IOPRIO_CLASS_SHIFT))
+		ksft_exit_fail_msg("ioprio_set: %s\n", strerror(errno));
+
+	err = run_reader(&lat, &nr);
+	stop = true;
+	for (i = 0; i < opts.writers; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	if (err || !nr)
+		ksft_exit_fail_msg("reads failed: %s\n", strerror(errno));
+
+	qsort(lat, nr, sizeof(*lat), cmp_u64);
+	printf("reads %zu, usec p50 %llu p99 %llu p99.9 %llu max %llu, writes %.1f MB/s\n",
+	       nr,
+	       (unsigned long long)percentile(lat, nr, 50) / 1000,
+	       (unsigned long long)percentile(lat, nr, 99) / 1000,
+	       (unsigned long long)percentile(lat, nr, 99.9) / 1000,
+	       (unsigned long long)lat[nr - 1] / 1000,
+	       (double)write_bytes / opts.seconds / (1 << 20));
+	free(lat);
+
+	ksft_exit_pass();
+}
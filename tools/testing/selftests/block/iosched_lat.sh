@@ -0,0 +1,32 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare read tail latency under a write load across the available I/O
+# schedulers, on a null_blk device with a single hardware queue whose
+# requests take a fixed time to complete.
+#
+# Usage: iosched_lat.sh [completion_usec] [queue_depth] [extra iosched_lat args]
+
+dir=$(dirname "$0")
+. "$dir"/null_blk_lib.sh
+
+completion_usec=${1:-200}
+queue_depth=${2:-32}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+
+null_blk_check
+null_blk_load "$completion_usec" "$queue_depth" submit_queues=1
+ret=0
+
+echo "null_blk: ${completion_usec}us per request, queue depth $queue_depth"
+for sched in $(tr -d '[]' < /sys/block/nullb0/queue/scheduler); do
+	echo "$sched" > /sys/block/nullb0/queue/scheduler || continue
+	for prio in "" -p; do
+		out=$("$dir"/iosched_lat -d /dev/nullb0 $prio "$@") || ret=1
+		printf "%-12s %-3s %s\n" "$sched" "$prio" "$(echo "$out" | head -n 1)"
+	done
+done
+
+null_blk_unload
+exit $ret
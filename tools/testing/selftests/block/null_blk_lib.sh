@@ -0,0 +1,42 @@
+# SPDX-License-Identifier: GPL-2.0
+#
+# Shared null_blk setup of the block selftests, to be sourced.
+#
+# The tests run on a single 4GB null_blk device, /dev/nullb0, completing its
+# requests from a timer, and pass their own module options to null_blk_load.
+
+ksft_skip=4
+
+# Skips the test unless run as root with null_blk not in use yet
+null_blk_check()
+{
+	if [ "$(id -u)" -ne 0 ]; then
+		echo "must be run as root"
+		exit $ksft_skip
+	fi
+
+	if [ -e /sys/module/null_blk ]; then
+		echo "null_blk is already loaded"
+		exit $ksft_skip
+	fi
+}
+
+# null_blk_load completion_usec queue_depth [null_blk options]
+null_blk_load()
+{
+	completion_nsec=$(($1 * 1000))
+	hw_queue_depth=$2
+	shift 2
+
+	if ! modprobe null_blk queue_mode=2 irqmode=2 nr_devices=1 gb=4 \
+		hw_queue_depth="$hw_queue_depth" \
+		completion_nsec="$completion_nsec" "$@"; then
+		echo "cannot load null_blk"
+		exit $ksft_skip
+	fi
+}
+
+null_blk_unload()
+{
+	modprobe -r null_blk
+}
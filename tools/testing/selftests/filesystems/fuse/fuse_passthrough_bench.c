@@ -0,0 +1,535 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fio-style comparison of native, FUSE passthrough and FUSE daemon I/O.
+ *
+ * A minimal FUSE daemon is mounted on a temporary directory and exposes a
+ * single backing file twice: "passthrough", opened with
+ * FUSE_DEV_IOC_PASSTHROUGH_OPEN, and "daemon", whose reads and writes are
+ * served by the daemon thread. The same workload is then run against the
+ * backing file itself and against both FUSE files, and the bandwidth and
+ * IOPS of each are reported.
+ *
+ * With a queue depth above 1 the I/O is submitted through Linux AIO, which
+ * exercises the asynchronous passthrough path.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <linux/aio_abi.h>
+#include <linux/fuse.h>
+
+#include <kselftest.h>
+
+#define NODEID_PASSTHROUGH	2
+#define NODEID_DAEMON		3
+#define MAX_WRITE		(128 * 1024)
+#define DEV_BUF_SIZE		(MAX_WRITE + 4096)
+
+static struct {
+	const char *dir;
+	size_t size;
+	size_t bs;
+	int qd;
+	int runs;
+	bool random;
+	bool write;
+	bool drop_caches;
+} opts = {
+	.dir = "/data/local/tmp",
+	.size = 64 << 20,
+	.bs = 4096,
+	.qd = 1,
+	.runs = 3,
+};
+
+static int fuse_fd = -1;
+static int backing_fd = -1;
+
+static void fill_attr(struct fuse_attr *attr, uint64_t nodeid)
+{
+	struct stat st;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->nlink = 1;
+	attr->blksize = 4096;
+
+	if (nodeid == FUSE_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+		return;
+	}
+
+	if (fstat(backing_fd, &st))
+		return;
+
+	attr->mode = S_IFREG | 0644;
+	attr->size = st.st_size;
+	attr->blocks = st.st_blocks;
+	attr->atime = st.st_atim.tv_sec;
+	attr->atimensec = st.st_atim.tv_nsec;
+	attr->mtime = st.st_mtim.tv_sec;
+	attr->mtimensec = st.st_mtim.tv_nsec;
+	attr->ctime = st.st_ctim.tv_sec;
+	attr->ctimensec = st.st_ctim.tv_nsec;
+}
+
+static void reply(uint64_t unique, int error, const void *data, size_t len)
+{
+	struct fuse_out_header out = {
+		.len = sizeof(out) + (error ? 0 : len),
+		.error = error,
+		.unique = unique,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &out, .iov_len = sizeof(out) },
+		{ .iov_base = (void *)data, .iov_len = len },
+	};
+
+	writev(fuse_fd, iov, error ? 1 : 2);
+}
+
+static void do_init(struct fuse_in_header *in)
+{
+	struct fuse_init_out out = {
+		.major = FUSE_KERNEL_VERSION,
+		.minor = FUSE_KERNEL_MINOR_VERSION,
+		.max_readahead = MAX_WRITE,
+		.flags = FUSE_ASYNC_READ | FUSE_BIG_WRITES | FUSE_PASSTHROUGH,
+		.max_background = 64,
+		.congestion_threshold = 48,
+		.max_write = MAX_WRITE,
+		.time_gran = 1,
+	};
+
+	reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void do_lookup(struct fuse_in_header *in, const char *name)
+{
+	struct fuse_entry_out out = {};
+
+	if (in->nodeid != FUSE_ROOT_ID) {
+		reply(in->unique, -ENOENT, NULL, 0);
+		return;
+	}
+
+	if (!strcmp(name, "passthrough"))
+		out.nodeid = NODEID_PASSTHROUGH;
+	else if (!strcmp(name, "daemon"))
+		out.nodeid = NODEID_DAEMON;
+	else {
+		reply(in->unique, -ENOENT, NULL, 0);
+		return;
+	}
+
+	fill_attr(&out.attr, out.nodeid);
+	reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void do_getattr(struct fuse_in_header *in)
+{
+	struct fuse_attr_out out = {};
+
+	fill_attr(&out.attr, in->nodeid);
+	reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void do_open(struct fuse_in_header *in)
+{
+	struct fuse_open_out out = {};
+	uint32_t fd = backing_fd;
+	int id;
+
+	if (in->nodeid == NODEID_PASSTHROUGH) {
+		id = ioctl(fuse_fd, FUSE_DEV_IOC_PASSTHROUGH_OPEN, &fd);
+		if (id <= 0) {
+			reply(in->unique, -errno, NULL, 0);
+			return;
+		}
+		out.passthrough_fh = id;
+	}
+
+	reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void do_read(struct fuse_in_header *in, struct fuse_read_in *arg,
+		    void *buf)
+{
+	ssize_t ret = pread(backing_fd, buf, arg->size, arg->offset);
+
+	if (ret < 0)
+		reply(in->unique, -errno, NULL, 0);
+	else
+		reply(in->unique, 0, buf, ret);
+}
+
+static void do_write(struct fuse_in_header *in, struct fuse_write_in *arg)
+{
+	struct fuse_write_out out = {};
+	ssize_t ret = pwrite(backing_fd, arg + 1, arg->size, arg->offset);
+
+	if (ret < 0) {
+		reply(in->unique, -errno, NULL, 0);
+		return;
+	}
+
+	out.size = ret;
+	reply(in->unique, 0, &out, sizeof(out));
+}
+
+static void *daemon_thread(void *arg)
+{
+	char *buf = malloc(DEV_BUF_SIZE);
+	char *data = malloc(MAX_WRITE);
+
+	if (!buf || !data)
+		return NULL;
+
+	for (;;) {
+		struct fuse_in_header *in = (void *)buf;
+		void *inarg = in + 1;
+		ssize_t len = read(fuse_fd, buf, DEV_BUF_SIZE);
+
+		if (len < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			break;
+		}
+		if (len < (ssize_t)sizeof(*in))
+			break;
+
+		switch (in->opcode) {
+		case FUSE_INIT:
+			do_init(in);
+			break;
+		case FUSE_LOOKUP:
+			do_lookup(in, inarg);
+			break;
+		case FUSE_GETATTR:
+			do_getattr(in);
+			break;
+		case FUSE_OPEN:
+			do_open(in);
+			break;
+		case FUSE_READ:
+			do_read(in, inarg, data);
+			break;
+		case FUSE_WRITE:
+			do_write(in, inarg);
+			break;
+		case FUSE_FLUSH:
+		case FUSE_RELEASE:
+		case FUSE_FSYNC:
+			reply(in->unique, 0, NULL, 0);
+			break;
+		case FUSE_FORGET:
+		case FUSE_BATCH_FORGET:
+			break;
+		case FUSE_DESTROY:
+			reply(in->unique, 0, NULL, 0);
+			goto out;
+		default:
+			reply(in->unique, -ENOSYS, NULL, 0);
+			break;
+		}
+	}
+out:
+	free(data);
+	free(buf);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static off_t next_offset(size_t *done, size_t nr_blocks)
+{
+	if (opts.random)
+		return (off_t)(random() % nr_blocks) * opts.bs;
+	return (off_t)((*done)++ % nr_blocks) * opts.bs;
+}
+
+static int run_sync(int fd, char *buf, size_t nr_ios, size_t nr_blocks)
+{
+	size_t i, seq = 0;
+	ssize_t ret;
+
+	for (i = 0; i < nr_ios; i++) {
+		off_t off = next_offset(&seq, nr_blocks);
+
+		if (opts.write)
+			ret = pwrite(fd, buf, opts.bs, off);
+		else
+			ret = pread(fd, buf, opts.bs, off);
+		if (ret != (ssize_t)opts.bs)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int run_aio(int fd, char *buf, size_t nr_ios, size_t nr_blocks)
+{
+	struct iocb *iocbs = calloc(opts.qd, sizeof(*iocbs));
+	struct io_event *events = calloc(opts.qd, sizeof(*events));
+	aio_context_t ctx = 0;
+	size_t submitted = 0, completed = 0, seq = 0;
+	int i, n, ret = -1;
+
+	if (!iocbs || !events || syscall(__NR_io_setup, opts.qd, &ctx))
+		goto out_free;
+
+	while (completed < nr_ios) {
+		struct iocb *batch[opts.qd];
+		int nr = 0;
+
+		/* refill the free slots, whose iocbs are all zeroed */
+		for (i = 0; i < opts.qd && submitted + nr < nr_ios; i++) {
+			struct iocb *iocb = &iocbs[i];
+
+			if (iocb->aio_data)
+				continue;
+			iocb->aio_data = 1;
+			iocb->aio_fildes = fd;
+			iocb->aio_lio_opcode = opts.write ? IOCB_CMD_PWRITE :
+							    IOCB_CMD_PREAD;
+			iocb->aio_buf = (uintptr_t)(buf + i * opts.bs);
+			iocb->aio_nbytes = opts.bs;
+			iocb->aio_offset = next_offset(&seq, nr_blocks);
+			batch[nr++] = iocb;
+		}
+
+		if (nr) {
+			if (syscall(__NR_io_submit, ctx, nr, batch) != nr)
+				goto out_destroy;
+			submitted += nr;
+		}
+
+		n = syscall(__NR_io_getevents, ctx, 1, opts.qd, events, NULL);
+		if (n < 0)
+			goto out_destroy;
+		for (i = 0; i < n; i++) {
+			struct iocb *iocb = (void *)(uintptr_t)events[i].obj;
+
+			if (events[i].res != (int64_t)opts.bs)
+				goto out_destroy;
+			memset(iocb, 0, sizeof(*iocb));
+		}
+		completed += n;
+	}
+	ret = 0;
+
+out_destroy:
+	syscall(__NR_io_destroy, ctx);
+out_free:
+	free(events);
+	free(iocbs);
+	return ret;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		return;
+	if (write(fd, "3", 1) != 1)
+		ksft_print_msg("failed to drop caches\n");
+	close(fd);
+}
+
+static int bench(const char *name, const char *path)
+{
+	size_t nr_blocks = opts.size / opts.bs;
+	double elapsed = 0, start;
+	char *buf;
+	int fd, run, ret = 0;
+
+	if (posix_memalign((void **)&buf, 4096, opts.bs * opts.qd))
+		return -1;
+	memset(buf, 0xa5, opts.bs * opts.qd);
+
+	fd = open(path, opts.write ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		ksft_print_msg("%s: open %s: %s\n", name, path,
+			       strerror(errno));
+		free(buf);
+		return -1;
+	}
+
+	for (run = 0; run < opts.runs && !ret; run++) {
+		if (opts.drop_caches)
+			drop_caches();
+
+		start = now();
+		if (opts.qd > 1)
+			ret = run_aio(fd, buf, nr_blocks, nr_blocks);
+		else
+			ret = run_sync(fd, buf, nr_blocks, nr_blocks);
+		elapsed += now() - start;
+	}
+
+	if (ret)
+		ksft_print_msg("%s: I/O error: %s\n", name, strerror(errno));
+	else
+		printf("%-12s %10.1f MB/s %10.0f IOPS\n", name,
+		       (double)opts.size * opts.runs / elapsed / (1 << 20),
+		       (double)nr_blocks * opts.runs / elapsed);
+
+	close(fd);
+	free(buf);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d dir] [-s size_mb] [-b block_kb] [-q depth] [-n runs] [-r] [-w] [-c]\n"
+		"  -d  directory for the backing file and mount point (default %s)\n"
+		"  -s  file size in MiB (default %zu)\n"
+		"  -b  block size in KiB (default %zu)\n"
+		"  -q  queue depth, above 1 uses Linux AIO (default %d)\n"
+		"  -n  number of runs (default %d)\n"
+		"  -r  random instead of sequential offsets\n"
+		"  -w  write instead of read\n"
+		"  -c  drop the page cache before each run\n",
+		prog, opts.dir, opts.size >> 20, opts.bs >> 10, opts.qd,
+		opts.runs);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	char backing[PATH_MAX], mnt[PATH_MAX], path[PATH_MAX + 16], mopts[128];
+	pthread_t daemon;
+	char *buf;
+	size_t off;
+	int c, err = 0;
+
+	while ((c = getopt(argc, argv, "d:s:b:q:n:rwc")) != -1) {
+		switch (c) {
+		case 'd':
+			opts.dir = optarg;
+			break;
+		case 's':
+			opts.size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			opts.bs = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'q':
+			opts.qd = atoi(optarg);
+			break;
+		case 'n':
+			opts.runs = atoi(optarg);
+			break;
+		case 'r':
+			opts.random = true;
+			break;
+		case 'w':
+			opts.write = true;
+			break;
+		case 'c':
+			opts.drop_caches = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!opts.bs || opts.size < opts.bs || opts.qd < 1 || opts.runs < 1)
+		usage(argv[0]);
+
+	if (geteuid())
+		ksft_exit_skip("must be run as root\n");
+
+	fuse_fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fuse_fd < 0)
+		ksft_exit_skip("/dev/fuse: %s\n", strerror(errno));
+
+	snprintf(backing, sizeof(backing), "%s/fuse_bench.XXXXXX", opts.dir);
+	backing_fd = mkstemp(backing);
+	if (backing_fd < 0)
+		ksft_exit_fail_msg("mkstemp %s: %s\n", backing, strerror(errno));
+
+	buf = malloc(1 << 20);
+	if (!buf)
+		ksft_exit_fail_msg("out of memory\n");
+	memset(buf, 0x5a, 1 << 20);
+	for (off = 0; off < opts.size; off += 1 << 20) {
+		if (pwrite(backing_fd, buf, 1 << 20, off) != 1 << 20) {
+			unlink(backing);
+			ksft_exit_fail_msg("filling %s: %s\n", backing,
+					   strerror(errno));
+		}
+	}
+	free(buf);
+	fsync(backing_fd);
+
+	snprintf(mnt, sizeof(mnt), "%s/fuse_mnt.XXXXXX", opts.dir);
+	if (!mkdtemp(mnt)) {
+		unlink(backing);
+		ksft_exit_fail_msg("mkdtemp %s: %s\n", mnt, strerror(errno));
+	}
+
+	snprintf(mopts, sizeof(mopts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0", fuse_fd);
+	if (mount("fuse", mnt, "fuse", MS_NOSUID | MS_NODEV, mopts)) {
+		rmdir(mnt);
+		unlink(backing);
+		ksft_exit_skip("mount fuse: %s\n", strerror(errno));
+	}
+
+	if (pthread_create(&daemon, NULL, daemon_thread, NULL)) {
+		umount2(mnt, MNT_DETACH);
+		rmdir(mnt);
+		unlink(backing);
+		ksft_exit_fail_msg("pthread_create failed\n");
+	}
+
+	printf("%s %s, %zu MiB, bs %zu KiB, qd %d, %d runs%s\n",
+	       opts.random ? "random" : "sequential",
+	       opts.write ? "write" : "read", opts.size >> 20, opts.bs >> 10,
+	       opts.qd, opts.runs, opts.drop_caches ? ", cold cache" : "");
+
+	err |= bench("native", backing);
+	snprintf(path, sizeof(path), "%s/passthrough", mnt);
+	err |= bench("passthrough", path);
+	snprintf(path, sizeof(path), "%s/daemon", mnt);
+	err |= bench("daemon", path);
+
+	umount2(mnt, MNT_DETACH);
+	pthread_join(daemon, NULL);
+	close(fuse_fd);
+	rmdir(mnt);
+	close(backing_fd);
+	unlink(backing);
+
+	if (err)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}